@@ -0,0 +1,249 @@
+#include "BlenderAction.h"
+
+#include "BlenderThreadPool.h"
+#include "BlenderTrace.h"
+
+#include <cmath>
+#include <cstring>
+
+// About 12 hours at 24 fps, a longer bake is a damaged range
+static const float s_MaxBakedRows = (float)(1 << 20);
+
+// Shortens the handles of a segment so their frames do not
+// overlap, which keeps the frame monotonic in t
+static void CorrectBezierPart(const float v1[2], float v2[2], float v3[2], const float v4[2]) {
+	float h1[2] = { v1[0] - v2[0], v1[1] - v2[1] };
+	float h2[2] = { v4[0] - v3[0], v4[1] - v3[1] };
+
+	float length = v4[0] - v1[0];
+	float length1 = fabsf(h1[0]);
+	float length2 = fabsf(h2[0]);
+
+	if(length1 + length2 == 0.0f || length1 + length2 <= length) {
+		return;
+	}
+
+	float fac = length / (length1 + length2);
+	v2[0] = v1[0] - fac * h1[0];
+	v2[1] = v1[1] - fac * h1[1];
+	v3[0] = v4[0] - fac * h2[0];
+	v3[1] = v4[1] - fac * h2[1];
+}
+
+static float Bezier(float p0, float p1, float p2, float p3, float t) {
+	float s = 1.0f - t;
+	return s * s * s * p0 + 3.0f * s * s * t * p1 + 3.0f * s * t * t * p2 + t * t * t * p3;
+}
+
+// Finds t for the frame by bisection, the corrected
+// segment is monotonic so this always converges
+static float SolveBezierSegment(const BlenderKeyframe &a, const BlenderKeyframe &b, float frame) {
+	float p0[2] = { a.points[1][0], a.points[1][1] };
+	float p1[2] = { a.points[2][0], a.points[2][1] };
+	float p2[2] = { b.points[0][0], b.points[0][1] };
+	float p3[2] = { b.points[1][0], b.points[1][1] };
+
+	CorrectBezierPart(p0, p1, p2, p3);
+
+	float low = 0.0f, high = 1.0f, t = 0.5f;
+	for(int i=0; i < 32; i++) {
+		t = 0.5f * (low + high);
+
+		if(Bezier(p0[0], p1[0], p2[0], p3[0], t) < frame) {
+			low = t;
+		}
+		else {
+			high = t;
+		}
+	}
+
+	return Bezier(p0[1], p1[1], p2[1], p3[1], t);
+}
+
+// Slope past an end key, from its handle for bezier keys
+// and from the neighbouring key for linear ones
+static float ExtrapolateSlope(const BlenderFCurve &curve, bool before) {
+	size_t count = curve.keys.size();
+	const BlenderKeyframe &key = before ? curve.keys[0] : curve.keys[count-1];
+	const BlenderKeyframe &neighbour = before ? curve.keys[1] : curve.keys[count-2];
+
+	if(key.interpolation == BLENDER_IPO_CONSTANT) {
+		return 0.0f;
+	}
+
+	const float *from = neighbour.points[1];
+	if(key.interpolation != BLENDER_IPO_LINEAR) {
+		from = before ? key.points[0] : key.points[2];
+	}
+
+	float dx = key.points[1][0] - from[0];
+	return (dx != 0.0f) ? (key.points[1][1] - from[1]) / dx : 0.0f;
+}
+
+float BlenderEvaluateFCurve(const BlenderFCurve &curve, float frame) {
+	size_t count = curve.keys.size();
+	if(count == 0) {
+		return 0.0f;
+	}
+
+	const BlenderKeyframe &first = curve.keys[0];
+	const BlenderKeyframe &last = curve.keys[count-1];
+
+	if(frame <= first.points[1][0]) {
+		if(!curve.extrapolateLinear || count == 1) {
+			return first.points[1][1];
+		}
+
+		return first.points[1][1] + ExtrapolateSlope(curve, true) * (frame - first.points[1][0]);
+	}
+
+	if(frame >= last.points[1][0]) {
+		if(!curve.extrapolateLinear || count == 1) {
+			return last.points[1][1];
+		}
+
+		return last.points[1][1] + ExtrapolateSlope(curve, false) * (frame - last.points[1][0]);
+	}
+
+	// The last key at or before the frame
+	size_t low = 0, high = count - 1;
+	while(high - low > 1) {
+		size_t mid = (low + high) / 2;
+
+		if(curve.keys[mid].points[1][0] <= frame) {
+			low = mid;
+		}
+		else {
+			high = mid;
+		}
+	}
+
+	const BlenderKeyframe &a = curve.keys[low];
+	const BlenderKeyframe &b = curve.keys[low+1];
+
+	if(a.interpolation == BLENDER_IPO_CONSTANT) {
+		return a.points[1][1];
+	}
+
+	if(a.interpolation == BLENDER_IPO_LINEAR) {
+		float t = (frame - a.points[1][0]) / (b.points[1][0] - a.points[1][0]);
+		return a.points[1][1] + t * (b.points[1][1] - a.points[1][1]);
+	}
+
+	return SolveBezierSegment(a, b, frame);
+}
+
+// True if every row between first and last is within the
+// tolerance of the line between them, for every channel
+static bool IsLinearRun(const BlenderBakedAction &baked, int first, int last, float tolerance) {
+	const float *a = baked.GetRow(first);
+	const float *b = baked.GetRow(last);
+	float span = baked.times[last] - baked.times[first];
+
+	for(int r=first+1; r < last; r++) {
+		const float *row = baked.GetRow(r);
+		float t = (baked.times[r] - baked.times[first]) / span;
+
+		for(int c=0; c < baked.numChannels; c++) {
+			if(fabsf(a[c] + t * (b[c] - a[c]) - row[c]) > tolerance) {
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+// Greedy: a run is extended while it stays linear, then
+// its last row is kept and starts the next run
+static void ReduceRows(BlenderBakedAction &baked, float tolerance) {
+	int numRows = baked.GetNumRows();
+	if(numRows <= 2) {
+		return;
+	}
+
+	std::vector<int> kept;
+	kept.push_back(0);
+
+	int start = 0;
+	for(int end=2; end < numRows; end++) {
+		if(!IsLinearRun(baked, start, end, tolerance)) {
+			start = end - 1;
+			kept.push_back(start);
+		}
+	}
+
+	kept.push_back(numRows - 1);
+
+	for(size_t i=0; i < kept.size(); i++) {
+		baked.times[i] = baked.times[kept[i]];
+
+		if((int)i != kept[i]) {
+			memcpy(&baked.samples[i * baked.channelStride], baked.GetRow(kept[i]), baked.channelStride * sizeof(float));
+		}
+	}
+
+	baked.times.resize(kept.size());
+	baked.samples.resize(kept.size() * baked.channelStride);
+}
+
+void BlenderBakeAction(const BlenderAction &action, float step, float tolerance, BlenderThreadPool *pool, BlenderBakedAction &baked) {
+	BLENDER_TRACE_SCOPE("BlenderBakeAction");
+
+	baked.numChannels = (int)action.curves.size();
+	baked.channelStride = (baked.numChannels + 3) & ~3;
+	baked.times.clear();
+	baked.samples.clear();
+
+	if(!std::isfinite(step) || !std::isfinite(action.frameStart) || !std::isfinite(action.frameEnd)) {
+		BLENDER_LOG(BLENDER_TRACE_WARNING, "Action " << action.name << " has a non-finite frame range or step, not baked");
+		return;
+	}
+
+	if(step <= 0.0f || action.frameEnd < action.frameStart || baked.numChannels == 0) {
+		return;
+	}
+
+	// The last row is always at frameEnd
+	float length = action.frameEnd - action.frameStart;
+	float rows = floorf(length / step + 1e-4f) + 1.0f;
+	if(!(rows < s_MaxBakedRows)) {
+		BLENDER_LOG(BLENDER_TRACE_WARNING, "Action " << action.name << " would bake " << rows << " rows, not baked");
+		return;
+	}
+
+	int numRows = (int)rows;
+	if((numRows - 1) * step < length - 1e-4f) {
+		numRows += 1;
+	}
+
+	baked.times.resize(numRows);
+	baked.samples.assign((size_t)numRows * baked.channelStride, 0.0f);
+
+	std::function<void(size_t, size_t)> sample = [&](size_t begin, size_t end) {
+		for(size_t r=begin; r < end; r++) {
+			float frame = action.frameStart + r * step;
+			if(frame > action.frameEnd || (int)r == numRows - 1) {
+				frame = action.frameEnd;
+			}
+
+			baked.times[r] = frame;
+			float *row = &baked.samples[r * baked.channelStride];
+
+			for(int c=0; c < baked.numChannels; c++) {
+				row[c] = BlenderEvaluateFCurve(action.curves[c], frame);
+			}
+		}
+	};
+
+	if(pool) {
+		pool->ParallelFor(numRows, 16, sample);
+	}
+	else {
+		sample(0, numRows);
+	}
+
+	if(tolerance > 0.0f) {
+		ReduceRows(baked, tolerance);
+	}
+}
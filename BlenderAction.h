@@ -0,0 +1,95 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+class BlenderThreadPool;
+
+// Interpolation of the segment after a key, BezTriple.ipo.
+// The easing modes Blender added later are sampled as bezier.
+enum BlenderInterpolation {
+	BLENDER_IPO_CONSTANT	= 0,
+	BLENDER_IPO_LINEAR		= 1,
+	BLENDER_IPO_BEZIER		= 2
+};
+
+// A BezTriple of an F-curve: the left handle, the key and the
+// right handle, each a (frame, value) pair
+struct BlenderKeyframe {
+	float points[3][2];
+	char interpolation;
+};
+
+// One animated value, e.g. the second array element of
+// pose.bones["Hand"].location. Values are as Blender stores
+// them, bone channels are in bone space.
+struct BlenderFCurve {
+	std::string rnaPath;
+	int arrayIndex;
+
+	// The bone of a pose.bones["..."] path, empty otherwise.
+	// boneIndex is the bone in the file's armature, -1 if
+	// it has no bone of that name.
+	std::string boneName;
+	int boneIndex;
+
+	// FCurve.extend, past the ends the curve keeps its
+	// first and last value unless this is set
+	bool extrapolateLinear;
+
+	// Sorted by frame
+	std::vector<BlenderKeyframe> keys;
+};
+
+// The curves of one bone, as indices into BlenderAction::curves
+struct BlenderBoneCurves {
+	std::string boneName;
+	int boneIndex;
+	std::vector<int> curves;
+};
+
+// Every curve sampled at a fixed step. Rows are frame-major:
+// all channels of one sample are contiguous, channel c of
+// row r is samples[r * channelStride + c]. The stride is a
+// multiple of 4 so rows stay 16-byte aligned. With reduction,
+// rows that linear interpolation between their neighbours
+// reproduces are dropped, and times holds the frame of
+// every row that is left.
+struct BlenderBakedAction {
+	int numChannels;
+	int channelStride;
+	std::vector<float> times;
+	std::vector<float> samples;
+
+	int GetNumRows() const				{ return (int)times.size(); }
+	const float *GetRow(int row) const	{ return &samples[row * channelStride]; }
+};
+
+struct BlenderAction {
+	std::string name;
+
+	// In file order, a channel of the baked action per curve
+	std::vector<BlenderFCurve> curves;
+
+	// Curves grouped by bone, in order of first appearance.
+	// Curves that do not animate a bone are not listed.
+	std::vector<BlenderBoneCurves> bones;
+
+	// First and last key over all curves
+	float frameStart;
+	float frameEnd;
+
+	// Set when the file was loaded with actionBakeStep
+	BlenderBakedAction baked;
+};
+
+// Value of the curve at a frame, as Blender evaluates
+// it without modifiers
+float BlenderEvaluateFCurve(const BlenderFCurve &curve, float frame);
+
+// Samples every curve of the action from frameStart to frameEnd
+// every step frames, the rows run in parallel on the pool. A
+// tolerance above 0 then drops the rows that are within it.
+// Non-finite ranges and bakes of a million rows or more are
+// left empty.
+void BlenderBakeAction(const BlenderAction &action, float step, float tolerance, BlenderThreadPool *pool, BlenderBakedAction &baked);
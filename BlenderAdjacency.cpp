@@ -0,0 +1,105 @@
+#include "BlenderAdjacency.h"
+
+#include "BlenderThreadPool.h"
+
+#include <atomic>
+#include <vector>
+#include <algorithm>
+
+static void RunBatches(BlenderThreadPool *pool, size_t count, size_t minBatch, const std::function<void(size_t begin, size_t end)> &fn) {
+	if(pool) {
+		pool->ParallelFor(count, minBatch, fn);
+	}
+	else {
+		fn(0, count);
+	}
+}
+
+void BlenderBuildAdjacency(BlenderArena &arena, BlenderThreadPool *pool, size_t numSources, unsigned int numLists,
+						   const std::function<int(size_t source, unsigned int keys[4])> &keys, BlenderAdjacency &result) {
+	BLENDER_TRACE_SCOPE("BlenderBuildAdjacency");
+
+	const size_t minBatch = 1 << 12;
+	std::vector<std::atomic<unsigned int> > cursors(numLists);
+
+	RunBatches(pool, numLists, minBatch, [&](size_t begin, size_t end) {
+		for(size_t i=begin; i < end; i++) {
+			cursors[i].store(0, std::memory_order_relaxed);
+		}
+	});
+
+	// Counts
+	RunBatches(pool, numSources, minBatch, [&](size_t begin, size_t end) {
+		unsigned int list[4];
+
+		for(size_t s=begin; s < end; s++) {
+			int n = keys(s, list);
+			for(int k=0; k < n; k++) {
+				cursors[list[k]].fetch_add(1, std::memory_order_relaxed);
+			}
+		}
+	});
+
+	// Prefix sum, each block sums its lists, the block totals
+	// are scanned, then each block writes its offsets
+	result.numLists = numLists;
+	result.offsets = arena.AllocateArray<unsigned int>(numLists + 1);
+
+	const size_t blockSize = 1 << 14;
+	size_t numBlocks = (numLists + blockSize - 1) / blockSize;
+	std::vector<unsigned int> blockStart(numBlocks + 1, 0);
+
+	RunBatches(pool, numBlocks, 1, [&](size_t begin, size_t end) {
+		for(size_t b=begin; b < end; b++) {
+			size_t last = (b+1) * blockSize < numLists ? (b+1) * blockSize : numLists;
+			unsigned int sum = 0;
+
+			for(size_t i=b * blockSize; i < last; i++) {
+				sum += cursors[i].load(std::memory_order_relaxed);
+			}
+
+			blockStart[b+1] = sum;
+		}
+	});
+
+	for(size_t b=0; b < numBlocks; b++) {
+		blockStart[b+1] += blockStart[b];
+	}
+
+	RunBatches(pool, numBlocks, 1, [&](size_t begin, size_t end) {
+		for(size_t b=begin; b < end; b++) {
+			size_t last = (b+1) * blockSize < numLists ? (b+1) * blockSize : numLists;
+			unsigned int running = blockStart[b];
+
+			for(size_t i=b * blockSize; i < last; i++) {
+				unsigned int count = cursors[i].load(std::memory_order_relaxed);
+				result.offsets[i] = running;
+				cursors[i].store(running, std::memory_order_relaxed);
+				running += count;
+			}
+		}
+	});
+
+	result.offsets[numLists] = blockStart[numBlocks];
+	result.items = arena.AllocateArray<unsigned int>(blockStart[numBlocks]);
+
+	// Fill, the slot order within a list depends on timing
+	RunBatches(pool, numSources, minBatch, [&](size_t begin, size_t end) {
+		unsigned int list[4];
+
+		for(size_t s=begin; s < end; s++) {
+			int n = keys(s, list);
+			for(int k=0; k < n; k++) {
+				unsigned int slot = cursors[list[k]].fetch_add(1, std::memory_order_relaxed);
+				result.items[slot] = (unsigned int)s;
+			}
+		}
+	});
+
+	// so sorting each list makes it deterministic
+	RunBatches(pool, numLists, minBatch, [&](size_t begin, size_t end) {
+		for(size_t i=begin; i < end; i++) {
+			std::sort(result.items + result.offsets[i], result.items + result.offsets[i+1]);
+		}
+	});
+}
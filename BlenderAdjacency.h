@@ -0,0 +1,32 @@
+#pragma once
+
+#include <functional>
+
+#include "BlenderArena.h"
+#include "BlenderSpan.h"
+
+class BlenderThreadPool;
+
+// Neighbour lists in compressed rows: the items of list i
+// are items[offsets[i]] to items[offsets[i+1]-1], sorted
+struct BlenderAdjacency {
+	unsigned int *offsets;
+	unsigned int *items;
+	unsigned int numLists;
+
+	BlenderAdjacency() { offsets = 0; items = 0; numLists = 0; }
+
+	bool IsValid() const { return offsets != 0; }
+
+	BlenderSpan<const unsigned int> Get(unsigned int list) const {
+		return BlenderSpan<const unsigned int>(items + offsets[list], offsets[list+1] - offsets[list]);
+	}
+};
+
+// Calls keys for every source, which writes up to 4 list indices
+// and returns how many. Each source is added to those lists. The
+// counts and the fill run in parallel with atomic cursors, and
+// every list is then sorted, so the result is the same for any
+// number of threads. Storage comes from the arena.
+void BlenderBuildAdjacency(BlenderArena &arena, BlenderThreadPool *pool, size_t numSources, unsigned int numLists,
+						   const std::function<int(size_t source, unsigned int keys[4])> &keys, BlenderAdjacency &result);
@@ -0,0 +1,132 @@
+#include "BlenderArena.h"
+
+#include <cstdlib>
+#include <cassert>
+#include <utility>
+
+// Chunks grow geometrically up to this size, larger
+// requests get a chunk of their own
+static const size_t s_MaxChunkSize = 16 << 20;
+static const size_t s_ChunkHeaderSize = 16;
+
+static void *DefaultAllocate(size_t size, void */*userData*/) {
+	return malloc(size);
+}
+
+static void DefaultDeallocate(void *ptr, size_t /*size*/, void */*userData*/) {
+	free(ptr);
+}
+
+///////////////////////////////
+// BlenderArena implementation
+///////////////////////////////
+BlenderArena::BlenderArena(size_t chunkSize) {
+	m_Chunks = 0;
+	m_Cursor = 0;
+	m_End = 0;
+	m_ChunkSize = chunkSize;
+	m_NextChunkSize = chunkSize;
+	m_BytesUsed = 0;
+	m_BytesReserved = 0;
+
+	SetAllocator(0);
+}
+
+BlenderArena::BlenderArena(BlenderArena &&other) {
+	m_Chunks = 0;
+	*this = std::move(other);
+}
+
+BlenderArena &BlenderArena::operator=(BlenderArena &&other) {
+	if(this != &other) {
+		Release();
+
+		m_Allocator = other.m_Allocator;
+		m_Chunks = other.m_Chunks;
+		m_Cursor = other.m_Cursor;
+		m_End = other.m_End;
+		m_ChunkSize = other.m_ChunkSize;
+		m_NextChunkSize = other.m_NextChunkSize;
+		m_BytesUsed = other.m_BytesUsed;
+		m_BytesReserved = other.m_BytesReserved;
+
+		other.m_Chunks = 0;
+		other.m_Cursor = 0;
+		other.m_End = 0;
+		other.m_NextChunkSize = other.m_ChunkSize;
+		other.m_BytesUsed = 0;
+		other.m_BytesReserved = 0;
+	}
+
+	return *this;
+}
+
+void BlenderArena::SetAllocator(const BlenderAllocator *allocator) {
+	assert(m_Chunks == 0 && "The allocator can only be changed while the arena is empty");
+
+	if(allocator && allocator->allocate && allocator->deallocate) {
+		m_Allocator = *allocator;
+	}
+	else {
+		m_Allocator.allocate = DefaultAllocate;
+		m_Allocator.deallocate = DefaultDeallocate;
+		m_Allocator.userData = 0;
+	}
+}
+
+void *BlenderArena::Allocate(size_t size, size_t alignment) {
+	size_t padding = (alignment - ((size_t)m_Cursor & (alignment - 1))) & (alignment - 1);
+
+	if(m_Cursor == 0 || size + padding > (size_t)(m_End - m_Cursor)) {
+		if(size + alignment > m_NextChunkSize) {
+			// Too big for a regular chunk, give it its own
+			// and keep filling the current one afterwards
+			unsigned char *data = (unsigned char *)AllocateChunk(size + alignment) + s_ChunkHeaderSize;
+			m_BytesUsed += size;
+			return data + ((alignment - ((size_t)data & (alignment - 1))) & (alignment - 1));
+		}
+
+		Chunk *chunk = AllocateChunk(m_NextChunkSize);
+		m_Cursor = (unsigned char *)chunk + s_ChunkHeaderSize;
+		m_End = (unsigned char *)chunk + chunk->size;
+
+		if(m_NextChunkSize < s_MaxChunkSize) {
+			m_NextChunkSize *= 2;
+		}
+
+		padding = (alignment - ((size_t)m_Cursor & (alignment - 1))) & (alignment - 1);
+	}
+
+	unsigned char *ptr = m_Cursor + padding;
+	m_Cursor = ptr + size;
+	m_BytesUsed += size;
+
+	return ptr;
+}
+
+BlenderArena::Chunk *BlenderArena::AllocateChunk(size_t size) {
+	Chunk *chunk = (Chunk *)m_Allocator.allocate(size + s_ChunkHeaderSize, m_Allocator.userData);
+	assert(chunk && "Arena chunk allocation failed");
+	BLENDER_TRACE_COUNT(BLENDER_COUNTER_ALLOCATIONS, 1);
+
+	chunk->next = m_Chunks;
+	chunk->size = size + s_ChunkHeaderSize;
+	m_Chunks = chunk;
+	m_BytesReserved += chunk->size;
+
+	return chunk;
+}
+
+void BlenderArena::Release() {
+	while(m_Chunks) {
+		Chunk *next = m_Chunks->next;
+		m_Allocator.deallocate(m_Chunks, m_Chunks->size, m_Allocator.userData);
+		m_Chunks = next;
+	}
+
+	m_Cursor = 0;
+	m_End = 0;
+	m_NextChunkSize = m_ChunkSize;
+	m_BytesUsed = 0;
+	m_BytesReserved = 0;
+}
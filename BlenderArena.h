@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+
+#include "BlenderTrace.h"
+
+// Upstream allocation hooks. An arena requests whole chunks
+// through these, so a host can route importer memory to
+// its own heap. Leave them null to use malloc/free.
+struct BlenderAllocator {
+	void *(*allocate)(size_t size, void *userData);
+	void (*deallocate)(void *ptr, size_t size, void *userData);
+	void *userData;
+};
+
+////////////////////////////////////////////////
+// BlenderArena
+//
+// A monotonic allocator: allocations are carved
+// from large chunks and never freed individually,
+// everything goes at once in Release(). An arena
+// is owned by a single file or mesh, so there is
+// no locking.
+////////////////////////////////////////////////
+class BlenderArena {
+public:
+	BlenderArena(size_t chunkSize = 1 << 16);
+	~BlenderArena() { Release(); }
+
+	BlenderArena(BlenderArena &&other);
+	BlenderArena &operator=(BlenderArena &&other);
+	BlenderArena(const BlenderArena &) = delete;
+	BlenderArena &operator=(const BlenderArena &) = delete;
+
+	void SetAllocator(const BlenderAllocator *allocator);
+
+	void *Allocate(size_t size, size_t alignment = 16);
+
+	// Only for plain structs, no constructors are run
+	template<typename T>
+	T *AllocateArray(size_t count) { return (T *)Allocate(sizeof(T) * count, alignof(T) < 16 ? 16 : alignof(T)); }
+
+	void Release();
+
+	size_t GetBytesUsed()		{ return m_BytesUsed; }
+	size_t GetBytesReserved()	{ return m_BytesReserved; }
+
+private:
+	struct Chunk {
+		Chunk *next;
+		size_t size;
+	};
+
+	Chunk *AllocateChunk(size_t size);
+
+	BlenderAllocator m_Allocator;
+	Chunk *m_Chunks;
+	unsigned char *m_Cursor;
+	unsigned char *m_End;
+	size_t m_ChunkSize;
+	size_t m_NextChunkSize;
+	size_t m_BytesUsed;
+	size_t m_BytesReserved;
+};
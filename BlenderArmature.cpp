@@ -1,17 +1,23 @@
 #include "BlenderArmature.h"
 
-bool BlenderArmature::LoadArmature(StructureDNA *sdna, std::vector<BlenderFileBlock> &blocks) {
+#include <cstring>
+
+bool BlenderArmature::LoadArmature(StructureDNA *sdna, BlenderSpan<const BlenderFileBlock> blocks) {
+	BLENDER_TRACE_SCOPE("BlenderArmature::LoadArmature");
+
 	if(blocks.size() > 0) {
-		BlenderFileBlock fBlock = blocks[0];
+		const BlenderFileBlock &fBlock = blocks[0];
 
 		m_Name = fBlock.GetString("id.name[66]", sdna);
 
-		std::cout << "\nReading data for armature " << m_Name << "..." << std::endl;
+		BLENDER_LOG(BLENDER_TRACE_INFO, "Reading data for armature " << m_Name << "...");
 
-		// Read in bone data
-		m_Bones = new Bone[blocks.size()-1];
-		for(unsigned int i=1; i < blocks.size()-1; i++) {
-			BlenderFileBlock block = blocks[i];
+		// Read in bone data, packed so the bones
+		// skip the other DATA blocks of the group
+		m_Bones = m_Arena.AllocateArray<Bone>(blocks.size()-1);
+		m_NumBones = 0;
+		for(unsigned int i=1; i < blocks.size(); i++) {
+			const BlenderFileBlock &block = blocks[i];
 			
 			Structure *s = sdna->GetStructureFromBlock(&block);
 			if(sdna->GetType(s->type_idx) != "Bone") {
@@ -19,11 +25,32 @@ bool BlenderArmature::LoadArmature(StructureDNA *sdna, std::vector<BlenderFileBl
 			}
 
 			//unsigned int offset_name = block.GetMemberOffset("name[64]", sdna);
-			std::cout << "Bone Name: " << block.GetString("name[64]", sdna) << std::endl;
-			strcpy_s(m_Bones[i-1].name, block.GetString("name[64]", sdna));
-			m_Bones[i-1].roll = block.GetFloat("roll", sdna);
+			BLENDER_LOG(BLENDER_TRACE_DEBUG, "Bone Name: " << block.GetString("name[64]", sdna));
+			Bone &bone = m_Bones[m_NumBones];
+			memset(&bone, 0, sizeof(Bone));
+			strcpy_s(bone.name, block.GetString("name[64]", sdna));
+			bone.roll = block.GetFloat("roll", sdna);
+			m_NumBones += 1;
 		}
 
 		return true;
 	}
+
+	return false;
+}
+
+int BlenderArmature::FindBone(const std::string &name) const {
+	for(int i=0; i < m_NumBones; i++) {
+		if(name == m_Bones[i].name) {
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+void BlenderArmature::ReleaseArmature() {
+	m_Bones = 0;
+	m_NumBones = 0;
+	m_Arena.Release();
 }
\ No newline at end of file
@@ -1,5 +1,6 @@
 #pragma once
 #include "BlenderFileBlock.h"
+#include "BlenderSpan.h"
 
 struct Bone {
 	Bone *next;
@@ -33,12 +34,32 @@ struct Bone {
 
 class BlenderArmature {
 public:
-	BlenderArmature() {}
+	BlenderArmature() : m_Arena(1 << 12) { m_Bones = 0; m_NumBones = 0; }
 	~BlenderArmature() {}
 
-	bool LoadArmature(StructureDNA *sdna, std::vector<BlenderFileBlock> &blocks);
+	BlenderArmature(BlenderArmature &&other) = default;
+	BlenderArmature &operator=(BlenderArmature &&other) = default;
+	BlenderArmature(const BlenderArmature &) = delete;
+	BlenderArmature &operator=(const BlenderArmature &) = delete;
+
+	void SetAllocator(const BlenderAllocator *allocator) { m_Arena.SetAllocator(allocator); }
+
+	bool LoadArmature(StructureDNA *sdna, BlenderSpan<const BlenderFileBlock> blocks);
+	void ReleaseArmature();
+
+	const std::string &GetName() const { return m_Name; }
+
+	// Bones in file order, only name and roll are read
+	int GetNumBones() const { return m_NumBones; }
+	const Bone *GetBone(int index) const { return &m_Bones[index]; }
+
+	// Index of the bone with this name, -1 if there is none
+	int FindBone(const std::string &name) const;
 
 private:
 	std::string m_Name;
 	Bone *m_Bones;
+	int m_NumBones;
+
+	BlenderArena m_Arena;
 };
\ No newline at end of file
@@ -0,0 +1,333 @@
+#include "BlenderBVH.h"
+
+#include "BlenderMesh.h"
+#include "BlenderThreadPool.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <utility>
+
+static const int s_NumBins = 16;
+static const int s_MaxLeafFaces = 8;
+
+static float HalfArea(const float min[3], const float max[3]) {
+	float dx = max[0] - min[0];
+	float dy = max[1] - min[1];
+	float dz = max[2] - min[2];
+	return dx * dy + dy * dz + dz * dx;
+}
+
+static void EmptyBounds(float min[3], float max[3]) {
+	for(int a=0; a < 3; a++) {
+		min[a] = FLT_MAX;
+		max[a] = -FLT_MAX;
+	}
+}
+
+static void GrowBounds(float min[3], float max[3], const float pmin[3], const float pmax[3]) {
+	for(int a=0; a < 3; a++) {
+		if(pmin[a] < min[a]) min[a] = pmin[a];
+		if(pmax[a] > max[a]) max[a] = pmax[a];
+	}
+}
+
+// Clamped at both ends, a NaN goes to the first bin
+static int GetBin(const float centroid[3], int axis, float binMin, float binScale) {
+	float bin = (centroid[axis] - binMin) * binScale;
+	if(!(bin > 0.0f)) {
+		return 0;
+	}
+
+	return (bin < (float)s_NumBins) ? (int)bin : s_NumBins - 1;
+}
+
+//////////////////////////////////////
+// BlenderBVHBuilder implementation
+//////////////////////////////////////
+BlenderBVHBuilder::BlenderBVHBuilder(const MVert *vertices, const MFace *faces, int numFaces, bool triangulated) {
+	m_Vertices = vertices;
+	m_Faces = faces;
+	m_NumFaces = numFaces;
+	m_Triangulated = triangulated;
+}
+
+void BlenderBVHBuilder::ComputePrimitives(BlenderThreadPool *pool) {
+	m_Primitives.resize(m_NumFaces);
+
+	std::function<void(size_t, size_t)> compute = [this](size_t begin, size_t end) {
+		for(size_t i=begin; i < end; i++) {
+			const MFace &face = m_Faces[i];
+			Primitive &primitive = m_Primitives[i];
+			int numVerts = (face.isQuad && !m_Triangulated) ? 4 : 3;
+
+			EmptyBounds(primitive.min, primitive.max);
+			for(int j=0; j < numVerts; j++) {
+				const float *co = m_Vertices[face.v[j]].co;
+				GrowBounds(primitive.min, primitive.max, co, co);
+			}
+
+			for(int a=0; a < 3; a++) {
+				primitive.centroid[a] = 0.5f * (primitive.min[a] + primitive.max[a]);
+			}
+		}
+	};
+
+	if(pool) {
+		pool->ParallelFor(m_NumFaces, 1 << 12, compute);
+	}
+	else {
+		compute(0, m_NumFaces);
+	}
+}
+
+void BlenderBVHBuilder::Build(BlenderThreadPool *pool) {
+	BLENDER_TRACE_SCOPE("BlenderBVHBuilder::Build");
+
+	m_Nodes.clear();
+	m_FaceIndices.resize(m_NumFaces);
+
+	if(m_NumFaces <= 0) {
+		return;
+	}
+
+	for(int i=0; i < m_NumFaces; i++) {
+		m_FaceIndices[i] = i;
+	}
+
+	ComputePrimitives(pool);
+
+	// Faces with a NaN or infinite corner would wreck the bins.
+	// They go last, in a leaf of their own with empty bounds
+	// that no query reaches.
+	std::vector<int>::iterator last = std::stable_partition(m_FaceIndices.begin(), m_FaceIndices.end(), [this](int face) {
+		return IsFinite(face);
+	});
+
+	int numFinite = (int)(last - m_FaceIndices.begin());
+	int root = 0;
+
+	m_Nodes.reserve(2 * m_NumFaces + 1);
+	m_Nodes.push_back(BlenderBVHNode());
+
+	if(numFinite < m_NumFaces) {
+		BLENDER_LOG(BLENDER_TRACE_WARNING, m_NumFaces - numFinite << " faces with non-finite vertices kept out of the BVH");
+
+		BlenderBVHNode leaf;
+		EmptyBounds(leaf.min, leaf.max);
+		leaf.first = numFinite;
+		leaf.count = m_NumFaces - numFinite;
+
+		if(numFinite == 0) {
+			m_Nodes[0] = leaf;
+			return;
+		}
+
+		m_Nodes.push_back(BlenderBVHNode());
+		m_Nodes.push_back(leaf);
+		root = 1;
+	}
+
+	BuildTree(pool, root, numFinite);
+
+	if(root != 0) {
+		m_Nodes[0] = m_Nodes[root];
+		m_Nodes[0].first = root;
+		m_Nodes[0].count = 0;
+	}
+}
+
+// Checks the corners, GrowBounds would skip a NaN
+bool BlenderBVHBuilder::IsFinite(int face) const {
+	int numVerts = (m_Faces[face].isQuad && !m_Triangulated) ? 4 : 3;
+
+	for(int j=0; j < numVerts; j++) {
+		const float *co = m_Vertices[m_Faces[face].v[j]].co;
+		if(!std::isfinite(co[0]) || !std::isfinite(co[1]) || !std::isfinite(co[2])) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// Builds the tree over the first numFaces entries
+// of the face list, rooted at m_Nodes[root]
+void BlenderBVHBuilder::BuildTree(BlenderThreadPool *pool, int root, int numFaces) {
+	if(!pool) {
+		BuildNode(m_Nodes, root, 0, numFaces, 0, 0);
+		return;
+	}
+
+	// Split serially until the ranges are small enough
+	// to give every worker a few subtrees
+	int deferSize = numFaces / (int)(4 * pool->GetNumThreads());
+	if(deferSize < 1024) {
+		deferSize = 1024;
+	}
+
+	std::vector<Subtree> deferred;
+	BuildNode(m_Nodes, root, 0, numFaces, &deferred, deferSize);
+
+	std::vector<std::vector<BlenderBVHNode> > subtrees(deferred.size());
+	pool->ParallelFor(deferred.size(), 1, [&](size_t begin, size_t end) {
+		for(size_t i=begin; i < end; i++) {
+			subtrees[i].push_back(BlenderBVHNode());
+			BuildNode(subtrees[i], 0, deferred[i].begin, deferred[i].end, 0, 0);
+		}
+	});
+
+	// Each subtree root replaces its placeholder, the rest
+	// is appended with the child indices shifted to match
+	for(size_t i=0; i < subtrees.size(); i++) {
+		const std::vector<BlenderBVHNode> &subtree = subtrees[i];
+		int base = (int)m_Nodes.size() - 1;
+
+		for(size_t k=0; k < subtree.size(); k++) {
+			BlenderBVHNode node = subtree[k];
+			if(node.count == 0) {
+				node.first += base;
+			}
+
+			if(k == 0) {
+				m_Nodes[deferred[i].node] = node;
+			}
+			else {
+				m_Nodes.push_back(node);
+			}
+		}
+	}
+}
+
+void BlenderBVHBuilder::BuildNode(std::vector<BlenderBVHNode> &nodes, int node, int begin, int end, std::vector<Subtree> *deferred, int deferSize) {
+	float centroidMin[3], centroidMax[3];
+	BlenderBVHNode result;
+
+	EmptyBounds(result.min, result.max);
+	EmptyBounds(centroidMin, centroidMax);
+
+	for(int i=begin; i < end; i++) {
+		const Primitive &primitive = m_Primitives[m_FaceIndices[i]];
+		GrowBounds(result.min, result.max, primitive.min, primitive.max);
+		GrowBounds(centroidMin, centroidMax, primitive.centroid, primitive.centroid);
+	}
+
+	result.first = begin;
+	result.count = end - begin;
+	nodes[node] = result;
+
+	if(result.count <= 2) {
+		return;
+	}
+
+	if(deferred && result.count <= deferSize) {
+		Subtree subtree = { node, begin, end };
+		deferred->push_back(subtree);
+		return;
+	}
+
+	float cost;
+	Split split;
+
+	if(!FindSplit(begin, end, centroidMin, centroidMax, &cost, &split)) {
+		return;
+	}
+
+	// Small nodes stay leaves unless splitting is cheaper, with
+	// a traversal step costing as much as one face test
+	float area = HalfArea(result.min, result.max);
+	if(result.count <= s_MaxLeafFaces && (area <= 0.0f || cost / area + 1.0f >= result.count)) {
+		return;
+	}
+
+	int mid = begin;
+	for(int i=begin; i < end; i++) {
+		if(GetBin(m_Primitives[m_FaceIndices[i]].centroid, split.axis, split.binMin, split.binScale) <= split.plane) {
+			std::swap(m_FaceIndices[i], m_FaceIndices[mid]);
+			mid++;
+		}
+	}
+
+	if(mid == begin || mid == end) {
+		return;
+	}
+
+	int left = (int)nodes.size();
+	nodes.push_back(BlenderBVHNode());
+	nodes.push_back(BlenderBVHNode());
+
+	nodes[node].first = left;
+	nodes[node].count = 0;
+
+	BuildNode(nodes, left, begin, mid, deferred, deferSize);
+	BuildNode(nodes, left+1, mid, end, deferred, deferSize);
+}
+
+// Bins the centroids on each axis and sweeps the planes
+// between the bins for the lowest surface area cost
+bool BlenderBVHBuilder::FindSplit(int begin, int end, const float centroidMin[3], const float centroidMax[3], float *cost, Split *split) {
+	bool found = false;
+	*cost = FLT_MAX;
+
+	for(int axis=0; axis < 3; axis++) {
+		float extent = centroidMax[axis] - centroidMin[axis];
+		if(extent <= 0.0f) {
+			continue;
+		}
+
+		float binScale = s_NumBins / extent;
+		float binMin[s_NumBins][3], binMax[s_NumBins][3];
+		int binCount[s_NumBins] = { 0 };
+
+		for(int b=0; b < s_NumBins; b++) {
+			EmptyBounds(binMin[b], binMax[b]);
+		}
+
+		for(int i=begin; i < end; i++) {
+			const Primitive &primitive = m_Primitives[m_FaceIndices[i]];
+			int b = GetBin(primitive.centroid, axis, centroidMin[axis], binScale);
+
+			binCount[b] += 1;
+			GrowBounds(binMin[b], binMax[b], primitive.min, primitive.max);
+		}
+
+		// Left side costs by plane, then the right side
+		// is swept from the other end
+		float leftArea[s_NumBins - 1];
+		int leftCount[s_NumBins - 1];
+		float min[3], max[3];
+		int count = 0;
+
+		EmptyBounds(min, max);
+		for(int b=0; b < s_NumBins - 1; b++) {
+			GrowBounds(min, max, binMin[b], binMax[b]);
+			count += binCount[b];
+			leftArea[b] = count ? HalfArea(min, max) : 0.0f;
+			leftCount[b] = count;
+		}
+
+		EmptyBounds(min, max);
+		count = 0;
+		for(int b=s_NumBins - 1; b > 0; b--) {
+			GrowBounds(min, max, binMin[b], binMax[b]);
+			count += binCount[b];
+
+			int plane = b - 1;
+			if(count == 0 || leftCount[plane] == 0) {
+				continue;
+			}
+
+			float planeCost = leftCount[plane] * leftArea[plane] + count * HalfArea(min, max);
+			if(planeCost < *cost) {
+				*cost = planeCost;
+				split->axis = axis;
+				split->plane = plane;
+				split->binMin = centroidMin[axis];
+				split->binScale = binScale;
+				found = true;
+			}
+		}
+	}
+
+	return found;
+}
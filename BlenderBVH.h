@@ -0,0 +1,75 @@
+#pragma once
+
+#include <vector>
+
+class BlenderThreadPool;
+struct MVert;
+struct MFace;
+
+// 32 bytes, two nodes to a cache line. Inner nodes have
+// count 0 and their children at first and first+1, leaves
+// cover count entries of the face list starting at first.
+struct BlenderBVHNode {
+	float min[3];
+	int first;
+	float max[3];
+	int count;
+};
+
+////////////////////////////////////////////////
+// BlenderBVHBuilder
+//
+// Binned SAH build over the faces of a mesh.
+// With a pool, the top of the tree is split on
+// the calling thread and the subtrees below it
+// are built on the workers. Only the node order
+// depends on the number of threads.
+////////////////////////////////////////////////
+class BlenderBVHBuilder {
+public:
+	// Faces of a triangulated mesh use three vertices,
+	// otherwise isQuad faces use all four
+	BlenderBVHBuilder(const MVert *vertices, const MFace *faces, int numFaces, bool triangulated);
+
+	void Build(BlenderThreadPool *pool);
+
+	const std::vector<BlenderBVHNode> &GetNodes() const { return m_Nodes; }
+	const std::vector<int> &GetFaces() const { return m_FaceIndices; }
+
+private:
+	struct Primitive {
+		float min[3];
+		float max[3];
+		float centroid[3];
+	};
+
+	// Faces at or below the plane go to the left child
+	struct Split {
+		int axis;
+		int plane;
+		float binMin;
+		float binScale;
+	};
+
+	// A range left for the workers, its root is nodes[node]
+	struct Subtree {
+		int node;
+		int begin;
+		int end;
+	};
+
+	bool IsFinite(int face) const;
+	void ComputePrimitives(BlenderThreadPool *pool);
+	void BuildTree(BlenderThreadPool *pool, int root, int numFaces);
+	void BuildNode(std::vector<BlenderBVHNode> &nodes, int node, int begin, int end, std::vector<Subtree> *deferred, int deferSize);
+	bool FindSplit(int begin, int end, const float centroidMin[3], const float centroidMax[3], float *cost, Split *split);
+
+	const MVert *m_Vertices;
+	const MFace *m_Faces;
+	int m_NumFaces;
+	bool m_Triangulated;
+
+	std::vector<Primitive> m_Primitives;
+	std::vector<BlenderBVHNode> m_Nodes;
+	std::vector<int> m_FaceIndices;
+};
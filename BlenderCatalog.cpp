@@ -0,0 +1,279 @@
+#include "BlenderCatalog.h"
+
+#include "BlenderFile.h"
+#include "BlenderThreadPool.h"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+namespace fs = std::filesystem;
+
+// Index file layout: the magic, the entry count, then per entry
+// the path, mtime, size, valid flag, id count and the ids.
+// Strings are a 32-bit length and the bytes, all little endian.
+static const char s_IndexMagic[8] = { 'B', 'L', 'E', 'N', 'D', 'C', 'A', '1' };
+
+static void WriteValue(std::ofstream &file, unsigned long long value, int bytes) {
+	unsigned char buffer[8];
+	for(int i=0; i < bytes; i++) {
+		buffer[i] = (unsigned char)(value >> (i * 8));
+	}
+
+	file.write((const char *)buffer, bytes);
+}
+
+static unsigned long long ReadValue(std::ifstream &file, int bytes) {
+	unsigned char buffer[8] = { 0 };
+	file.read((char *)buffer, bytes);
+
+	unsigned long long value = 0;
+	for(int i=0; i < bytes; i++) {
+		value |= (unsigned long long)buffer[i] << (i * 8);
+	}
+
+	return value;
+}
+
+static void WriteString(std::ofstream &file, const std::string &text) {
+	WriteValue(file, text.size(), 4);
+	file.write(text.data(), text.size());
+}
+
+static bool ReadString(std::ifstream &file, std::string &text) {
+	size_t length = (size_t)ReadValue(file, 4);
+
+	// A bad length fails the read instead of allocating
+	// whatever a damaged index says
+	if(!file.good() || length > (1 << 16)) {
+		return false;
+	}
+
+	text.resize(length);
+	if(length) {
+		file.read(&text[0], length);
+	}
+
+	return file.good();
+}
+
+// The mtime is only compared for equality, so the clock's
+// own tick count is stored as is
+static bool StatFile(const fs::path &path, long long &mtime, unsigned long long &size) {
+	std::error_code error;
+
+	size = (unsigned long long)fs::file_size(path, error);
+	if(error) {
+		return false;
+	}
+
+	mtime = (long long)fs::last_write_time(path, error).time_since_epoch().count();
+	return !error;
+}
+
+////////////////////////////////////
+// BlenderCatalog implementation
+////////////////////////////////////
+bool BlenderCatalog::ScanFile(const std::string &path, BlenderCatalogEntry &entry) {
+	entry.path = path;
+	entry.ids.clear();
+	entry.valid = false;
+
+	if(!StatFile(path, entry.mtime, entry.size)) {
+		return false;
+	}
+
+	BlenderFile file(path, BlenderImporterConfig());
+	entry.valid = file.ScanIDs(entry.ids);
+
+	if(!entry.valid) {
+		entry.ids.clear();
+	}
+
+	return entry.valid;
+}
+
+size_t BlenderCatalog::Scan(const std::string &directory, unsigned int numThreads) {
+	BLENDER_TRACE_SCOPE("BlenderCatalog::Scan");
+
+	BlenderThreadPool pool(numThreads);
+
+	// Each level of the tree is listed in parallel, one
+	// directory per task. Symlinked directories are not
+	// followed, so a link cycle cannot trap the crawl.
+	std::vector<std::string> paths;
+	std::vector<fs::path> level(1, fs::path(directory));
+
+	while(!level.empty()) {
+		std::vector<std::vector<fs::path> > subdirectories(level.size());
+		std::vector<std::vector<std::string> > files(level.size());
+
+		pool.ParallelFor(level.size(), 1, [&](size_t begin, size_t end) {
+			for(size_t d=begin; d < end; d++) {
+				std::error_code error;
+				fs::directory_iterator it(level[d], fs::directory_options::skip_permission_denied, error);
+
+				for(; !error && it != fs::directory_iterator(); it.increment(error)) {
+					const fs::directory_entry &item = *it;
+
+					if(item.is_symlink(error)) {
+						continue;
+					}
+
+					if(item.is_directory(error)) {
+						subdirectories[d].push_back(item.path());
+					}
+					else if(item.path().extension() == ".blend") {
+						files[d].push_back(item.path().generic_string());
+					}
+				}
+			}
+		});
+
+		level.clear();
+		for(size_t d=0; d < files.size(); d++) {
+			paths.insert(paths.end(), files[d].begin(), files[d].end());
+			level.insert(level.end(), subdirectories[d].begin(), subdirectories[d].end());
+		}
+	}
+
+	std::sort(paths.begin(), paths.end());
+
+	std::vector<BlenderCatalogEntry> entries(paths.size());
+	std::vector<char> scanned(paths.size(), 0);
+
+	// Unchanged files keep their entry, every other file
+	// is scanned. Entries are only read here, each task
+	// writes its own slots.
+	pool.ParallelFor(paths.size(), 1, [&](size_t begin, size_t end) {
+		for(size_t i=begin; i < end; i++) {
+			BlenderCatalogEntry &entry = entries[i];
+
+			if(!StatFile(paths[i], entry.mtime, entry.size)) {
+				entry.path = paths[i];
+				entry.valid = false;
+				continue;
+			}
+
+			const BlenderCatalogEntry *old = FindEntry(paths[i]);
+			if(old && old->mtime == entry.mtime && old->size == entry.size) {
+				entry = *old;
+				continue;
+			}
+
+			ScanFile(paths[i], entry);
+			scanned[i] = 1;
+		}
+	});
+
+	m_Entries.swap(entries);
+	BuildPathIndex();
+
+	size_t numScanned = std::count(scanned.begin(), scanned.end(), 1);
+	BLENDER_LOG(BLENDER_TRACE_INFO, m_Entries.size() << " files in catalog, " << numScanned << " scanned");
+
+	return numScanned;
+}
+
+const BlenderCatalogEntry *BlenderCatalog::FindEntry(const std::string &path) {
+	std::unordered_map<std::string, size_t>::const_iterator it = m_EntriesByPath.find(path);
+	return (it == m_EntriesByPath.end()) ? 0 : &m_Entries[it->second];
+}
+
+void BlenderCatalog::BuildPathIndex() {
+	m_EntriesByPath.clear();
+
+	for(size_t i=0; i < m_Entries.size(); i++) {
+		m_EntriesByPath[m_Entries[i].path] = i;
+	}
+}
+
+bool BlenderCatalog::LoadIndex(const std::string &indexPath) {
+	std::ifstream file(indexPath.c_str(), std::ios::in | std::ios::binary);
+	if(!file.is_open()) {
+		return false;
+	}
+
+	char magic[8];
+	file.read(magic, 8);
+	if(!file.good() || memcmp(magic, s_IndexMagic, 8) != 0) {
+		return false;
+	}
+
+	size_t numEntries = (size_t)ReadValue(file, 8);
+	std::vector<BlenderCatalogEntry> entries;
+
+	for(size_t i=0; i < numEntries && file.good(); i++) {
+		BlenderCatalogEntry entry;
+		if(!ReadString(file, entry.path)) {
+			return false;
+		}
+
+		entry.mtime = (long long)ReadValue(file, 8);
+		entry.size = ReadValue(file, 8);
+		entry.valid = ReadValue(file, 1) != 0;
+
+		size_t numIDs = (size_t)ReadValue(file, 4);
+		for(size_t k=0; k < numIDs && file.good(); k++) {
+			std::string name;
+			if(!ReadString(file, name)) {
+				return false;
+			}
+
+			entry.ids.push_back(name);
+		}
+
+		entries.push_back(entry);
+	}
+
+	if(!file.good()) {
+		return false;
+	}
+
+	std::sort(entries.begin(), entries.end(), [](const BlenderCatalogEntry &a, const BlenderCatalogEntry &b) { return a.path < b.path; });
+
+	m_Entries.swap(entries);
+	BuildPathIndex();
+
+	return true;
+}
+
+// Written to a temporary file that then replaces the index,
+// so an interrupted save leaves the old index intact
+bool BlenderCatalog::SaveIndex(const std::string &indexPath) {
+	std::string temporary = indexPath + ".tmp";
+
+	{
+		std::ofstream file(temporary.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+		if(!file.is_open()) {
+			return false;
+		}
+
+		file.write(s_IndexMagic, 8);
+		WriteValue(file, m_Entries.size(), 8);
+
+		for(size_t i=0; i < m_Entries.size(); i++) {
+			const BlenderCatalogEntry &entry = m_Entries[i];
+
+			WriteString(file, entry.path);
+			WriteValue(file, (unsigned long long)entry.mtime, 8);
+			WriteValue(file, entry.size, 8);
+			WriteValue(file, entry.valid ? 1 : 0, 1);
+			WriteValue(file, entry.ids.size(), 4);
+
+			for(size_t k=0; k < entry.ids.size(); k++) {
+				WriteString(file, entry.ids[k]);
+			}
+		}
+
+		if(!file.good()) {
+			return false;
+		}
+	}
+
+	std::error_code error;
+	fs::rename(temporary, indexPath, error);
+
+	return !error;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+// The datablocks of one .blend, as found by a header-only
+// scan. mtime and size are the file's when it was scanned.
+struct BlenderCatalogEntry {
+	std::string path;
+	long long mtime;
+	unsigned long long size;
+
+	// False if the file could not be read as a .blend,
+	// e.g. a compressed file. It is not rescanned until
+	// it changes.
+	bool valid;
+
+	// ID names with their code, e.g. "MECube", "OBCube",
+	// "MAWood", "ARRig", in file order
+	std::vector<std::string> ids;
+};
+
+////////////////////////////////////////////////
+// BlenderCatalog
+//
+// Lists the datablocks of every .blend under a
+// directory without loading them. Entries are
+// kept by path, and a file is only scanned again
+// when its mtime or size changes. The entries can
+// be saved to and loaded from an index file.
+////////////////////////////////////////////////
+class BlenderCatalog {
+public:
+	BlenderCatalog() {}
+
+	// Crawls the directory and its subdirectories, one level
+	// at a time, and scans new and changed files on numThreads
+	// threads, 0 for the hardware concurrency. Entries of
+	// files that are gone are dropped. Returns the number of
+	// files that were scanned.
+	size_t Scan(const std::string &directory, unsigned int numThreads = 0);
+
+	// Header-only scan of a single file, see BlenderFile::ScanIDs
+	static bool ScanFile(const std::string &path, BlenderCatalogEntry &entry);
+
+	// The index replaces the current entries on load. Both
+	// return false if the file could not be read or written.
+	bool LoadIndex(const std::string &indexPath);
+	bool SaveIndex(const std::string &indexPath);
+
+	// Sorted by path
+	size_t GetNumEntries() { return m_Entries.size(); }
+	const BlenderCatalogEntry *GetEntry(size_t index) { return &m_Entries[index]; }
+
+	// Null if the path is not in the catalog
+	const BlenderCatalogEntry *FindEntry(const std::string &path);
+
+private:
+	void BuildPathIndex();
+
+	std::vector<BlenderCatalogEntry> m_Entries;
+	std::unordered_map<std::string, size_t> m_EntriesByPath;
+};
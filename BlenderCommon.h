@@ -1,6 +1,135 @@
 #pragma once
+#include <cstddef>
+#include <string>
+#include <vector>
+
+struct BlenderAllocator;
+class BlenderMesh;
+
+// Streaming import: each mesh is extracted as soon as its
+// block group ends and the group's raw payloads are freed
+// right away. Blocks outside mesh and armature groups are
+// skipped, not retained.
+struct BlenderStreamingConfig {
+	bool enabled = false;
+
+	// Upper bound in bytes on retained meshes plus the group
+	// being read, 0 for no bound. Reaching it hands the
+	// retained meshes to onMesh before reading continues.
+	size_t memoryBudget = 0;
+
+	// Receives every extracted mesh, and may move it out.
+	// Without one, meshes stay in the file.
+	void (*onMesh)(BlenderMesh &mesh, void *userData) = 0;
+	void *userData = 0;
+};
+
+// Pipelined import: a background thread reads the file ahead
+// of the parser while finished mesh groups are extracted on
+// worker threads, so I/O, parsing and extraction overlap.
+// Meshes still come out in file order.
+struct BlenderPipelineConfig {
+	bool enabled = false;
+
+	// Read-ahead buffering, numChunks chunks of chunkSize
+	// bytes are kept in flight
+	size_t readAheadChunkSize = 4 << 20;
+	unsigned int readAheadChunks = 4;
+
+	// Mesh extraction workers, 0 for one per hardware thread
+	unsigned int extractionThreads = 0;
+};
+
+// Mesh extraction steps, positions are always read
+enum BlenderExtractFlags {
+	BLENDER_EXTRACT_POSITIONS		= 0,
+	BLENDER_EXTRACT_NORMALS			= 1 << 0,
+	BLENDER_EXTRACT_UVS				= 1 << 1,
+	BLENDER_EXTRACT_DEFORM_WEIGHTS	= 1 << 2,
+	BLENDER_EXTRACT_ATTRIBUTES		= 1 << 3,
+	BLENDER_EXTRACT_EDGES			= 1 << 4,
+	BLENDER_EXTRACT_SHAPE_KEYS		= 1 << 5,
+	BLENDER_EXTRACT_ACTIONS			= 1 << 6,
+	BLENDER_EXTRACT_ALL				= 0xffffffff
+};
+
+// Restricts what Load reads, an empty list matches everything.
+// Rejected payloads are skipped with a seek and never read.
+struct BlenderLoadFilter {
+	// Block codes of datablocks to keep, e.g. "ME", "AR", "OB".
+	// A rejected datablock takes its DATA blocks with it.
+	std::vector<std::string> idCodes;
+
+	// SDNA types of DATA blocks to keep, e.g. "MVert", "MPoly"
+	std::vector<std::string> structTypes;
+
+	// Datablock names, with or without the code prefix
+	// ("Collision" or "MECollision")
+	std::vector<std::string> names;
+
+	// Datablock names, with or without the code prefix. Only
+	// they and the blocks they point to, directly or not, are
+	// loaded, see BlenderFile::BuildReachableSet.
+	std::vector<std::string> roots;
+
+	// BlenderExtractFlags, DATA blocks only the disabled
+	// steps would read are skipped as well
+	unsigned int extract = BLENDER_EXTRACT_ALL;
+};
+
 struct BlenderImporterConfig {
-	bool flipYZ;
-	bool triangulate;
-	bool vertexUVs;
+	bool flipYZ = false;
+	bool triangulate = false;
+	bool vertexUVs = false;
+
+	// Sorts faces by mat_nr into one BlenderSubmesh per
+	// material, so each can be drawn with one call
+	bool materialSubmeshes = false;
+
+	// Builds a BVH over each mesh's faces, see
+	// BlenderMesh::BuildBVH
+	bool buildBVH = false;
+
+	// Generates a tangent per vertex, best combined with
+	// vertexUVs, see BlenderMesh::GenerateTangents
+	bool tangents = false;
+
+	// Face ratios in (0, 1) of the LODs to generate for
+	// every mesh, e.g. { 0.5f, 0.25f }. Empty for none.
+	std::vector<float> lodRatios;
+
+	// Builds neighbour lists for every mesh, see
+	// BlenderMesh::BuildAdjacency
+	bool adjacency = false;
+
+	// Samples every action each actionBakeStep frames, 0 keeps
+	// only the curves. A tolerance above 0 drops the samples
+	// linear interpolation reproduces, see BlenderBakeAction.
+	float actionBakeStep = 0.0f;
+	float actionBakeTolerance = 0.0f;
+
+	// Loads the datablocks linked from other .blend files
+	// through BlenderLibraryCache, see BlenderFile::ResolveLibraries
+	bool linkLibraries = false;
+
+	// Leaves packed file payloads (embedded images, fonts and
+	// sounds) on disk, BlenderFile::LoadPackedFile reads one
+	// when it is needed
+	bool deferPackedFiles = false;
+
+	// Checks every block header against the file size and
+	// the SDNA before any payload is read, so a damaged or
+	// truncated file fails the load instead of crashing it.
+	// Costs one extra walk over the headers, turn it off
+	// for trusted files.
+	bool validate = true;
+
+	// Source of the chunks for the file and mesh arenas,
+	// null uses malloc/free. With the pipeline enabled it
+	// is called from several threads at once.
+	const BlenderAllocator *allocator = 0;
+
+	BlenderStreamingConfig streaming;
+	BlenderPipelineConfig pipeline;
+	BlenderLoadFilter filter;
 };
\ No newline at end of file
@@ -1,48 +1,144 @@
 #include "BlenderFile.h"
 #include "BlenderImporter.h"
 
+#include <utility>
+#include <algorithm>
+#include <cstring>
+
 ///////////////////////////////
 // BlenderFile implementation
 ///////////////////////////////
-BlenderFile::BlenderFile(std::string filename, BlenderImporterConfig config) {
-	m_Filename = filename;
+BlenderFile::BlenderFile(std::string filename, BlenderImporterConfig config) : BlenderFile(BlenderSource::File(filename), config) {
+}
+
+BlenderFile::BlenderFile(BlenderSource source, BlenderImporterConfig config) : m_Arena(1 << 20), m_StreamArena(1 << 20) {
+	m_Filename = source.filename;
+	m_Source = source;
 	m_Config = config;
+	m_CurrentGroup = BLOCK_GROUP_NONE;
+	m_SkippingGroup = false;
+	m_RetainedMeshBytes = 0;
+	m_LoadState = BLENDER_LOAD_IDLE;
+	m_Cancelled = false;
+	m_PackedFileStruct = -1;
+	m_FilterReachable = false;
+	m_SDNAFirst = false;
+	m_BlocksRead = 0;
+	m_NextMeshGroup = 0;
+
+	m_Arena.SetAllocator(config.allocator);
+	m_StreamArena.SetAllocator(config.allocator);
+	m_Armature.SetAllocator(config.allocator);
 }
 
 BlenderFile::~BlenderFile() {
+	if(m_LoadState == BLENDER_LOAD_BLOCKS || m_LoadState == BLENDER_LOAD_EXTRACT) {
+		AbortLoad();
+	}
 }
 
-void BlenderFile::Release() {
-	m_Mesh.ReleaseMesh();
-	//m_Armature.ReleaseArmature();
-	ReleaseFileBlocks();
+BlenderFile::BlenderFile(BlenderFile &&other) : BlenderFile() {
+	MoveFrom(other);
 }
 
-void BlenderFile::ReleaseFileBlocks() {
-	for(unsigned int i=0; i < m_FileBlocks.size(); i++) {
-		m_FileBlocks[i].ReleaseBuffer();
+BlenderFile &BlenderFile::operator=(BlenderFile &&other) {
+	if(this != &other) {
+		if(m_Pool) {
+			m_Pool->Wait();
+		}
+
+		MoveFrom(other);
 	}
 
-	m_FileBlocks.clear();
+	return *this;
+}
 
-	for(unsigned int i=0; i < m_MeshBlocks.size(); i++) {
-		m_MeshBlocks[i].ReleaseBuffer();
+// Extraction tasks hold the address of the file they were
+// queued by, so they have to finish before anything moves
+void BlenderFile::MoveFrom(BlenderFile &other) {
+	if(other.m_Pool) {
+		other.m_Pool->Wait();
 	}
 
-	m_MeshBlocks.clear();
+	m_Filename			= std::move(other.m_Filename);
+	m_Source			= other.m_Source;
+	m_Config			= std::move(other.m_Config);
+	m_Mapping			= std::move(other.m_Mapping);
+
+	m_LoadState			= other.m_LoadState;
+	m_Error				= std::move(other.m_Error);
+	m_Reader			= std::move(other.m_Reader);
+	m_SDNAFirst			= other.m_SDNAFirst;
+	m_Cancelled			= other.m_Cancelled;
+	m_BlocksRead		= other.m_BlocksRead;
+	m_NextMeshGroup		= other.m_NextMeshGroup;
+
+	m_FileHeader		= other.m_FileHeader;
+	m_FileBlocks		= std::move(other.m_FileBlocks);
+	m_MeshBlocks		= std::move(other.m_MeshBlocks);
+	m_ArmatureBlocks	= std::move(other.m_ArmatureBlocks);
+	m_SDNA				= std::move(other.m_SDNA);
+	m_Arena				= std::move(other.m_Arena);
+
+	m_MeshGroups		= std::move(other.m_MeshGroups);
+	m_CurrentGroup		= other.m_CurrentGroup;
+	m_SkippingGroup		= other.m_SkippingGroup;
+	m_SkipStructs		= std::move(other.m_SkipStructs);
+	m_StreamArena		= std::move(other.m_StreamArena);
+	m_RetainedMeshBytes	= other.m_RetainedMeshBytes;
+
+	m_BlocksByStruct	= std::move(other.m_BlocksByStruct);
+	m_BlocksByAddress	= std::move(other.m_BlocksByAddress);
+
+	m_Meshes			= std::move(other.m_Meshes);
+	m_Armature			= std::move(other.m_Armature);
+	m_Objects			= std::move(other.m_Objects);
+	m_Instances			= std::move(other.m_Instances);
+	m_Actions			= std::move(other.m_Actions);
+	m_PackedFiles		= std::move(other.m_PackedFiles);
+	m_Libraries			= std::move(other.m_Libraries);
+	m_LinkedIDs			= std::move(other.m_LinkedIDs);
+
+	// The accessor points at the SDNA it was made from
+	m_PackedFileStruct	= other.m_PackedFileStruct;
+	m_PackedFileData	= (m_PackedFileStruct == -1) ? BlenderFieldAccessor() : BlenderFieldAccessor(&m_SDNA, m_PackedFileStruct, "data", m_FileHeader.pointer_size);
+	m_PackedAddresses	= std::move(other.m_PackedAddresses);
+	m_PackedOffsets		= std::move(other.m_PackedOffsets);
+
+	m_FilterReachable	= other.m_FilterReachable;
+	m_Reachable			= std::move(other.m_Reachable);
+
+	m_PendingMeshes		= std::move(other.m_PendingMeshes);
+	m_Pool				= std::move(other.m_Pool);
+
+	other.m_LoadState = BLENDER_LOAD_IDLE;
+}
 
-	for(unsigned int i=0; i < m_ArmatureBlocks.size(); i++) {
-		m_ArmatureBlocks[i].ReleaseBuffer();
+// Block payloads all live in the file arena, so
+// there is no need to visit the blocks one by one.
+// Mesh attributes still pointing into them are
+// copied out first.
+void BlenderFile::ReleaseFileBlocks() {
+	for(size_t i=0; i < m_Meshes.size(); i++) {
+		m_Meshes[i].CopyAttributes();
 	}
 
+	m_FileBlocks.clear();
+	m_MeshBlocks.clear();
+	m_MeshGroups.clear();
 	m_ArmatureBlocks.clear();
+	m_BlocksByStruct.clear();
+	m_BlocksByAddress.clear();
+	m_PackedFiles.clear();
+
+	m_Arena.Release();
 }
 
-std::string BlenderFile::GetFilename() {
+std::string BlenderFile::GetFilename() const {
 	return m_Filename;
 }
 
-std::string BlenderFile::GetHeaderInfo() {
+std::string BlenderFile::GetHeaderInfo() const {
 	char buffer[256];
 
 	sprintf_s(buffer, "Identifier: %s\nPointer Size: %u\nLittle Endian: %s\nVersion: %s\n",
@@ -55,19 +151,414 @@ std::string BlenderFile::GetHeaderInfo() {
 	return output;
 }
 
-void BlenderFile::Load() {
-	std::fstream file;
-	file.open(m_Filename.c_str(), std::fstream::in | std::fstream::binary);
+bool BlenderFile::Load() {
+	BLENDER_TRACE_SCOPE("BlenderFile::Load");
+
+	if(BeginLoad()) {
+		LoadStep(0);
+	}
+
+	return m_LoadState == BLENDER_LOAD_DONE;
+}
+
+// Opens the file and reads the header, and the SDNA when it
+// is needed up front. The blocks are read by LoadStep.
+bool BlenderFile::BeginLoad() {
+	BLENDER_TRACE_SCOPE("BlenderFile::BeginLoad");
+
+	const BlenderPipelineConfig &pipeline = m_Config.pipeline;
+	bool opened;
+
+	m_Error.clear();
+
+	// Only files are read ahead, the other sources are
+	// in memory already or read by the caller
+	if(pipeline.enabled && m_Source.type == BLENDER_SOURCE_FILE) {
+		BlenderReadAheadReader *readAhead = new BlenderReadAheadReader(pipeline.readAheadChunkSize, pipeline.readAheadChunks);
+		m_Reader.reset(readAhead);
+		opened = readAhead->Open(m_Filename);
+	}
+	else {
+		m_Reader = OpenReader();
+		opened = (m_Reader != 0);
+	}
+
+	if(pipeline.enabled) {
+		m_Pool.reset(new BlenderThreadPool(pipeline.extractionThreads));
+	}
+
+	if(!opened) {
+		FailLoad("Failed to open file: " + m_Filename);
+		return false;
+	}
+
+	if(!ReadFileHeader(m_Reader.get())) {
+		FailLoad("File Header is incorrect, this is either a compressed file or not a blend file.");
+		return false;
+	}
+
+	BLENDER_LOG(BLENDER_TRACE_INFO, "Header Info:\n" << GetHeaderInfo());
+
+	const BlenderLoadFilter &filter = m_Config.filter;
+
+	// Streaming and the pipeline extract each group as soon as
+	// it ends, and filtering by struct or name needs the types
+	// up front, so then the SDNA at the end of the file is read
+	// first. Validation reads it on its walk over the headers.
+	m_SDNAFirst = m_Config.validate || m_Config.streaming.enabled || pipeline.enabled || !filter.structTypes.empty() || !filter.names.empty() || filter.extract != BLENDER_EXTRACT_ALL || m_Config.deferPackedFiles || !filter.roots.empty();
+
+	if(m_SDNAFirst) {
+		if(!LocateSDNA(m_Reader.get())) {
+			FailLoad(m_Error);
+			return false;
+		}
+
+		BuildStructFilter();
+
+		if(m_Config.deferPackedFiles) {
+			m_PackedFileStruct = m_SDNA.GetStructureIndex("PackedFile");
+			m_PackedFileData = BlenderFieldAccessor(&m_SDNA, m_PackedFileStruct, "data", m_FileHeader.pointer_size);
+		}
+
+		if(!filter.roots.empty()) {
+			BuildReachableSet(m_Reader.get());
+		}
+	}
+
+	BLENDER_LOG(BLENDER_TRACE_INFO, "Loading Fileblocks...");
+
+	m_BlocksRead = 0;
+	m_NextMeshGroup = 0;
+	m_Cancelled = false;
+	m_LoadState = BLENDER_LOAD_BLOCKS;
+
+	return true;
+}
+
+// Advances the load until it finishes or budgetMs has passed,
+// 0 meaning no limit. The budget is checked after every block
+// and every mesh extraction, so a step can overrun it by one.
+BlenderLoadState BlenderFile::LoadStep(double budgetMs) {
+	long long deadline = 0;
+	if(budgetMs > 0) {
+		deadline = BlenderTrace::Now() + (long long)(budgetMs * 1000.0);
+	}
+
+	while(m_LoadState == BLENDER_LOAD_BLOCKS || m_LoadState == BLENDER_LOAD_EXTRACT) {
+		if(m_Cancelled) {
+			AbortLoad();
+			break;
+		}
+
+		if(m_LoadState == BLENDER_LOAD_BLOCKS) {
+			if(!ReadNextBlock() && m_LoadState == BLENDER_LOAD_BLOCKS) {
+				FinishBlocks();
+			}
+		}
+		else if(m_NextMeshGroup < m_MeshGroups.size() && !m_Config.pipeline.enabled) {
+			ExtractMesh(m_MeshGroups[m_NextMeshGroup]);
+			m_NextMeshGroup += 1;
+		}
+		else {
+			FinishLoad();
+		}
+
+		if(deadline && BlenderTrace::Now() >= deadline) {
+			break;
+		}
+	}
+
+	return m_LoadState;
+}
+
+// Parsing counts for the first 90% by bytes read,
+// extraction for the rest by mesh group
+float BlenderFile::GetProgress() const {
+	if(m_LoadState == BLENDER_LOAD_DONE) {
+		return 1.0f;
+	}
+
+	if(m_LoadState == BLENDER_LOAD_BLOCKS && m_Reader && m_Reader->Size()) {
+		return 0.9f * (float)m_Reader->Tell() / (float)m_Reader->Size();
+	}
+
+	if(m_LoadState == BLENDER_LOAD_EXTRACT) {
+		float extracted = m_MeshGroups.empty() ? 1.0f : (float)m_NextMeshGroup / (float)m_MeshGroups.size();
+		return 0.9f + 0.1f * extracted;
+	}
+
+	return 0.0f;
+}
+
+// Takes effect at the start of the next LoadStep
+void BlenderFile::Cancel() {
+	if(m_LoadState == BLENDER_LOAD_BLOCKS || m_LoadState == BLENDER_LOAD_EXTRACT) {
+		m_Cancelled = true;
+	}
+}
+
+// A new reader at the start of the source, null if it cannot
+// be opened. A mapped file is mapped once, every later reader
+// shares the mapping.
+std::unique_ptr<BlenderReader> BlenderFile::OpenReader() {
+	if(m_Source.type == BLENDER_SOURCE_MAPPED && !m_Mapping) {
+		std::shared_ptr<BlenderMappedFile> mapping(new BlenderMappedFile());
+		if(!mapping->Open(m_Source.filename)) {
+			return std::unique_ptr<BlenderReader>();
+		}
+
+		m_Mapping = mapping;
+	}
+
+	return static_cast<const BlenderFile *>(this)->OpenReader();
+}
+
+// Opens the source without keeping anything, a mapped
+// source that is not open yet is read as a plain file
+std::unique_ptr<BlenderReader> BlenderFile::OpenReader() const {
+	switch(m_Source.type) {
+	case BLENDER_SOURCE_MAPPED:
+		if(!m_Mapping) {
+			break;
+		}
+
+		return std::unique_ptr<BlenderReader>(new BlenderMemoryReader(m_Mapping->GetData(), m_Mapping->GetSize()));
+
+	case BLENDER_SOURCE_MEMORY:
+		return std::unique_ptr<BlenderReader>(new BlenderMemoryReader((const unsigned char *)m_Source.data, m_Source.size));
+
+	case BLENDER_SOURCE_CALLBACK:
+		if(!m_Source.read || !m_Source.seek || !m_Source.seek(0, m_Source.userData)) {
+			return std::unique_ptr<BlenderReader>();
+		}
+
+		return std::unique_ptr<BlenderReader>(new BlenderCallbackReader(m_Source));
+
+	default:
+		break;
+	}
+
+	BlenderFileReader *fileReader = new BlenderFileReader();
+	std::unique_ptr<BlenderReader> reader(fileReader);
+
+	if(!fileReader->Open(m_Source.filename)) {
+		return std::unique_ptr<BlenderReader>();
+	}
+
+	return reader;
+}
+
+// Reads one block, returns false after ENDB or when the load fails
+bool BlenderFile::ReadNextBlock() {
+	BlenderReader *reader = m_Reader.get();
+	bool streaming = m_Config.streaming.enabled;
+
+	BlenderFileBlock fileBlock;
+	fileBlock.LoadHeader(reader, m_FileHeader.pointer_size);
+	m_BlocksRead += 1;
+
+	if(!reader->Good()) {
+		FailLoad("Unexpected end of file, no ENDB block");
+		return false;
+	}
+
+	if(strcmp("DNA1", fileBlock.m_Header.code) == 0) {
+		if(m_SDNAFirst) {
+			// Already extracted by LocateSDNA
+			fileBlock.SkipPayload(reader);
+			return true;
+		}
+
+		// Extract the Structure DNA and release the block, it is
+		// the only payload that does not go into the arena
+		if(fileBlock.m_Header.size > reader->Size() - reader->Tell()) {
+			FailLoad("SDNA block runs past the end of the file");
+			return false;
+		}
+
+		fileBlock.LoadPayload(reader, 0);
+
+		if(!ExtractSDNA(fileBlock)) {
+			FailLoad(m_Error);
+			return false;
+		}
+
+		return true;
+	}
+
+	bool done = (strcmp("ENDB", fileBlock.m_Header.code) == 0);
+
+	bool isData = (strcmp("DATA", fileBlock.m_Header.code) == 0);
+
+	// Any block other than DATA closes the current group
+	if(!isData) {
+		EndGroup();
+		m_SkippingGroup = !done && (!AcceptIDBlock(fileBlock, reader) || !IsReachable(fileBlock));
+
+		if(m_SkippingGroup) {
+			BLENDER_LOG(BLENDER_TRACE_VERBOSE, "Skipping block: " << fileBlock.m_Header.code);
+		} else if(strcmp("ME", fileBlock.m_Header.code) == 0) {
+			BeginGroup(BLOCK_GROUP_MESH);
+		} else if(strcmp("AR", fileBlock.m_Header.code) == 0) {
+			BeginGroup(BLOCK_GROUP_ARMATURE);
+		}
+		else {
+			BLENDER_LOG(BLENDER_TRACE_VERBOSE, "Block: " << fileBlock.m_Header.code);
+		}
+	}
+
+	if(m_SkippingGroup || (isData && ((fileBlock.m_Header.sdna < m_SkipStructs.size() && m_SkipStructs[fileBlock.m_Header.sdna]) || !IsReachable(fileBlock)))) {
+		fileBlock.SkipPayload(reader);
+		return !done;
+	}
+
+	if(isData && !m_PackedAddresses.empty() && DeferPackedPayload(fileBlock, reader)) {
+		return !done;
+	}
+
+	if(streaming) {
+		if(m_CurrentGroup == BLOCK_GROUP_NONE) {
+			fileBlock.SkipPayload(reader);
+			return !done;
+		}
+
+		ApplyBackpressure(fileBlock.m_Header.size);
+		fileBlock.LoadPayload(reader, &m_StreamArena);
+	}
+	else {
+		fileBlock.LoadPayload(reader, &m_Arena);
+	}
+
+	// The payload of a PackedFile follows it
+	if(isData && m_PackedFileData.IsPointer() && (int)fileBlock.m_Header.sdna == m_PackedFileStruct) {
+		m_PackedAddresses.insert(m_PackedFileData.GetPointer(fileBlock));
+	}
+
+	if(m_CurrentGroup == BLOCK_GROUP_MESH) {
+		m_MeshBlocks.push_back(std::move(fileBlock));
+	} else if(m_CurrentGroup == BLOCK_GROUP_ARMATURE) {
+		m_ArmatureBlocks.push_back(std::move(fileBlock));
+	}
+	else {
+		m_FileBlocks.push_back(std::move(fileBlock));
+	}
+
+	return !done;
+}
+
+// Skips the payload of a deferred packed file and keeps where
+// it starts, LoadPackedFile reads it from there
+bool BlenderFile::DeferPackedPayload(BlenderFileBlock &block, BlenderReader *reader) {
+	std::unordered_set<const void *>::iterator it = m_PackedAddresses.find(block.m_Header.old_mem_address);
+	if(it == m_PackedAddresses.end()) {
+		return false;
+	}
+
+	m_PackedAddresses.erase(it);
+	m_PackedOffsets[block.m_Header.old_mem_address] = std::make_pair(reader->Tell(), (size_t)block.m_Header.size);
+	block.SkipPayload(reader);
+
+	return true;
+}
+
+// Closes the file once every block has been read
+void BlenderFile::FinishBlocks() {
+	BLENDER_LOG(BLENDER_TRACE_INFO, m_BlocksRead << " data blocks processed.");
+
+	m_Reader.reset();
+	BuildBlockIndex();
+
+	if(!Query("MDeformWeight").empty()) {
+		BLENDER_LOG(BLENDER_TRACE_DEBUG, "MDeformWeight found!");
+	}
+
+	// Collect whatever the workers still have in flight,
+	// the pool stays up for the rest of the load
+	if(m_Pool) {
+		CompletePendingMeshes();
+	}
+
+	m_LoadState = BLENDER_LOAD_EXTRACT;
+}
+
+void BlenderFile::FinishLoad() {
+	if(m_Config.streaming.enabled) {
+		// Whatever is still retained goes to the consumer
+		if(m_Config.streaming.onMesh) {
+			FlushMeshes();
+		}
+	}
+	else {
+		m_Armature.LoadArmature(&m_SDNA, m_ArmatureBlocks);
+		ResolveMaterials();
+
+		if(m_Config.filter.extract & BLENDER_EXTRACT_SHAPE_KEYS) {
+			ResolveShapeKeys();
+		}
+
+		ResolveLibraries();
+		ExtractObjects();
+
+		if(m_Config.filter.extract & BLENDER_EXTRACT_ACTIONS) {
+			ExtractActions();
+		}
+
+		ExtractPackedFiles();
+	}
+
+	m_Pool.reset();
+	m_LoadState = BLENDER_LOAD_DONE;
+}
 
-	if(!file.is_open()) {
-		assert(0 && "Failed to open file.");
+// Drops everything read so far, in-flight extractions
+// are waited for first
+void BlenderFile::AbortLoad() {
+	if(m_Pool) {
+		m_Pool->Wait();
+		m_PendingMeshes.clear();
+		m_Pool.reset();
 	}
 
-	/////////////////////////////////////////////////////////////
-	// BLEND file header is 12 bytes, see BlendFileHeader struct
-	/////////////////////////////////////////////////////////////
+	m_Reader.reset();
+
+	m_Meshes.clear();
+	ReleaseFileBlocks();
+	m_StreamArena.Release();
+	m_Objects.clear();
+	m_Instances.clear();
+	m_Actions.clear();
+	m_Libraries.clear();
+	m_LinkedIDs.clear();
+	m_PackedAddresses.clear();
+	m_PackedOffsets.clear();
+	m_Reachable.clear();
+	m_Armature.ReleaseArmature();
+
+	m_RetainedMeshBytes = 0;
+	m_CurrentGroup = BLOCK_GROUP_NONE;
+	m_SkippingGroup = false;
+	m_Cancelled = false;
+	m_LoadState = BLENDER_LOAD_CANCELLED;
+}
+
+// Drops the partial load like a cancel, keeping the error
+void BlenderFile::FailLoad(const std::string &error) {
+	BLENDER_LOG(BLENDER_TRACE_ERROR, error);
+
+	AbortLoad();
+
+	m_Error = error;
+	m_LoadState = BLENDER_LOAD_FAILED;
+}
+
+/////////////////////////////////////////////////////////////
+// BLEND file header is 12 bytes, see BlendFileHeader struct
+/////////////////////////////////////////////////////////////
+bool BlenderFile::ReadFileHeader(BlenderReader *reader) {
 	char header[12];
-	file.read(header, 12);
+	if(reader->Read(header, 12) != 12) {
+		return false;
+	}
 
 	for(int i=0; i < 7; i++) {
 		m_FileHeader.identifier[i] = header[i];
@@ -76,7 +567,7 @@ void BlenderFile::Load() {
 	m_FileHeader.identifier[7] = 0;
 
 	if(strcmp("BLENDER", m_FileHeader.identifier) != 0) {
-		assert(0 && "File Header Identifier is incorrect, this is either a compressed file or not a blend file.");
+		return false;
 	}
 
 	if(header[7] == '_') {
@@ -86,7 +577,7 @@ void BlenderFile::Load() {
 		m_FileHeader.pointer_size = 8;
 	}
 	else {
-		assert(0 && "Invalid pointer size detected.");
+		return false;
 	}
 
 	if(header[8] == 'v') {
@@ -101,225 +592,1781 @@ void BlenderFile::Load() {
 	}
 	m_FileHeader.version[3] = 0;
 
-	std::cout << "\n\nHeader Info: \n\n" << GetHeaderInfo();
-
-	///////////////////////
-	// Load in file blocks
-	///////////////////////
-	
-	BlenderFileBlock fileBlock;
-	int headerSize = 16 + m_FileHeader.pointer_size;
-	char *fbHeader = new char[headerSize];
-	int counter = 0;
-	int total_counter = 0;
-	bool loadingMeshData = false;
-	bool loadingArmatureData = false;
+	return true;
+}
 
-	std::cout << "Loading Fileblocks...\n";
+// Walks the block headers, seeking over payloads, until the
+// DNA1 block is found and extracted. The reader is left where
+// it started.
+//
+// With config.validate this is the validation pass: the walk
+// goes on to ENDB, every payload has to lie inside the file
+// and every header is checked against the SDNA. The blocks are
+// then read and accessed without further checks.
+bool BlenderFile::LocateSDNA(BlenderReader *reader) {
+	BLENDER_TRACE_SCOPE("BlenderFile::LocateSDNA");
+
+	size_t start = reader->Tell();
+	size_t fileSize = reader->Size();
+	bool validate = m_Config.validate;
+	bool found = false;
+	bool ended = false;
+	char error[256];
+
+	std::vector<BlenderFileBlockHeader> headers;
+
+	while(!ended && (validate || !found)) {
+		size_t position = reader->Tell();
+
+		BlenderFileBlock fileBlock;
+		fileBlock.LoadHeader(reader, m_FileHeader.pointer_size);
+
+		if(!reader->Good()) {
+			sprintf_s(error, "Unexpected end of file at offset %zu, no ENDB block", position);
+			m_Error = error;
+			break;
+		}
 
-	do {
-		fileBlock.Load(&file, m_FileHeader.pointer_size);
+		if(fileBlock.m_Header.size > fileSize - reader->Tell()) {
+			sprintf_s(error, "Block %s at offset %zu runs past the end of the file", fileBlock.m_Header.code, position);
+			m_Error = error;
+			break;
+		}
 
-		if(strcmp("DNA1", fileBlock.m_Header.code) == 0) {
-			// Extract the Structure DNA and release the block
-			bool result = ExtractSDNA(fileBlock);
+		if(strcmp("DNA1", fileBlock.m_Header.code) == 0 && !found) {
+			fileBlock.LoadPayload(reader, 0);
 
-			if(!result) {
-				assert(0 && "There was an error loading SDNA data");
+			if(!ExtractSDNA(fileBlock)) {
+				break;
 			}
 
-			fileBlock.ReleaseBuffer();
-		} else if(strcmp("ME", fileBlock.m_Header.code) == 0) {
-			//std::cout << "\n\nMesh data sdna: " << fileBlock.m_Header.sdna << "\n\n";
-			loadingMeshData = true;
-			m_MeshBlocks.push_back(fileBlock);
-		} else if(strcmp("AR", fileBlock.m_Header.code) == 0) {
-			loadingArmatureData = true;
-			m_ArmatureBlocks.push_back(fileBlock);
+			found = true;
+		} else if(strcmp("ENDB", fileBlock.m_Header.code) == 0) {
+			ended = true;
 		}
 		else {
-			if(loadingMeshData && strcmp("DATA", fileBlock.m_Header.code) == 0) {
-				m_MeshBlocks.push_back(fileBlock);
-			} else if(loadingArmatureData && strcmp("DATA", fileBlock.m_Header.code) == 0) {
-				m_ArmatureBlocks.push_back(fileBlock);
+			if(validate) {
+				headers.push_back(fileBlock.m_Header);
 			}
-			else {
-				if(loadingMeshData) {
-					loadingMeshData = false;
-				}
 
-				if(loadingArmatureData) {
-					loadingArmatureData = false;
-				}
+			fileBlock.SkipPayload(reader);
+		}
+	}
 
-				if(strcmp("DATA", fileBlock.m_Header.code) != 0) {
-					std::cout << std::endl << fileBlock.m_Header.code;
-					counter = 0;
-				}
-				else {
-					counter += 1;
-					if(counter%10 == 0) {
-						std::cout << ".";
-					}	
-				}
+	reader->Seek(start);
 
-				m_FileBlocks.push_back(fileBlock);
-			}
+	if(!found || (validate && !ended)) {
+		if(m_Error.empty()) {
+			m_Error = "Failed to locate the SDNA block";
 		}
 
-		total_counter += 1;
+		return false;
+	}
 
-	} while (strcmp("ENDB", fileBlock.m_Header.code) != 0);
+	for(size_t i=0; i < headers.size(); i++) {
+		if(!ValidateBlockHeader(headers[i])) {
+			return false;
+		}
+	}
 
-	std::cout << total_counter << " data blocks processed.\n";
+	return true;
+}
 
-	// find MDeformWeight block
-	for(unsigned int i=0; i < m_FileBlocks.size(); i++) {
-		Structure *s = m_SDNA.GetStructureFromBlock(&m_FileBlocks[i]);
+// Struct 0 marks raw bytes (pointer arrays, strings, previews),
+// every other block holds count structs of its SDNA type
+bool BlenderFile::ValidateBlockHeader(const BlenderFileBlockHeader &header) {
+	char error[256];
 
-		if(m_SDNA.GetType(s->type_idx) == "MDeformWeight") {
-			std::cout << "MDeformWeight found!";
-		}
+	if(header.sdna >= m_SDNA.structures.size()) {
+		sprintf_s(error, "Block %s has SDNA index %u, the file has %u structs", header.code, header.sdna, (unsigned int)m_SDNA.structures.size());
+		m_Error = error;
+		return false;
 	}
 
-	delete[] fbHeader;
-	file.close();
+	if(header.sdna == 0) {
+		return true;
+	}
 
-	m_Mesh.LoadMesh(&m_SDNA, m_MeshBlocks, m_Config.triangulate, m_Config.vertexUVs, m_Config.flipYZ);
-	m_Armature.LoadArmature(&m_SDNA, m_ArmatureBlocks);
+	unsigned short type = m_SDNA.structures[header.sdna].type_idx;
+	unsigned long long length = m_SDNA.lengths[type];
 
-	std::cout << "\nMesh Data:\n" << m_Mesh.GetMeshInfo().c_str();
+	if((unsigned long long)header.count * length > header.size) {
+		sprintf_s(error, "Block %s holds %u %s of %llu bytes in %u bytes", header.code, header.count, m_SDNA.types[type].c_str(), length, header.size);
+		m_Error = error;
+		return false;
+	}
 
-	/*for(int i=0; i < m_SDNA.structures.size(); i++) {
-		std::cout << i << ": " << m_SDNA.types[m_SDNA.structures[i].type_idx] << ", " << m_SDNA.structures[i].fields.size() << " fields\n";
-	}*/
+	return true;
 }
 
-bool BlenderFile::ExtractSDNA(BlenderFileBlock &block) {
-	std::cout << "\n\nLoading SDNA\n\n";
+// Catalog mode. Walks the block headers, seeking over every
+// payload, and keeps the ID.name of each datablock. Blender
+// writes the SDNA last, so the start of every ID block is kept
+// on the way and the names are cut from it once the SDNA is read.
+bool BlenderFile::ScanIDs(std::vector<std::string> &names) {
+	BLENDER_TRACE_SCOPE("BlenderFile::ScanIDs");
 
-	// Make sure there's nothing in here
-	m_SDNA.names.clear();
-	m_SDNA.lengths.clear();
-	m_SDNA.types.clear();
-	m_SDNA.structures.clear();
+	std::unique_ptr<BlenderReader> reader = OpenReader();
+	if(!reader || !ReadFileHeader(reader.get())) {
+		return false;
+	}
 
-	// Get the buffer and initialize buffer pointer position
-	unsigned char *buffer = block.GetBuffer();
-	size_t pos = 0;
+	const size_t prefixSize = 128;
 
-	// SDNA Identifier
-	if(strncmp("SDNA", (char *)&buffer[pos], 4) != 0) {
-		assert(0 && "SDNA File Block Invalid");
-	}
-	pos += 4;
+	struct PendingID {
+		unsigned int sdna;
+		size_t position;
+		size_t size;
+	};
 
-	// NAMEs identifier
-	if(strncmp("NAME", (char *)&buffer[pos], 4) != 0) {
-		assert(0 && "SDNA File Block Invalid");
-	}
-	pos += 4;
+	std::vector<PendingID> pending;
+	std::vector<char> prefixes;
+	bool found = false;
+	bool ended = false;
 
-	// Get names
-	std::cout << "Loading name data...\n";
-	unsigned int numNames = *((unsigned int *)&buffer[pos]);
-	pos += 4;
+	while(reader->Good()) {
+		BlenderFileBlock fileBlock;
+		fileBlock.LoadHeader(reader.get(), m_FileHeader.pointer_size);
 
-	for(unsigned int i=0; i < numNames; i++) {
-		m_SDNA.names.push_back(std::string((char *)&buffer[pos]));
-		pos += (m_SDNA.names[i].size() + (size_t)1);
-	}
+		if(!reader->Good()) {
+			break;
+		}
 
-	std::cout << "Number of names: " << m_SDNA.names.size() << "\n";
+		if(strcmp("DNA1", fileBlock.m_Header.code) == 0) {
+			if(fileBlock.m_Header.size > reader->Size() - reader->Tell()) {
+				break;
+			}
 
-	// TYPEs identifier
-	while((pos%4) != 0) pos++; // 4 byte alignment
-	if(strncmp("TYPE", (char *)&buffer[pos], 4) != 0) {
-		assert(0 && "SDNA File Block Invalid");
-	}
-	pos += 4;
+			fileBlock.LoadPayload(reader.get(), 0);
+			found = ExtractSDNA(fileBlock);
+			continue;
+		}
 
-	// Get types
-	std::cout << "Loading type data...\n";
-	unsigned int numTypes = *((unsigned int *)&buffer[pos]);
-	pos += 4;
+		if(strcmp("ENDB", fileBlock.m_Header.code) == 0) {
+			ended = true;
+			break;
+		}
 
-	for(unsigned int i=0; i < numTypes; i++) {
-		m_SDNA.types.push_back(std::string((char *)&buffer[pos]));
-		pos += (m_SDNA.types[i].size() + (size_t)1);
-	}
+		if(strcmp("DATA", fileBlock.m_Header.code) != 0) {
+			PendingID id = { fileBlock.m_Header.sdna, reader->Tell(), fileBlock.m_Header.size };
+			size_t length = (id.size < prefixSize) ? id.size : prefixSize;
 
-	std::cout << "Number of types: " << m_SDNA.types.size() << "\n";
+			prefixes.resize(prefixes.size() + prefixSize, 0);
+			reader->Read(&prefixes[prefixes.size() - prefixSize], length);
+			reader->Seek(id.position);
 
-	// LEGNTHs identifier
-	while((pos%4) != 0) pos++; // 4 byte alignment
-	if(strncmp("TLEN", (char *)&buffer[pos], 4) != 0) {
-		assert(0 && "SDNA File Block Invalid");
+			pending.push_back(id);
+		}
+
+		fileBlock.SkipPayload(reader.get());
 	}
-	pos += 4;
 
-	// get lengths
-	std::cout << "Loading type length data...\n";
-	for(unsigned int i=0; i < numTypes; i++) {
-		m_SDNA.lengths.push_back(*(unsigned short *)&buffer[pos]);
-		pos += 2;
+	if(!found || !ended) {
+		return false;
 	}
 
-	std::cout << "Number of lengths: " << m_SDNA.lengths.size() << "\n";
+	for(size_t i=0; i < pending.size(); i++) {
+		int offset = m_SDNA.GetIDNameOffset(pending[i].sdna);
+		if(offset == -1 || offset + 66 > (int)pending[i].size) {
+			continue;
+		}
 
-	// STRUCTURES
-	while((pos%4) != 0) pos++; // 4 byte alignment
-	if(strncmp("STRC", (char *)&buffer[pos], 4) != 0) {
-		assert(0 && "SDNA File Block Invalid");
+		char name[67];
+		if(offset + 66 <= (int)prefixSize) {
+			memcpy(name, &prefixes[i * prefixSize + offset], 66);
+		}
+		else {
+			reader->Seek(pending[i].position + offset);
+			reader->Read(name, 66);
+		}
+
+		name[66] = 0;
+		names.push_back(name);
 	}
-	pos += 4;
 
-	// Get structures
-	std::cout << "Loading structure data...\n";
-	unsigned int numStructs = *((unsigned int *)&buffer[pos]);
-	pos += 4;
+	return true;
+}
 
-	for(unsigned int i=0; i < numStructs; i++) {
-		Structure structure;
-		Field field;
+// Marks the struct types whose DATA blocks are never read, both
+// those missing from the filter list and those only needed by
+// disabled extraction steps
+void BlenderFile::BuildStructFilter() {
+	const BlenderLoadFilter &filter = m_Config.filter;
+	m_SkipStructs.assign(m_SDNA.structures.size(), false);
+
+	std::vector<std::string> skipped;
+	if(!(filter.extract & BLENDER_EXTRACT_UVS)) {
+		skipped.push_back("MLoopUV");
+		skipped.push_back("MTexPoly");
+		skipped.push_back("MTFace");
+	}
 
-		// Get the data type of this structure
-		structure.type_idx = *((unsigned short *)&buffer[pos]);
-		pos += 2;
-
-		// Get each field
-		size_t numFields = *((unsigned short *)&buffer[pos]);
-		pos += 2;
-
-		int offset = 0;
-		for (unsigned int k=0; k < numFields; k++) {
-			// Index into SDNA types array
-			field.type_idx = *((unsigned short *)&buffer[pos]);
-			pos += 2;
-					
-			// Index into SDNA names array
-			field.name_idx = *((unsigned short *)&buffer[pos]);
-			pos += 2;
-
-			field.offset = offset;
-			offset += BlenderImporter::ComputeFieldLength(m_SDNA.names[field.name_idx], m_SDNA.lengths[field.type_idx], m_FileHeader.pointer_size);
+	if(!(filter.extract & BLENDER_EXTRACT_EDGES)) {
+		skipped.push_back("MEdge");
+	}
 
-			structure.fields.push_back(field);
-		}
+	if(!(filter.extract & BLENDER_EXTRACT_SHAPE_KEYS)) {
+		skipped.push_back("KeyBlock");
+	}
 
-		m_SDNA.structures.push_back(structure);
+	if(!(filter.extract & BLENDER_EXTRACT_ACTIONS)) {
+		skipped.push_back("FCurve");
+		skipped.push_back("BezTriple");
 	}
 
-	std::cout << "Number of structures: " << m_SDNA.structures.size() << "\n";
+	if(!(filter.extract & BLENDER_EXTRACT_DEFORM_WEIGHTS)) {
+		skipped.push_back("MDeformVert");
+		skipped.push_back("MDeformWeight");
+	}
 
-	return true;
+	for(unsigned int i=0; i < m_SDNA.structures.size(); i++) {
+		const std::string &type = m_SDNA.GetType(m_SDNA.structures[i].type_idx);
+
+		if(!filter.structTypes.empty() && std::find(filter.structTypes.begin(), filter.structTypes.end(), type) == filter.structTypes.end()) {
+			m_SkipStructs[i] = true;
+		}
+
+		if(std::find(skipped.begin(), skipped.end(), type) != skipped.end()) {
+			m_SkipStructs[i] = true;
+		}
+	}
+}
+
+// Checks a datablock against the code and name filters. The
+// name is peeked from the reader, the payload is not read.
+bool BlenderFile::AcceptIDBlock(const BlenderFileBlock &block, BlenderReader *reader) {
+	const BlenderLoadFilter &filter = m_Config.filter;
+
+	if(!filter.idCodes.empty() && std::find(filter.idCodes.begin(), filter.idCodes.end(), block.m_Header.code) == filter.idCodes.end()) {
+		return false;
+	}
+
+	if(filter.names.empty()) {
+		return true;
+	}
+
+	int offset = m_SDNA.GetIDNameOffset(block.m_Header.sdna);
+	if(offset == -1 || offset + 66 > (int)block.m_Header.size) {
+		return true;
+	}
+
+	char name[67];
+	size_t pos = reader->Tell();
+	reader->Skip(offset);
+	reader->Read(name, 66);
+	reader->Seek(pos);
+	name[66] = 0;
+
+	for(unsigned int i=0; i < filter.names.size(); i++) {
+		if(filter.names[i] == name || filter.names[i] == name + 2) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// A pointer in a struct, and whether it points to an
+// array of pointers (a ** field such as Mesh.mat)
+struct PointerField {
+	unsigned int offset;
+	bool toPointers;
+};
+
+// Flattens the pointer fields of a struct, including those of
+// the structs embedded in it. The next and prev links of a
+// datablock's ID lead to unrelated datablocks and are left out.
+static void CollectPointerFields(const StructureDNA &sdna, const Structure &structure, unsigned int base, bool isID, std::vector<PointerField> &fields) {
+	unsigned short pointerSize = sdna.pointer_size;
+
+	for(unsigned int i=0; i < structure.fields.size(); i++) {
+		const Field &field = structure.fields[i];
+		const std::string &name = sdna.GetName(field.name_idx);
+		unsigned short length = sdna.lengths[field.type_idx];
+
+		if(name[0] == '(') {
+			continue;
+		}
+
+		if(name[0] == '*') {
+			if(isID && (name == "*next" || name == "*prev")) {
+				continue;
+			}
+
+			unsigned int count = BlenderImporter::ComputeFieldLength(name, length, pointerSize) / pointerSize;
+			for(unsigned int e=0; e < count; e++) {
+				PointerField pointer = { base + field.offset + e * pointerSize, name[1] == '*' };
+				fields.push_back(pointer);
+			}
+
+			continue;
+		}
+
+		const Structure *embedded = sdna.GetStructureByTypeIndex(field.type_idx);
+		if(!embedded || length == 0) {
+			continue;
+		}
+
+		bool embeddedID = (i == 0 && name == "id" && sdna.GetType(field.type_idx) == "ID");
+		unsigned int count = BlenderImporter::ComputeFieldLength(name, length, pointerSize) / length;
+
+		for(unsigned int e=0; e < count; e++) {
+			CollectPointerFields(sdna, *embedded, base + field.offset + e * length, embeddedID, fields);
+		}
+	}
+}
+
+// Walks the block headers once, then follows every pointer from
+// the root datablocks through the old address of each block. Only
+// blocks with pointer fields are read. Raw blocks (SDNA index 0)
+// are followed only when a ** field points to them. The reader
+// is left where it started. A missing root is not an error, a
+// library may no longer have a datablock that was linked from it.
+void BlenderFile::BuildReachableSet(BlenderReader *reader) {
+	BLENDER_TRACE_SCOPE("BlenderFile::BuildReachableSet");
+
+	const std::vector<std::string> &roots = m_Config.filter.roots;
+	size_t start = reader->Tell();
+
+	struct BlockInfo {
+		BlenderFileBlockHeader header;
+		size_t position;
+	};
+
+	std::vector<BlockInfo> blocks;
+	std::unordered_map<const void *, size_t> blocksByAddress;
+	std::vector<size_t> queue;
+	std::vector<char> found(roots.size(), 0);
+	size_t numFound = 0;
+
+	while(reader->Good()) {
+		BlenderFileBlock fileBlock;
+		fileBlock.LoadHeader(reader, m_FileHeader.pointer_size);
+
+		if(!reader->Good() || strcmp("ENDB", fileBlock.m_Header.code) == 0) {
+			break;
+		}
+
+		BlockInfo info = { fileBlock.m_Header, reader->Tell() };
+		bool isData = (strcmp("DATA", fileBlock.m_Header.code) == 0);
+		int offset = isData ? -1 : m_SDNA.GetIDNameOffset(fileBlock.m_Header.sdna);
+
+		if(numFound < roots.size() && offset != -1 && offset + 66 <= (int)fileBlock.m_Header.size) {
+			char name[67];
+			reader->Skip(offset);
+			reader->Read(name, 66);
+			reader->Seek(info.position);
+			name[66] = 0;
+
+			bool isRoot = false;
+			for(size_t r=0; r < roots.size(); r++) {
+				if(!found[r] && (roots[r] == name || roots[r] == name + 2)) {
+					found[r] = 1;
+					numFound++;
+					isRoot = true;
+				}
+			}
+
+			if(isRoot) {
+				queue.push_back(blocks.size());
+			}
+		}
+
+		if(strcmp("DNA1", fileBlock.m_Header.code) != 0) {
+			blocksByAddress[fileBlock.m_Header.old_mem_address] = blocks.size();
+			blocks.push_back(info);
+		}
+
+		fileBlock.SkipPayload(reader);
+	}
+
+	m_FilterReachable = true;
+	m_Reachable.clear();
+
+	for(size_t r=0; r < roots.size(); r++) {
+		if(!found[r]) {
+			BLENDER_LOG(BLENDER_TRACE_WARNING, "Root datablock not found: " << roots[r]);
+		}
+	}
+
+	if(queue.empty()) {
+		reader->Seek(start);
+		return;
+	}
+
+	std::vector<std::vector<PointerField> > layouts(m_SDNA.structures.size());
+	std::vector<char> hasLayout(m_SDNA.structures.size(), 0);
+
+	std::vector<char> visited(blocks.size(), 0);
+	std::vector<char> pointerArray(blocks.size(), 0);
+	size_t numRoots = queue.size();
+
+	for(size_t q=0; q < numRoots; q++) {
+		visited[queue[q]] = 1;
+	}
+
+	std::vector<unsigned char> buffer;
+	unsigned short pointerSize = m_FileHeader.pointer_size;
+
+	for(size_t q=0; q < queue.size(); q++) {
+		const BlockInfo &info = blocks[queue[q]];
+		m_Reachable.insert(info.header.old_mem_address);
+
+		unsigned int sdna = info.header.sdna;
+		bool isRaw = (sdna == 0 && strcmp("DATA", info.header.code) == 0);
+		const std::vector<PointerField> *layout = 0;
+
+		if(isRaw) {
+			if(!pointerArray[queue[q]]) {
+				continue;
+			}
+		}
+		else if(sdna < m_SDNA.structures.size()) {
+			if(!hasLayout[sdna]) {
+				CollectPointerFields(m_SDNA, m_SDNA.structures[sdna], 0, false, layouts[sdna]);
+				hasLayout[sdna] = 1;
+			}
+
+			layout = &layouts[sdna];
+			if(layout->empty()) {
+				continue;
+			}
+		}
+		else {
+			continue;
+		}
+
+		buffer.resize(info.header.size);
+		reader->Seek(info.position);
+		if(reader->Read(buffer.empty() ? 0 : &buffer[0], buffer.size()) != buffer.size()) {
+			continue;
+		}
+
+		unsigned int structLength = isRaw ? pointerSize : m_SDNA.lengths[m_SDNA.structures[sdna].type_idx];
+		unsigned int numFields = isRaw ? 1 : (unsigned int)layout->size();
+		unsigned int count = isRaw ? (unsigned int)(buffer.size() / pointerSize) : info.header.count;
+
+		for(unsigned int k=0; k < count; k++) {
+			for(unsigned int f=0; f < numFields; f++) {
+				size_t offset = (size_t)k * structLength + (isRaw ? 0 : (*layout)[f].offset);
+				if(offset + pointerSize > buffer.size()) {
+					continue;
+				}
+
+				const void *address = 0;
+				if(pointerSize == 8) {
+					unsigned long long value;
+					memcpy(&value, &buffer[offset], 8);
+					address = (const void *)(size_t)value;
+				}
+				else {
+					unsigned int value;
+					memcpy(&value, &buffer[offset], 4);
+					address = (const void *)(size_t)value;
+				}
+
+				std::unordered_map<const void *, size_t>::const_iterator it = blocksByAddress.find(address);
+				if(!address || it == blocksByAddress.end()) {
+					continue;
+				}
+
+				if(!isRaw && (*layout)[f].toPointers) {
+					pointerArray[it->second] = 1;
+				}
+
+				if(!visited[it->second]) {
+					visited[it->second] = 1;
+					queue.push_back(it->second);
+				}
+			}
+		}
+	}
+
+	reader->Seek(start);
+
+	BLENDER_LOG(BLENDER_TRACE_INFO, m_Reachable.size() << " of " << blocks.size() << " blocks reachable from " << numRoots << " roots");
+}
+
+void BlenderFile::BeginGroup(BlockGroup group) {
+	m_CurrentGroup = group;
+}
+
+// Without streaming a finished mesh group is retained, and
+// handed to the workers when the pipeline is on. In streaming
+// mode the group is extracted right away and its payloads are
+// freed before the next block, or once its worker is done.
+void BlenderFile::EndGroup() {
+	BlockGroup group = m_CurrentGroup;
+	m_CurrentGroup = BLOCK_GROUP_NONE;
+
+	if(group == BLOCK_GROUP_MESH && !m_Config.streaming.enabled) {
+		m_MeshGroups.push_back(std::move(m_MeshBlocks));
+		m_MeshBlocks.clear();
+
+		if(m_Pool) {
+			std::unique_ptr<PendingMesh> pending(new PendingMesh());
+			pending->blocks = m_MeshGroups.back();
+			DispatchMesh(std::move(pending));
+		}
+	}
+
+	if(!m_Config.streaming.enabled || group == BLOCK_GROUP_NONE) {
+		return;
+	}
+
+	if(group == BLOCK_GROUP_MESH) {
+		if(m_Pool) {
+			// The worker takes the blocks and their payloads with it
+			std::unique_ptr<PendingMesh> pending(new PendingMesh());
+			pending->ownedBlocks = std::move(m_MeshBlocks);
+			pending->payloads = std::move(m_StreamArena);
+			pending->blocks = pending->ownedBlocks;
+			DispatchMesh(std::move(pending));
+		}
+		else {
+			ExtractMesh(m_MeshBlocks);
+		}
+
+		m_MeshBlocks.clear();
+	}
+	else if(group == BLOCK_GROUP_ARMATURE) {
+		// Only the first armature is kept
+		if(m_Armature.GetName().empty()) {
+			m_Armature.LoadArmature(&m_SDNA, m_ArmatureBlocks);
+		}
+
+		m_ArmatureBlocks.clear();
+	}
+
+	m_StreamArena.Release();
+	ApplyBackpressure(0);
+}
+
+void BlenderFile::ExtractMesh(BlenderSpan<const BlenderFileBlock> blocks) {
+	if(blocks.empty()) {
+		return;
+	}
+
+	BlenderMesh mesh;
+	LoadMeshGroup(mesh, blocks);
+	RetainMesh(std::move(mesh));
+}
+
+// Runs on the extraction workers as well, it only reads the
+// SDNA and the group's blocks and writes to the mesh
+void BlenderFile::LoadMeshGroup(BlenderMesh &mesh, BlenderSpan<const BlenderFileBlock> blocks) {
+	mesh.SetAllocator(m_Config.allocator);
+	mesh.LoadMesh(&m_SDNA, blocks, m_Config.triangulate, m_Config.vertexUVs, m_Config.flipYZ, m_Config.filter.extract, m_Config.streaming.enabled);
+
+	// Runs on the extraction workers when the pipeline
+	// is enabled, so meshes are simplified in parallel
+	if(!m_Config.lodRatios.empty()) {
+		mesh.GenerateLODs(m_Config.lodRatios);
+	}
+}
+
+// Runs on the loading thread, so the material sort can
+// spread over the whole pool
+void BlenderFile::RetainMesh(BlenderMesh &&mesh) {
+	if(m_Config.materialSubmeshes) {
+		mesh.SortByMaterial(m_Pool.get());
+	}
+
+	if(m_Config.adjacency) {
+		mesh.BuildAdjacency(m_Pool.get());
+	}
+
+	if(m_Config.buildBVH) {
+		mesh.BuildBVH(m_Pool.get());
+	}
+
+	if(m_Config.tangents) {
+		mesh.GenerateTangents(m_Pool.get());
+	}
+
+	m_Meshes.push_back(std::move(mesh));
+	m_RetainedMeshBytes += m_Meshes.back().GetMemoryUsage();
+
+	BLENDER_LOG(BLENDER_TRACE_INFO, "Mesh Data:\n" << m_Meshes.back().GetMeshInfo());
+
+	if(m_Config.streaming.memoryBudget && !m_Config.streaming.onMesh && m_RetainedMeshBytes > m_Config.streaming.memoryBudget) {
+		BLENDER_LOG(BLENDER_TRACE_WARNING, "Streaming memory budget exceeded with no mesh consumer set");
+	}
+}
+
+// Queues a finished group on the workers. The number of groups
+// in flight is bounded, past that the parser waits for them.
+void BlenderFile::DispatchMesh(std::unique_ptr<PendingMesh> pending) {
+	if(pending->blocks.empty()) {
+		return;
+	}
+
+	if(m_PendingMeshes.size() >= 2 * m_Pool->GetNumThreads()) {
+		CompletePendingMeshes();
+	}
+
+	PendingMesh *task = pending.get();
+	m_PendingMeshes.push_back(std::move(pending));
+
+	m_Pool->Submit([this, task] {
+		BLENDER_TRACE_SCOPE("BlenderFile::LoadMeshGroup");
+		LoadMeshGroup(task->mesh, task->blocks);
+	});
+}
+
+// Waits for the workers and retains their meshes in file order
+void BlenderFile::CompletePendingMeshes() {
+	BLENDER_TRACE_SCOPE("BlenderFile::CompletePendingMeshes");
+	m_Pool->Wait();
+
+	for(unsigned int i=0; i < m_PendingMeshes.size(); i++) {
+		RetainMesh(std::move(m_PendingMeshes[i]->mesh));
+	}
+
+	m_PendingMeshes.clear();
+}
+
+// Keeps retained meshes plus the incoming payload within the
+// budget by handing meshes to the consumer. Reading resumes
+// only once the consumer returns. Groups still with the
+// workers count with their payloads.
+void BlenderFile::ApplyBackpressure(size_t incomingBytes) {
+	size_t budget = m_Config.streaming.memoryBudget;
+
+	if(budget == 0 || (m_Meshes.empty() && m_PendingMeshes.empty()) || !m_Config.streaming.onMesh) {
+		return;
+	}
+
+	size_t pendingBytes = 0;
+	for(unsigned int i=0; i < m_PendingMeshes.size(); i++) {
+		pendingBytes += m_PendingMeshes[i]->payloads.GetBytesReserved();
+	}
+
+	if(m_RetainedMeshBytes + pendingBytes + m_StreamArena.GetBytesReserved() + incomingBytes > budget) {
+		if(!m_PendingMeshes.empty()) {
+			CompletePendingMeshes();
+		}
+
+		FlushMeshes();
+	}
+}
+
+void BlenderFile::FlushMeshes() {
+	BLENDER_TRACE_SCOPE("BlenderFile::FlushMeshes");
+
+	for(unsigned int i=0; i < m_Meshes.size(); i++) {
+		m_Config.streaming.onMesh(m_Meshes[i], m_Config.streaming.userData);
+	}
+
+	m_Meshes.clear();
+	m_RetainedMeshBytes = 0;
+}
+
+// Bounds-checked reads for ExtractSDNA, each returns false
+// when what it reads does not fit in the rest of the block
+static bool ReadSDNAValue(const unsigned char *buffer, size_t size, size_t &pos, void *value, size_t length) {
+	if(length > size - pos) {
+		return false;
+	}
+
+	memcpy(value, &buffer[pos], length);
+	pos += length;
+
+	return true;
+}
+
+static bool ReadSDNAString(const unsigned char *buffer, size_t size, size_t &pos, std::string &text) {
+	const unsigned char *end = (const unsigned char *)memchr(&buffer[pos], 0, size - pos);
+	if(!end) {
+		return false;
+	}
+
+	text.assign((const char *)&buffer[pos], end - &buffer[pos]);
+	pos += text.size() + 1;
+
+	return true;
+}
+
+// Section codes start 4 byte aligned
+static bool ReadSDNACode(const unsigned char *buffer, size_t size, size_t &pos, const char *code) {
+	pos = (pos + 3) & ~(size_t)3;
+
+	if(pos > size || size - pos < 4 || strncmp(code, (const char *)&buffer[pos], 4) != 0) {
+		return false;
+	}
+
+	pos += 4;
+	return true;
+}
+
+bool BlenderFile::ExtractSDNA(const BlenderFileBlock &block) {
+	BLENDER_TRACE_SCOPE("BlenderFile::ExtractSDNA");
+	BLENDER_LOG(BLENDER_TRACE_INFO, "Loading SDNA");
+
+	// Make sure there's nothing in here
+	m_SDNA.names.clear();
+	m_SDNA.lengths.clear();
+	m_SDNA.types.clear();
+	m_SDNA.structures.clear();
+	m_SDNA.structureByType.clear();
+	m_SDNA.structureByTypeIndex.clear();
+	m_SDNA.pointer_size = m_FileHeader.pointer_size;
+
+	// Get the buffer and initialize buffer pointer position
+	const unsigned char *buffer = block.GetBuffer();
+	size_t size = block.m_Header.size;
+	size_t pos = 0;
+
+	// SDNA and NAMEs identifiers
+	if(!ReadSDNACode(buffer, size, pos, "SDNA") || !ReadSDNACode(buffer, size, pos, "NAME")) {
+		m_Error = "SDNA File Block Invalid";
+		return false;
+	}
+
+	// Get names
+	BLENDER_LOG(BLENDER_TRACE_DEBUG, "Loading name data...");
+	unsigned int numNames = 0;
+	bool valid = ReadSDNAValue(buffer, size, pos, &numNames, 4);
+
+	// Every name takes at least a byte, so a bad count
+	// runs out of block instead of memory
+	for(unsigned int i=0; valid && i < numNames; i++) {
+		std::string name;
+		valid = ReadSDNAString(buffer, size, pos, name);
+		m_SDNA.names.push_back(name);
+	}
+
+	if(!valid) {
+		m_Error = "SDNA names run past the end of the block";
+		return false;
+	}
+
+	BLENDER_LOG(BLENDER_TRACE_DEBUG, "Number of names: " << m_SDNA.names.size());
+
+	// TYPEs identifier, 4 byte aligned
+	if(!ReadSDNACode(buffer, size, pos, "TYPE")) {
+		m_Error = "SDNA File Block Invalid";
+		return false;
+	}
+
+	// Get types
+	BLENDER_LOG(BLENDER_TRACE_DEBUG, "Loading type data...");
+	unsigned int numTypes = 0;
+	valid = ReadSDNAValue(buffer, size, pos, &numTypes, 4);
+
+	for(unsigned int i=0; valid && i < numTypes; i++) {
+		std::string type;
+		valid = ReadSDNAString(buffer, size, pos, type);
+		m_SDNA.types.push_back(type);
+	}
+
+	if(!valid) {
+		m_Error = "SDNA types run past the end of the block";
+		return false;
+	}
+
+	BLENDER_LOG(BLENDER_TRACE_DEBUG, "Number of types: " << m_SDNA.types.size());
+
+	// LEGNTHs identifier
+	if(!ReadSDNACode(buffer, size, pos, "TLEN")) {
+		m_Error = "SDNA File Block Invalid";
+		return false;
+	}
+
+	// get lengths
+	BLENDER_LOG(BLENDER_TRACE_DEBUG, "Loading type length data...");
+	for(unsigned int i=0; valid && i < numTypes; i++) {
+		unsigned short length = 0;
+		valid = ReadSDNAValue(buffer, size, pos, &length, 2);
+		m_SDNA.lengths.push_back(length);
+	}
+
+	if(!valid) {
+		m_Error = "SDNA lengths run past the end of the block";
+		return false;
+	}
+
+	BLENDER_LOG(BLENDER_TRACE_DEBUG, "Number of lengths: " << m_SDNA.lengths.size());
+
+	// STRUCTURES
+	if(!ReadSDNACode(buffer, size, pos, "STRC")) {
+		m_Error = "SDNA File Block Invalid";
+		return false;
+	}
+
+	// Get structures
+	BLENDER_LOG(BLENDER_TRACE_DEBUG, "Loading structure data...");
+	unsigned int numStructs = 0;
+	valid = ReadSDNAValue(buffer, size, pos, &numStructs, 4);
+
+	char error[256];
+
+	for(unsigned int i=0; valid && i < numStructs; i++) {
+		Structure structure;
+		Field field;
+
+		// Get the data type of this structure, and the number of fields
+		unsigned short numFields = 0;
+		valid = ReadSDNAValue(buffer, size, pos, &structure.type_idx, 2) && ReadSDNAValue(buffer, size, pos, &numFields, 2);
+
+		if(valid && structure.type_idx >= numTypes) {
+			sprintf_s(error, "SDNA struct %u has type index %u, the file has %u types", i, structure.type_idx, numTypes);
+			m_Error = error;
+			return false;
+		}
+
+		unsigned long long offset = 0;
+		for(unsigned int k=0; valid && k < numFields; k++) {
+			// Indices into the SDNA types and names arrays
+			valid = ReadSDNAValue(buffer, size, pos, &field.type_idx, 2) && ReadSDNAValue(buffer, size, pos, &field.name_idx, 2);
+			if(!valid) {
+				break;
+			}
+
+			if(field.type_idx >= numTypes || field.name_idx >= numNames) {
+				sprintf_s(error, "SDNA struct %.64s has a field with type %u and name %u out of range", m_SDNA.types[structure.type_idx].c_str(), field.type_idx, field.name_idx);
+				m_Error = error;
+				return false;
+			}
+
+			field.offset = (unsigned int)offset;
+			offset += BlenderImporter::ComputeFieldLength(m_SDNA.names[field.name_idx], m_SDNA.lengths[field.type_idx], m_FileHeader.pointer_size);
+
+			structure.fields.push_back(field);
+		}
+
+		// Every field has to lie inside the struct, the block
+		// accessors read at these offsets without checks
+		if(valid && offset > m_SDNA.lengths[structure.type_idx]) {
+			sprintf_s(error, "SDNA struct %.64s has %llu bytes of fields, its type is %u bytes long", m_SDNA.types[structure.type_idx].c_str(), offset, m_SDNA.lengths[structure.type_idx]);
+			m_Error = error;
+			return false;
+		}
+
+		m_SDNA.structures.push_back(structure);
+	}
+
+	if(!valid) {
+		m_Error = "SDNA structures run past the end of the block";
+		return false;
+	}
+
+	m_SDNA.BuildIndex();
+
+	// A field stored inline needs a size, or a struct to
+	// look into. Only pointers may use void and the like.
+	for(size_t i=0; i < m_SDNA.structures.size(); i++) {
+		const Structure &structure = m_SDNA.structures[i];
+
+		for(size_t k=0; k < structure.fields.size(); k++) {
+			const Field &field = structure.fields[k];
+			const std::string &name = m_SDNA.names[field.name_idx];
+
+			if(name[0] != '*' && name[0] != '(' && m_SDNA.lengths[field.type_idx] == 0) {
+				sprintf_s(error, "SDNA struct %.64s has field %.64s of type %.64s with no size", m_SDNA.types[structure.type_idx].c_str(), name.c_str(), m_SDNA.types[field.type_idx].c_str());
+				m_Error = error;
+				return false;
+			}
+		}
+	}
+
+	BLENDER_LOG(BLENDER_TRACE_DEBUG, "Number of structures: " << m_SDNA.structures.size());
+
+	return true;
+}
+
+// Built once every block has been read, the block
+// vectors do not grow after that
+void BlenderFile::BuildBlockIndex() {
+	BLENDER_TRACE_SCOPE("BlenderFile::BuildBlockIndex");
+
+	m_BlocksByStruct.assign(m_SDNA.structures.size(), std::vector<const BlenderFileBlock *>());
+	m_BlocksByAddress.clear();
+
+	IndexBlocks(m_FileBlocks);
+	IndexBlocks(m_ArmatureBlocks);
+
+	for(unsigned int i=0; i < m_MeshGroups.size(); i++) {
+		IndexBlocks(m_MeshGroups[i]);
+	}
+}
+
+void BlenderFile::IndexBlocks(const std::vector<BlenderFileBlock> &blocks) {
+	for(unsigned int i=0; i < blocks.size(); i++) {
+		const BlenderFileBlock &block = blocks[i];
+
+		// DATA, ENDB, DNA1 and the like use sdna 0 for raw bytes,
+		// only two letter datablock codes are real instances of
+		// struct 0. Short blocks are left out so queries can
+		// read every struct they hand out.
+		unsigned int sdna = block.m_Header.sdna;
+		bool raw = (sdna == 0 && block.m_Header.code[2] != 0);
+
+		if(!raw && sdna < m_BlocksByStruct.size() && block.m_Header.count > 0 &&
+		   (unsigned long long)block.m_Header.count * m_SDNA.lengths[m_SDNA.structures[sdna].type_idx] <= block.m_Header.size) {
+			m_BlocksByStruct[sdna].push_back(&block);
+		}
+
+		if(block.m_Header.old_mem_address) {
+			m_BlocksByAddress[block.m_Header.old_mem_address] = &block;
+		}
+	}
+}
+
+// Names the material slots of each mesh, following Mesh.mat
+// to its pointer array and on to the Material blocks
+void BlenderFile::ResolveMaterials() {
+	BlenderBlockQuery meshes = Query("Mesh");
+	BlenderBlockQuery materials = Query("Material");
+
+	if(meshes.empty()) {
+		return;
+	}
+
+	BlenderFieldAccessor mat = meshes.GetField("mat");
+	BlenderFieldAccessor totcol = meshes.GetField("totcol");
+	BlenderFieldAccessor name = materials.GetField("id.name");
+
+	if(!mat.IsPointer() || !totcol.IsShort() || !name.IsString()) {
+		BLENDER_LOG(BLENDER_TRACE_WARNING, "Mesh or Material struct has unknown fields, materials skipped");
+		return;
+	}
+
+	int materialStruct = m_SDNA.GetStructureIndex("Material");
+	unsigned short pointerSize = m_FileHeader.pointer_size;
+
+	for(unsigned int i=0; i < m_Meshes.size(); i++) {
+		const BlenderFileBlock *meshBlock = FindBlock(m_Meshes[i].m_OldAddress);
+		if(!meshBlock) {
+			continue;
+		}
+
+		const BlenderFileBlock *slots = FindBlock(mat.GetPointer(*meshBlock));
+		int count = totcol.GetShort(*meshBlock);
+
+		m_Meshes[i].m_Materials.assign(count > 0 ? count : 0, std::string());
+
+		for(int k=0; slots && k < count && (k+1) * pointerSize <= (int)slots->m_Header.size; k++) {
+			const BlenderFileBlock *material = FindBlock(slots->GetOldPointer(k * pointerSize, pointerSize));
+
+			if(material && (int)material->m_Header.sdna == materialStruct) {
+				m_Meshes[i].m_Materials[k] = name.GetString(*material);
+			}
+		}
+	}
+}
+
+// Follows Mesh.key to its Key and walks the KeyBlock list.
+// The basis is Key.refkey, or the first block without one.
+// The meshes are encoded in parallel, each in its own arena.
+void BlenderFile::ResolveShapeKeys() {
+	BLENDER_TRACE_SCOPE("BlenderFile::ResolveShapeKeys");
+
+	BlenderBlockQuery meshes = Query("Mesh");
+	BlenderBlockQuery keys = Query("Key");
+	BlenderBlockQuery keyBlocks = Query("KeyBlock");
+
+	if(meshes.empty() || keys.empty() || keyBlocks.empty()) {
+		return;
+	}
+
+	BlenderFieldAccessor meshKey = meshes.GetField("key");
+	BlenderFieldAccessor refkey = keys.GetField("refkey");
+	BlenderFieldAccessor first = keys.GetField("block.first");
+	BlenderFieldAccessor next = keyBlocks.GetField("next");
+	BlenderFieldAccessor name = keyBlocks.GetField("name");
+	BlenderFieldAccessor curval = keyBlocks.GetField("curval");
+	BlenderFieldAccessor sliderMin = keyBlocks.GetField("slidermin");
+	BlenderFieldAccessor sliderMax = keyBlocks.GetField("slidermax");
+	BlenderFieldAccessor totelem = keyBlocks.GetField("totelem");
+	BlenderFieldAccessor data = keyBlocks.GetField("data");
+
+	if(!meshKey.IsPointer() || !first.IsPointer() || !next.IsPointer() || !totelem.IsInt() || !data.IsPointer()) {
+		return;
+	}
+
+	int keyStruct = m_SDNA.GetStructureIndex("Key");
+	int keyBlockStruct = m_SDNA.GetStructureIndex("KeyBlock");
+
+	std::vector<std::vector<BlenderShapeKeySource> > sources(m_Meshes.size());
+	std::vector<int> basis(m_Meshes.size(), -1);
+
+	for(unsigned int i=0; i < m_Meshes.size(); i++) {
+		const BlenderFileBlock *meshBlock = FindBlock(m_Meshes[i].m_OldAddress);
+		if(!meshBlock) {
+			continue;
+		}
+
+		const BlenderFileBlock *key = FindBlock(meshKey.GetPointer(*meshBlock));
+		if(!key || (int)key->m_Header.sdna != keyStruct) {
+			continue;
+		}
+
+		const void *basisAddress = refkey.IsPointer() ? refkey.GetPointer(*key) : 0;
+
+		// Bounded by the number of KeyBlocks in case of a cycle
+		const BlenderFileBlock *block = FindBlock(first.GetPointer(*key));
+		for(size_t n=0; block && (int)block->m_Header.sdna == keyBlockStruct && n < keyBlocks.size(); n++) {
+			const BlenderFileBlock *co = FindBlock(data.GetPointer(*block));
+			int count = totelem.GetInt(*block);
+
+			if(co && count > 0 && (size_t)count * 3 * sizeof(float) <= co->m_Header.size) {
+				BlenderShapeKeySource source;
+				source.name = name.IsString() ? name.GetString(*block) : "";
+				source.weight = curval.IsFloat() ? curval.GetFloat(*block) : 0.0f;
+				source.sliderMin = sliderMin.IsFloat() ? sliderMin.GetFloat(*block) : 0.0f;
+				source.sliderMax = sliderMax.IsFloat() ? sliderMax.GetFloat(*block) : 1.0f;
+				source.co = (const float *)co->GetBuffer();
+				source.count = count;
+
+				if(block->m_Header.old_mem_address == basisAddress) {
+					basis[i] = (int)sources[i].size();
+				}
+
+				sources[i].push_back(source);
+			}
+
+			block = FindBlock(next.GetPointer(*block));
+		}
+
+		if(basis[i] == -1 && !sources[i].empty()) {
+			basis[i] = 0;
+		}
+	}
+
+	bool flipYZ = m_Config.flipYZ;
+
+	ParallelFor(m_Meshes.size(), 1, [&](size_t begin, size_t end) {
+		for(size_t i=begin; i < end; i++) {
+			m_Meshes[i].EncodeShapeKeys(sources[i], basis[i], flipYZ);
+		}
+	});
+}
+
+// True if the field holds count floats inline
+static bool IsFloatArray(const BlenderFieldAccessor &field, unsigned int count) {
+	return field.IsValid() && !field.IsPointer() && field.GetNumElements() == count && field.GetSize() == count * sizeof(float);
+}
+
+// Leaves out as it is when the field does not hold count floats
+static void ReadFloats(const BlenderFieldAccessor &field, const BlenderFileBlock &block, float *out, unsigned int count) {
+	if(!IsFloatArray(field, count)) {
+		return;
+	}
+
+	for(unsigned int e=0; e < count; e++) {
+		out[e] = field.GetFloat(block, 0, e);
+	}
+}
+
+// Resolves each object's data and parent pointers through the
+// block index, and orders the objects so parents come first
+void BlenderFile::ExtractObjects() {
+	BLENDER_TRACE_SCOPE("BlenderFile::ExtractObjects");
+
+	BlenderBlockQuery objects = Query("Object");
+	if(objects.empty()) {
+		return;
+	}
+
+	BlenderFieldAccessor name = objects.GetField("id.name");
+	BlenderFieldAccessor type = objects.GetField("type");
+	BlenderFieldAccessor data = objects.GetField("data");
+	BlenderFieldAccessor parent = objects.GetField("parent");
+	BlenderFieldAccessor obmat = objects.GetField("obmat");
+
+	if(!name.IsString()) {
+		BLENDER_LOG(BLENDER_TRACE_WARNING, "Object struct has no name, objects skipped");
+		return;
+	}
+
+	if(!type.IsShort()) {
+		type = BlenderFieldAccessor();
+	}
+
+	if(data.IsValid() && !data.IsPointer()) {
+		data = BlenderFieldAccessor();
+	}
+
+	if(parent.IsValid() && !parent.IsPointer()) {
+		parent = BlenderFieldAccessor();
+	}
+
+	// Renamed in Blender 3.5
+	if(!IsFloatArray(obmat, 16)) {
+		obmat = objects.GetField("object_to_world");
+	}
+
+	// Newer files keep no world matrix at all, it
+	// is rebuilt from the transform channels
+	BlenderFieldAccessor loc, rot, quat, rotAxis, rotAngle, rotMode, size, parentInverse;
+	bool compose = !IsFloatArray(obmat, 16);
+
+	if(compose) {
+		loc = objects.GetField("loc");
+		rot = objects.GetField("rot");
+		quat = objects.GetField("quat");
+		rotAxis = objects.GetField("rotAxis");
+		rotAngle = objects.GetField("rotAngle");
+		rotMode = objects.GetField("rotmode");
+		size = objects.GetField("size");
+		parentInverse = objects.GetField("parentinv");
+
+		if(!IsFloatArray(size, 3)) {
+			size = objects.GetField("scale");
+		}
+
+		if(!rotMode.IsShort()) {
+			rotMode = BlenderFieldAccessor();
+		}
+
+		if(!IsFloatArray(loc, 3)) {
+			BLENDER_LOG(BLENDER_TRACE_WARNING, "Object struct has no obmat, object_to_world or loc, objects skipped");
+			return;
+		}
+
+		BLENDER_LOG(BLENDER_TRACE_INFO, "Object struct has no world matrix, composing it from loc, rot and size");
+	}
+
+	unsigned int numObjects = (unsigned int)objects.size();
+
+	std::unordered_map<const void *, int> meshesByAddress;
+	for(unsigned int i=0; i < m_Meshes.size(); i++) {
+		meshesByAddress[m_Meshes[i].m_OldAddress] = (int)i;
+	}
+
+	std::unordered_map<const void *, int> linkedByAddress;
+	for(unsigned int i=0; i < m_LinkedIDs.size(); i++) {
+		linkedByAddress[m_LinkedIDs[i].oldAddress] = (int)i;
+	}
+
+	std::unordered_map<const void *, int> objectsByAddress;
+	for(unsigned int i=0; i < numObjects; i++) {
+		objectsByAddress[objects[i].m_Header.old_mem_address] = (int)i;
+	}
+
+	// Parents in file order, then the depth of each object
+	std::vector<int> parents(numObjects, -1);
+	std::vector<unsigned int> depths(numObjects, 0);
+
+	for(unsigned int i=0; parent.IsValid() && i < numObjects; i++) {
+		std::unordered_map<const void *, int>::const_iterator it = objectsByAddress.find(parent.GetPointer(objects[i]));
+
+		if(it != objectsByAddress.end() && it->second != (int)i) {
+			parents[i] = it->second;
+		}
+	}
+
+	for(unsigned int i=0; i < numObjects; i++) {
+		// A chain longer than the object count is a cycle
+		for(int p = parents[i]; p != -1 && depths[i] < numObjects; p = parents[p]) {
+			depths[i] += 1;
+		}
+	}
+
+	// Parents before children, file order within a level
+	std::vector<unsigned int> order(numObjects);
+	for(unsigned int i=0; i < numObjects; i++) {
+		order[i] = i;
+	}
+
+	std::stable_sort(order.begin(), order.end(), [&depths](unsigned int a, unsigned int b) { return depths[a] < depths[b]; });
+
+	std::vector<int> remap(numObjects);
+	for(unsigned int i=0; i < numObjects; i++) {
+		remap[order[i]] = (int)i;
+	}
+
+	m_Objects.resize(numObjects);
+	bool flipYZ = m_Config.flipYZ;
+
+	// Every object only writes its own entry
+	ParallelFor(numObjects, 256, [&](size_t begin, size_t end) {
+		for(size_t k=begin; k < end; k++) {
+			const BlenderFileBlock &block = objects[order[k]];
+			BlenderObject &object = m_Objects[k];
+
+			object.name = name.GetString(block);
+			object.type = type.IsValid() ? type.GetShort(block) : (short)BLENDER_OBJECT_EMPTY;
+			object.depth = depths[order[k]];
+			object.parentIndex = (parents[order[k]] == -1) ? -1 : remap[parents[order[k]]];
+			object.meshIndex = -1;
+			object.linkedIndex = -1;
+
+			if(data.IsValid()) {
+				std::unordered_map<const void *, int>::const_iterator it = meshesByAddress.find(data.GetPointer(block));
+				if(it != meshesByAddress.end()) {
+					object.meshIndex = it->second;
+				}
+
+				it = linkedByAddress.find(data.GetPointer(block));
+				if(it != linkedByAddress.end()) {
+					object.linkedIndex = it->second;
+				}
+			}
+
+			if(compose) {
+				BlenderTransform transform = { { 0, 0, 0 }, { 0, 0, 0 }, { 1, 0, 0, 0 }, { 0, 1, 0 }, 0, { 1, 1, 1 }, BLENDER_ROT_EULER_XYZ };
+				ReadFloats(loc, block, transform.loc, 3);
+				ReadFloats(rot, block, transform.rot, 3);
+				ReadFloats(quat, block, transform.quat, 4);
+				ReadFloats(rotAxis, block, transform.rotAxis, 3);
+				ReadFloats(rotAngle, block, &transform.rotAngle, 1);
+				ReadFloats(size, block, transform.size, 3);
+				transform.rotMode = rotMode.IsValid() ? rotMode.GetShort(block) : (short)BLENDER_ROT_EULER_XYZ;
+
+				BlenderComposeMatrix(object.world, transform);
+
+				// The parent's world matrix is applied below,
+				// once every parent is done
+				float inverse[4][4];
+				if(object.parentIndex != -1 && IsFloatArray(parentInverse, 16)) {
+					ReadFloats(parentInverse, block, &inverse[0][0], 16);
+					BlenderMultiplyMatrix(object.world, inverse, object.world);
+				}
+			}
+			else {
+				ReadFloats(obmat, block, &object.world[0][0], 16);
+			}
+
+			if(flipYZ) {
+				BlenderFlipMatrixYZ(object.world);
+			}
+		}
+	});
+
+	// Parents come first, so each parent is final by
+	// the time its children read it
+	for(unsigned int i=0; compose && i < numObjects; i++) {
+		if(m_Objects[i].parentIndex != -1) {
+			BlenderMultiplyMatrix(m_Objects[i].world, m_Objects[m_Objects[i].parentIndex].world, m_Objects[i].world);
+		}
+	}
+
+	// Local matrices read the parent's world matrix, which
+	// the pass above has already filled in
+	ParallelFor(numObjects, 256, [&](size_t begin, size_t end) {
+		for(size_t k=begin; k < end; k++) {
+			BlenderObject &object = m_Objects[k];
+			float parentInverse[4][4];
+
+			if(object.parentIndex != -1 && BlenderInvertMatrix(parentInverse, m_Objects[object.parentIndex].world)) {
+				BlenderMultiplyMatrix(object.local, parentInverse, object.world);
+			}
+			else {
+				memcpy(object.local, object.world, sizeof(object.world));
+			}
+		}
+	});
+
+	for(unsigned int i=0; i < numObjects; i++) {
+		int linked = m_Objects[i].linkedIndex;
+		int meshIndex = (linked == -1) ? m_Objects[i].meshIndex : m_LinkedIDs[linked].meshIndex;
+
+		if(meshIndex == -1) {
+			continue;
+		}
+
+		BlenderInstance instance;
+		instance.meshIndex = meshIndex;
+		instance.linkedIndex = linked;
+		instance.objectIndex = (int)i;
+		memcpy(instance.world, m_Objects[i].world, sizeof(instance.world));
+
+		m_Instances.push_back(instance);
+	}
+
+	BLENDER_LOG(BLENDER_TRACE_INFO, numObjects << " objects, " << m_Instances.size() << " mesh instances");
+}
+
+// Joins a library path to the directory of the linking file
+// when it starts with //, and folds "." and ".." segments.
+// Separators come out as '/'.
+static std::string ResolveLibraryPath(const std::string &filename, const std::string &path) {
+	std::string joined = path;
+
+	if(path.compare(0, 2, "//") == 0) {
+		size_t slash = filename.find_last_of("/\\");
+		joined = (slash == std::string::npos) ? path.substr(2) : filename.substr(0, slash + 1) + path.substr(2);
+	}
+
+	std::replace(joined.begin(), joined.end(), '\\', '/');
+
+	// A leading / or a drive like C: is kept as it is
+	size_t rootLength = (!joined.empty() && joined[0] == '/') ? 1 : 0;
+	if(joined.size() >= 2 && joined[1] == ':') {
+		rootLength = (joined.size() >= 3 && joined[2] == '/') ? 3 : 2;
+	}
+
+	std::vector<std::string> segments;
+	size_t start = rootLength;
+
+	while(start <= joined.size()) {
+		size_t end = joined.find('/', start);
+		end = (end == std::string::npos) ? joined.size() : end;
+		std::string segment = joined.substr(start, end - start);
+
+		if(segment == "..") {
+			if(!segments.empty() && segments.back() != "..") {
+				segments.pop_back();
+			}
+			else if(rootLength == 0) {
+				segments.push_back(segment);
+			}
+		}
+		else if(!segment.empty() && segment != ".") {
+			segments.push_back(segment);
+		}
+
+		start = end + 1;
+	}
+
+	std::string resolved = joined.substr(0, rootLength);
+	for(size_t i=0; i < segments.size(); i++) {
+		resolved += (i == 0) ? segments[i] : "/" + segments[i];
+	}
+
+	return resolved;
+}
+
+// Lists the LI blocks and the ID blocks linked from them, and
+// with linkLibraries loads each linked datablock from its
+// library through the shared cache, in parallel
+void BlenderFile::ResolveLibraries() {
+	BLENDER_TRACE_SCOPE("BlenderFile::ResolveLibraries");
+
+	BlenderBlockQuery libraries = Query("Library");
+	BlenderBlockQuery ids = Query("ID");
+
+	if(libraries.empty()) {
+		return;
+	}
+
+	BlenderFieldAccessor libraryName = libraries.GetField("id.name");
+	BlenderFieldAccessor filepath = libraries.GetField("name");
+	if(!filepath.IsString()) {
+		// Renamed in Blender 2.91
+		filepath = libraries.GetField("filepath");
+	}
+
+	BlenderFieldAccessor idName = ids.GetField("name");
+	BlenderFieldAccessor lib = ids.GetField("lib");
+
+	if(!libraryName.IsString() || !filepath.IsString() || !idName.IsString() || !lib.IsPointer()) {
+		BLENDER_LOG(BLENDER_TRACE_WARNING, "Library or ID struct has unknown fields, libraries skipped");
+		return;
+	}
+
+	std::unordered_map<const void *, int> librariesByAddress;
+
+	m_Libraries.resize(libraries.size());
+	for(unsigned int i=0; i < libraries.size(); i++) {
+		BlenderLibrary &library = m_Libraries[i];
+		library.name = libraryName.GetString(libraries[i]);
+		library.path = filepath.GetString(libraries[i]);
+
+		library.resolvedPath = ResolveLibraryPath(m_Filename, library.path);
+
+		librariesByAddress[libraries[i].m_Header.old_mem_address] = (int)i;
+	}
+
+	// Only the placeholder ID blocks Blender writes for
+	// linked datablocks have the ID struct itself
+	for(unsigned int i=0; i < ids.size(); i++) {
+		std::unordered_map<const void *, int>::const_iterator it = librariesByAddress.find(lib.GetPointer(ids[i]));
+		if(it == librariesByAddress.end()) {
+			continue;
+		}
+
+		BlenderLinkedID linked;
+		linked.name = idName.GetString(ids[i]);
+		linked.libraryIndex = it->second;
+		linked.oldAddress = ids[i].m_Header.old_mem_address;
+		linked.meshIndex = -1;
+
+		m_LinkedIDs.push_back(linked);
+	}
+
+	if(!m_Config.linkLibraries) {
+		BLENDER_LOG(BLENDER_TRACE_INFO, m_Libraries.size() << " libraries, " << m_LinkedIDs.size() << " linked datablocks");
+		return;
+	}
+
+	// Each library is loaded once with all of its datablocks as roots
+	std::vector<std::vector<std::string> > roots(m_Libraries.size());
+	std::vector<std::shared_ptr<const BlenderFile> > files(m_Libraries.size());
+
+	for(unsigned int i=0; i < m_LinkedIDs.size(); i++) {
+		roots[m_LinkedIDs[i].libraryIndex].push_back(m_LinkedIDs[i].name);
+	}
+
+	std::function<void(size_t, size_t)> load = [&](size_t begin, size_t end) {
+		for(size_t i=begin; i < end; i++) {
+			if(!roots[i].empty()) {
+				files[i] = BlenderLibraryCache::Get().Load(m_Libraries[i].resolvedPath, roots[i], m_Config);
+			}
+		}
+	};
+
+	if(BlenderLibraryCache::IsLoading()) {
+		load(0, m_Libraries.size());
+	}
+	else {
+		ParallelFor(m_Libraries.size(), 1, load);
+	}
+
+	for(unsigned int i=0; i < m_LinkedIDs.size(); i++) {
+		BlenderLinkedID &linked = m_LinkedIDs[i];
+		linked.file = files[linked.libraryIndex];
+
+		for(int m=0; linked.file && m < linked.file->GetNumMeshes(); m++) {
+			if(linked.file->GetMesh(m)->m_Name == linked.name) {
+				linked.meshIndex = m;
+				break;
+			}
+		}
+	}
+
+	BLENDER_LOG(BLENDER_TRACE_INFO, m_Libraries.size() << " libraries, " << m_LinkedIDs.size() << " linked datablocks");
+}
+
+// The bone name of a pose.bones["..."] path, with
+// the quotes and backslashes Blender escapes undone
+static bool ParseBonePath(const std::string &path, std::string &bone) {
+	const char *prefix = "pose.bones[\"";
+	size_t length = strlen(prefix);
+
+	if(path.compare(0, length, prefix) != 0) {
+		return false;
+	}
+
+	bone.clear();
+	for(size_t i=length; i < path.size(); i++) {
+		if(path[i] == '\\' && i + 1 < path.size()) {
+			bone += path[++i];
+		}
+		else if(path[i] == '"') {
+			return true;
+		}
+		else {
+			bone += path[i];
+		}
+	}
+
+	return false;
+}
+
+// Walks each action's FCurve list and copies the keys. The
+// legacy curves list is read, layered actions (Blender 4.4)
+// keep their curves in channel bags that are not followed.
+void BlenderFile::ExtractActions() {
+	BLENDER_TRACE_SCOPE("BlenderFile::ExtractActions");
+
+	BlenderBlockQuery actions = Query("bAction");
+	BlenderBlockQuery curves = Query("FCurve");
+	BlenderBlockQuery keys = Query("BezTriple");
+
+	if(actions.empty() || curves.empty()) {
+		return;
+	}
+
+	BlenderFieldAccessor name = actions.GetField("id.name");
+	BlenderFieldAccessor first = actions.GetField("curves.first");
+	BlenderFieldAccessor next = curves.GetField("next");
+	BlenderFieldAccessor bezt = curves.GetField("bezt");
+	BlenderFieldAccessor totvert = curves.GetField("totvert");
+	BlenderFieldAccessor rnaPath = curves.GetField("rna_path");
+	BlenderFieldAccessor arrayIndex = curves.GetField("array_index");
+	BlenderFieldAccessor extend = curves.GetField("extend");
+	BlenderFieldAccessor vec = keys.GetField("vec");
+	BlenderFieldAccessor ipo = keys.GetField("ipo");
+
+	if(!name.IsString() || !first.IsPointer() || !next.IsPointer() || !bezt.IsPointer() || !totvert.IsInt() || !IsFloatArray(vec, 9)) {
+		BLENDER_LOG(BLENDER_TRACE_WARNING, "FCurve or BezTriple struct has unknown fields, actions skipped");
+		return;
+	}
+
+	int curveStruct = m_SDNA.GetStructureIndex("FCurve");
+	int keyStruct = m_SDNA.GetStructureIndex("BezTriple");
+
+	m_Actions.resize(actions.size());
+
+	for(unsigned int i=0; i < actions.size(); i++) {
+		BlenderAction &action = m_Actions[i];
+		action.name = name.GetString(actions[i]);
+		action.frameStart = 0.0f;
+		action.frameEnd = 0.0f;
+
+		bool hasKeys = false;
+
+		// Bounded by the number of FCurves in case of a cycle
+		const BlenderFileBlock *block = FindBlock(first.GetPointer(actions[i]));
+		for(size_t n=0; block && (int)block->m_Header.sdna == curveStruct && n < curves.size(); n++) {
+			BlenderFCurve curve;
+			curve.arrayIndex = arrayIndex.IsInt() ? arrayIndex.GetInt(*block) : 0;
+			curve.extrapolateLinear = extend.IsShort() && extend.GetShort(*block) == 1;
+
+			const BlenderFileBlock *path = rnaPath.IsPointer() ? FindBlock(rnaPath.GetPointer(*block)) : 0;
+			if(path) {
+				const char *text = (const char *)path->GetBuffer();
+				curve.rnaPath.assign(text, strnlen(text, path->m_Header.size));
+			}
+
+			curve.boneIndex = -1;
+			if(ParseBonePath(curve.rnaPath, curve.boneName)) {
+				curve.boneIndex = m_Armature.FindBone(curve.boneName);
+			}
+
+			const BlenderFileBlock *keyBlock = FindBlock(bezt.GetPointer(*block));
+			int count = 0;
+
+			// The block may hold fewer keys than totvert says, or none
+			if(keyBlock && (int)keyBlock->m_Header.sdna == keyStruct) {
+				count = totvert.GetInt(*block);
+				if(count > 0 && (unsigned int)count > keyBlock->m_Header.count) {
+					count = (int)keyBlock->m_Header.count;
+				}
+			}
+
+			if(count > 0) {
+				curve.keys.resize(count);
+
+				for(int k=0; k < count; k++) {
+					BlenderKeyframe &key = curve.keys[k];
+
+					for(int p=0; p < 3; p++) {
+						key.points[p][0] = vec.GetFloat(*keyBlock, k, p * 3);
+						key.points[p][1] = vec.GetFloat(*keyBlock, k, p * 3 + 1);
+					}
+
+					key.interpolation = ipo.IsChar() ? ipo.GetChar(*keyBlock, k) : (char)BLENDER_IPO_BEZIER;
+				}
+
+				float start = curve.keys[0].points[1][0];
+				float end = curve.keys[count-1].points[1][0];
+
+				action.frameStart = (hasKeys && action.frameStart < start) ? action.frameStart : start;
+				action.frameEnd = (hasKeys && action.frameEnd > end) ? action.frameEnd : end;
+				hasKeys = true;
+			}
+
+			if(!curve.boneName.empty()) {
+				size_t b = 0;
+				while(b < action.bones.size() && action.bones[b].boneName != curve.boneName) {
+					b++;
+				}
+
+				if(b == action.bones.size()) {
+					BlenderBoneCurves bone;
+					bone.boneName = curve.boneName;
+					bone.boneIndex = curve.boneIndex;
+					action.bones.push_back(bone);
+				}
+
+				action.bones[b].curves.push_back((int)action.curves.size());
+			}
+
+			action.curves.push_back(curve);
+			block = FindBlock(next.GetPointer(*block));
+		}
+
+		if(m_Config.actionBakeStep > 0.0f) {
+			BlenderBakeAction(action, m_Config.actionBakeStep, m_Config.actionBakeTolerance, m_Pool.get(), action.baked);
+		}
+	}
+
+	BLENDER_LOG(BLENDER_TRACE_INFO, m_Actions.size() << " actions");
+}
+
+// Finds the owner of every packed file through the pointers of
+// the Image, VFont and bSound blocks, and the ImagePackedFile
+// list images have kept since Blender 3.0 (one per UDIM tile)
+void BlenderFile::ExtractPackedFiles() {
+	BLENDER_TRACE_SCOPE("BlenderFile::ExtractPackedFiles");
+
+	BlenderBlockQuery packed = Query("PackedFile");
+	if(packed.empty()) {
+		return;
+	}
+
+	BlenderFieldAccessor size = packed.GetField("size");
+	BlenderFieldAccessor data = packed.GetField("data");
+
+	if(!size.IsInt() || !data.IsPointer()) {
+		BLENDER_LOG(BLENDER_TRACE_WARNING, "PackedFile struct has unknown fields, packed files skipped");
+		return;
+	}
+
+	struct Owner {
+		std::string name;
+		std::string filepath;
+	};
+
+	std::unordered_map<const void *, Owner> owners;
+	const char *ownerTypes[] = { "Image", "VFont", "bSound" };
+
+	for(int t=0; t < 3; t++) {
+		BlenderBlockQuery ids = Query(ownerTypes[t]);
+		BlenderFieldAccessor name = ids.GetField("id.name");
+		BlenderFieldAccessor packedfile = ids.GetField("packedfile");
+		BlenderFieldAccessor filepath = ids.GetField("filepath");
+		if(!filepath.IsString()) {
+			filepath = ids.GetField("name");
+		}
+
+		if(!name.IsString() || !packedfile.IsPointer()) {
+			continue;
+		}
+
+		for(unsigned int i=0; i < ids.size(); i++) {
+			Owner owner;
+			owner.name = name.GetString(ids[i]);
+			owner.filepath = filepath.IsString() ? filepath.GetString(ids[i]) : "";
+
+			if(packedfile.GetPointer(ids[i])) {
+				owners[packedfile.GetPointer(ids[i])] = owner;
+			}
+		}
+	}
+
+	BlenderBlockQuery images = Query("Image");
+	BlenderBlockQuery tiles = Query("ImagePackedFile");
+	BlenderFieldAccessor imageName = images.GetField("id.name");
+	BlenderFieldAccessor first = images.GetField("packedfiles.first");
+	BlenderFieldAccessor next = tiles.GetField("next");
+	BlenderFieldAccessor tileFile = tiles.GetField("packedfile");
+	BlenderFieldAccessor tilePath = tiles.GetField("filepath");
+
+	if(imageName.IsString() && first.IsPointer() && next.IsPointer() && tileFile.IsPointer()) {
+		int tileStruct = m_SDNA.GetStructureIndex("ImagePackedFile");
+
+		for(unsigned int i=0; i < images.size(); i++) {
+			// Bounded by the number of tiles in case of a cycle
+			const BlenderFileBlock *block = FindBlock(first.GetPointer(images[i]));
+			for(size_t n=0; block && (int)block->m_Header.sdna == tileStruct && n < tiles.size(); n++) {
+				Owner owner;
+				owner.name = imageName.GetString(images[i]);
+				owner.filepath = tilePath.IsString() ? tilePath.GetString(*block) : "";
+				owners[tileFile.GetPointer(*block)] = owner;
+
+				block = FindBlock(next.GetPointer(*block));
+			}
+		}
+	}
+
+	m_PackedFiles.resize(packed.size());
+
+	for(unsigned int i=0; i < packed.size(); i++) {
+		BlenderPackedFile &file = m_PackedFiles[i];
+		int packedSize = size.GetInt(packed[i]);
+		file.size = (packedSize > 0) ? (size_t)packedSize : 0;
+		file.fileOffset = 0;
+
+		std::unordered_map<const void *, Owner>::const_iterator owner = owners.find(packed[i].m_Header.old_mem_address);
+		if(owner != owners.end()) {
+			file.owner = owner->second.name;
+			file.filepath = owner->second.filepath;
+		}
+
+		// The payload is a raw DATA block, used in place
+		const void *address = data.GetPointer(packed[i]);
+		const BlenderFileBlock *payload = FindBlock(address);
+
+		if(payload) {
+			file.size = (file.size < payload->m_Header.size) ? file.size : payload->m_Header.size;
+			file.data = BlenderSpan<const unsigned char>(payload->GetBuffer(), file.size);
+		}
+		else {
+			// PackedFile.size is not trusted past the block
+			std::unordered_map<const void *, std::pair<size_t, size_t> >::const_iterator it = m_PackedOffsets.find(address);
+			if(it != m_PackedOffsets.end()) {
+				file.fileOffset = it->second.first;
+				file.size = (file.size < it->second.second) ? file.size : it->second.second;
+			}
+		}
+	}
+
+	BLENDER_LOG(BLENDER_TRACE_INFO, m_PackedFiles.size() << " packed files");
+}
+
+BlenderSpan<const unsigned char> BlenderFile::LoadPackedFile(int index) {
+	BlenderPackedFile &file = m_PackedFiles[index];
+	if(!file.data.empty() || file.fileOffset == 0 || file.size == 0) {
+		return file.data;
+	}
+
+	file.data = ReadPackedPayload(file, [this](size_t size) { return m_Arena.AllocateArray<unsigned char>(size); });
+	return file.data;
+}
+
+BlenderSpan<const unsigned char> BlenderFile::ReadPackedFile(int index, std::vector<unsigned char> &buffer) const {
+	const BlenderPackedFile &file = m_PackedFiles[index];
+	if(!file.data.empty() || file.fileOffset == 0 || file.size == 0) {
+		return file.data;
+	}
+
+	return ReadPackedPayload(file, [&buffer](size_t size) {
+		buffer.resize(size);
+		return buffer.data();
+	});
+}
+
+// Reads a deferred payload into the storage allocate
+// returns, empty if it could not be read
+BlenderSpan<const unsigned char> BlenderFile::ReadPackedPayload(const BlenderPackedFile &file, const std::function<unsigned char *(size_t size)> &allocate) const {
+	// The source may be gone since the load
+	std::unique_ptr<BlenderReader> reader = OpenReader();
+	if(!reader) {
+		BLENDER_LOG(BLENDER_TRACE_WARNING, "Failed to reopen " << m_Filename << " for packed file " << file.owner);
+		return BlenderSpan<const unsigned char>();
+	}
+
+	reader->Seek(file.fileOffset);
+
+	// Memory and mapped sources need no copy
+	const unsigned char *mapped = reader->Map(file.size);
+	if(mapped) {
+		return BlenderSpan<const unsigned char>(mapped, file.size);
+	}
+
+	unsigned char *buffer = allocate(file.size);
+
+	if(reader->Read(buffer, file.size) != file.size) {
+		return BlenderSpan<const unsigned char>();
+	}
+
+	return BlenderSpan<const unsigned char>(buffer, file.size);
+}
+
+void BlenderFile::ParallelFor(size_t count, size_t minBatch, const std::function<void(size_t begin, size_t end)> &fn) {
+	if(m_Pool) {
+		m_Pool->ParallelFor(count, minBatch, fn);
+	}
+	else {
+		fn(0, count);
+	}
+}
+
+BlenderBlockQuery BlenderFile::Query(const std::string &type) const {
+	int index = m_SDNA.GetStructureIndex(type);
+
+	if(index == -1 || index >= (int)m_BlocksByStruct.size()) {
+		return BlenderBlockQuery(&m_SDNA, index, BlenderSpan<const BlenderFileBlock *const>(), m_FileHeader.pointer_size);
+	}
+
+	return BlenderBlockQuery(&m_SDNA, index, m_BlocksByStruct[index], m_FileHeader.pointer_size);
+}
+
+const BlenderFileBlock *BlenderFile::FindBlock(const void *oldAddress) const {
+	std::unordered_map<const void *, const BlenderFileBlock *>::const_iterator it = m_BlocksByAddress.find(oldAddress);
+	return (it == m_BlocksByAddress.end()) ? 0 : it->second;
 }
 
-int BlenderFile::GetNumFileBlocks() {
+int BlenderFile::GetNumFileBlocks() const {
 	return m_FileBlocks.size();
 }
 
-std::string BlenderFile::GetFileBlockInfo(int index) {
+std::string BlenderFile::GetFileBlockInfo(int index) const {
 	char buffer[256];
 
 	sprintf_s(buffer, "File Block Code: %s\nSize: %u\nOld Address: %p\nSDNA: %u\nCount: %u\n",
@@ -333,7 +2380,7 @@ std::string BlenderFile::GetFileBlockInfo(int index) {
 	return output;
 }
 
-std::string BlenderFile::GetSDNAInfo() {
+std::string BlenderFile::GetSDNAInfo() const {
 	std::string output = "NAMES:\n\n";
 	char buffer[256];
 
@@ -4,6 +4,17 @@
 #include "BlenderFileBlock.h"
 #include "BlenderMesh.h"
 #include "BlenderArmature.h"
+#include "BlenderReader.h"
+#include "BlenderThreadPool.h"
+#include "BlenderQuery.h"
+#include "BlenderObject.h"
+#include "BlenderAction.h"
+#include "BlenderLibrary.h"
+
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
 
 struct BlenderFileHeader {
 	char identifier[8];
@@ -12,40 +23,279 @@ struct BlenderFileHeader {
 	char version[4];
 };
 
+// A file packed into the .blend, e.g. an image. data points
+// straight into the block payload, it is empty while the
+// payload is deferred (see BlenderFile::LoadPackedFile).
+struct BlenderPackedFile {
+	// ID name of the Image, VFont or bSound using it, with
+	// the code prefix, and the path it was packed from
+	std::string owner;
+	std::string filepath;
+
+	// PackedFile.size, cut to the payload block
+	size_t size;
+	BlenderSpan<const unsigned char> data;
+
+	// Where a deferred payload starts in the .blend
+	size_t fileOffset;
+};
+
+enum BlenderLoadState {
+	BLENDER_LOAD_IDLE,
+	BLENDER_LOAD_BLOCKS,
+	BLENDER_LOAD_EXTRACT,
+	BLENDER_LOAD_DONE,
+	BLENDER_LOAD_CANCELLED,
+	BLENDER_LOAD_FAILED
+};
+
+// Once loaded, a file is only read through its const
+// methods, which never write and are safe to call from
+// any number of threads at once. BlenderImporter::
+// LoadFrozenFile hands out files that way. Products
+// derived from a mesh go into a copy, see
+// BlenderMesh::CopyTo.
 class BlenderFile {
 public:
-	BlenderFile() {}
+	BlenderFile() { m_CurrentGroup = BLOCK_GROUP_NONE; m_SkippingGroup = false; m_RetainedMeshBytes = 0; m_LoadState = BLENDER_LOAD_IDLE; m_Cancelled = false; m_PackedFileStruct = -1; m_FilterReachable = false; m_SDNAFirst = false; m_BlocksRead = 0; m_NextMeshGroup = 0; }
 	BlenderFile(std::string filename, BlenderImporterConfig config);
+
+	// Reads from a file, a mapped file, memory or callbacks.
+	// Memory and mapped sources are read in place, block
+	// payloads point into them instead of the arena.
+	BlenderFile(BlenderSource source, BlenderImporterConfig config);
 	~BlenderFile();
 
-	void Load();
+	// Files own their blocks and extracted data,
+	// they can be moved but never copied. A move
+	// during a load waits for its extraction workers,
+	// destroying the file cancels the load.
+	BlenderFile(BlenderFile &&other);
+	BlenderFile &operator=(BlenderFile &&other);
+	BlenderFile(const BlenderFile &) = delete;
+	BlenderFile &operator=(const BlenderFile &) = delete;
+
+	// Returns false if the load failed, GetError says why
+	bool Load();
 
-	std::string GetFilename();
-	std::string GetHeaderInfo();
+	// Incremental loading for hosts that must stay responsive:
+	// call BeginLoad once, then LoadStep with a time budget
+	// (e.g. once per frame) until it returns BLENDER_LOAD_DONE.
+	// Cancel drops the partial load at the next step.
+	bool BeginLoad();
+	BlenderLoadState LoadStep(double budgetMs);
+	BlenderLoadState GetLoadState() const { return m_LoadState; }
+	float GetProgress() const;
+	void Cancel();
 
-	int GetNumFileBlocks();
-	std::string GetFileBlockInfo(int index);
+	// Why the load failed, empty otherwise
+	const std::string &GetError() const { return m_Error; }
 
-	bool ExtractSDNA(BlenderFileBlock &block);
-	std::string GetSDNAInfo();
+	std::string GetFilename() const;
+	std::string GetHeaderInfo() const;
+
+	int GetNumFileBlocks() const;
+	std::string GetFileBlockInfo(int index) const;
+
+	bool ExtractSDNA(const BlenderFileBlock &block);
+	std::string GetSDNAInfo() const;
 	StructureDNA *GetSDNA() { return &m_SDNA; }
+	const StructureDNA *GetSDNA() const { return &m_SDNA; }
 
-	BlenderMesh *GetMesh() { return &m_Mesh; }
+	// GetMesh() returns the first mesh, or null if there is none
+	int GetNumMeshes() const { return (int)m_Meshes.size(); }
+	BlenderMesh *GetMesh() { return m_Meshes.empty() ? 0 : &m_Meshes[0]; }
+	BlenderMesh *GetMesh(int index) { return &m_Meshes[index]; }
+	const BlenderMesh *GetMesh(int index) const { return &m_Meshes[index]; }
 	BlenderArmature *GetArmature() { return &m_Armature; }
+	const BlenderArmature *GetArmature() const { return &m_Armature; }
+
+	// Objects in topological order, and one instance per
+	// object that uses a loaded mesh. A mesh shared by many
+	// objects is extracted once. Objects need the OB blocks
+	// to be retained, so there are none in streaming mode.
+	int GetNumObjects() const { return (int)m_Objects.size(); }
+	BlenderObject *GetObject(int index) { return &m_Objects[index]; }
+	const BlenderObject *GetObject(int index) const { return &m_Objects[index]; }
+	BlenderSpan<const BlenderInstance> GetInstances() const { return m_Instances; }
+
+	// Actions with their F-curves, bone curves are matched
+	// to the armature. Like objects, they need the blocks
+	// to be retained, so there are none in streaming mode.
+	int GetNumActions() const { return (int)m_Actions.size(); }
+	BlenderAction *GetAction(int index) { return &m_Actions[index]; }
+	const BlenderAction *GetAction(int index) const { return &m_Actions[index]; }
+
+	// Reflective access to any datablock through the block
+	// index, e.g. Query("Object") or Query("Material"). The
+	// index covers the retained blocks, so it is empty in
+	// streaming mode and after ReleaseFileBlocks. Raw data
+	// blocks (DATA with sdna 0) are not in it.
+	BlenderBlockQuery Query(const std::string &type) const;
+
+	// The block a pointer field pointed to when the file was
+	// saved, null if it was not retained
+	const BlenderFileBlock *FindBlock(const void *oldAddress) const;
+
+	// Libraries and the datablocks linked from them, loaded
+	// with config.linkLibraries
+	int GetNumLibraries() const { return (int)m_Libraries.size(); }
+	const BlenderLibrary *GetLibrary(int index) const { return &m_Libraries[index]; }
+	int GetNumLinkedIDs() const { return (int)m_LinkedIDs.size(); }
+	const BlenderLinkedID *GetLinkedID(int index) const { return &m_LinkedIDs[index]; }
+
+	// Packed files in file order. The data spans are only
+	// valid while the file keeps its blocks.
+	int GetNumPackedFiles() const { return (int)m_PackedFiles.size(); }
+	const BlenderPackedFile *GetPackedFile(int index) const { return &m_PackedFiles[index]; }
+
+	// Reads a payload left on disk by deferPackedFiles into
+	// the file arena. Returns the data, empty if it could not
+	// be read. Already loaded payloads are returned as is.
+	BlenderSpan<const unsigned char> LoadPackedFile(int index);
 
-	void Release();
+	// LoadPackedFile for a frozen file. Nothing is stored, a
+	// deferred payload is read into buffer unless the source
+	// is in memory. Safe to call from several threads, unless
+	// the file was loaded from callbacks.
+	BlenderSpan<const unsigned char> ReadPackedFile(int index, std::vector<unsigned char> &buffer) const;
+
+	// Reads only the block headers and the name of every
+	// datablock, with its ID code, e.g. "MECube". Nothing is
+	// loaded. Returns false if this is not a complete .blend.
+	bool ScanIDs(std::vector<std::string> &names);
+
+	// Frees the raw block payloads early, the extracted
+	// mesh and armature stay valid. Everything else is
+	// released when the file is destroyed.
 	void ReleaseFileBlocks();
 
 private:
+	enum BlockGroup {
+		BLOCK_GROUP_NONE,
+		BLOCK_GROUP_MESH,
+		BLOCK_GROUP_ARMATURE
+	};
+
+	// A mesh group handed to the extraction workers. In
+	// streaming mode it owns its blocks and their payloads.
+	struct PendingMesh {
+		std::vector<BlenderFileBlock> ownedBlocks;
+		BlenderArena payloads;
+		BlenderSpan<const BlenderFileBlock> blocks;
+		BlenderMesh mesh;
+	};
+
+	bool ReadNextBlock();
+	void FinishBlocks();
+	void FinishLoad();
+	void AbortLoad();
+	void FailLoad(const std::string &error);
+	void MoveFrom(BlenderFile &other);
+	void BuildBlockIndex();
+	void IndexBlocks(const std::vector<BlenderFileBlock> &blocks);
+	void ResolveMaterials();
+	void ResolveShapeKeys();
+	void ExtractObjects();
+	void ExtractActions();
+	void ExtractPackedFiles();
+	void ResolveLibraries();
+	bool DeferPackedPayload(BlenderFileBlock &block, BlenderReader *reader);
+	void ParallelFor(size_t count, size_t minBatch, const std::function<void(size_t begin, size_t end)> &fn);
+
+	bool ReadFileHeader(BlenderReader *reader);
+	bool LocateSDNA(BlenderReader *reader);
+	bool ValidateBlockHeader(const BlenderFileBlockHeader &header);
+	std::unique_ptr<BlenderReader> OpenReader();
+	std::unique_ptr<BlenderReader> OpenReader() const;
+	BlenderSpan<const unsigned char> ReadPackedPayload(const BlenderPackedFile &file, const std::function<unsigned char *(size_t size)> &allocate) const;
+	void BuildStructFilter();
+	bool AcceptIDBlock(const BlenderFileBlock &block, BlenderReader *reader);
+	void BuildReachableSet(BlenderReader *reader);
+	bool IsReachable(const BlenderFileBlock &block) { return !m_FilterReachable || m_Reachable.count(block.m_Header.old_mem_address) != 0; }
+	void BeginGroup(BlockGroup group);
+	void EndGroup();
+	void ExtractMesh(BlenderSpan<const BlenderFileBlock> blocks);
+	void LoadMeshGroup(BlenderMesh &mesh, BlenderSpan<const BlenderFileBlock> blocks);
+	void RetainMesh(BlenderMesh &&mesh);
+	void DispatchMesh(std::unique_ptr<PendingMesh> pending);
+	void CompletePendingMeshes();
+	void ApplyBackpressure(size_t incomingBytes);
+	void FlushMeshes();
+
 	std::string m_Filename;
+	BlenderSource m_Source;
 	BlenderImporterConfig m_Config;
 
+	// Set once a mapped source is opened, readers
+	// and block payloads point into it
+	std::shared_ptr<BlenderMappedFile> m_Mapping;
+
+	// Load progress, kept between LoadStep calls
+	BlenderLoadState m_LoadState;
+	std::string m_Error;
+	std::unique_ptr<BlenderReader> m_Reader;
+	bool m_SDNAFirst;
+	bool m_Cancelled;
+	int m_BlocksRead;
+	size_t m_NextMeshGroup;
+
 	BlenderFileHeader m_FileHeader;
 	std::vector<BlenderFileBlock> m_FileBlocks;
 	std::vector<BlenderFileBlock> m_MeshBlocks;
 	std::vector<BlenderFileBlock> m_ArmatureBlocks;
 	StructureDNA m_SDNA;
 
-	BlenderMesh m_Mesh;
+	// Owns the payloads of every retained block
+	BlenderArena m_Arena;
+
+	// m_MeshBlocks collects the group being read, each
+	// finished group (an ME block and its DATA blocks)
+	// is moved to m_MeshGroups
+	std::vector<std::vector<BlenderFileBlock> > m_MeshGroups;
+	BlockGroup m_CurrentGroup;
+
+	// Set while the DATA blocks of a datablock
+	// rejected by the load filter go past
+	bool m_SkippingGroup;
+
+	// DATA blocks to skip, by SDNA struct index
+	std::vector<bool> m_SkipStructs;
+
+	// Streaming mode keeps only the current group's
+	// payloads, in their own arena
+	BlenderArena m_StreamArena;
+	size_t m_RetainedMeshBytes;
+
+	// Retained blocks by SDNA struct index and by old address
+	std::vector<std::vector<const BlenderFileBlock *> > m_BlocksByStruct;
+	std::unordered_map<const void *, const BlenderFileBlock *> m_BlocksByAddress;
+
+	std::vector<BlenderMesh> m_Meshes;
 	BlenderArmature m_Armature;
+	std::vector<BlenderObject> m_Objects;
+	std::vector<BlenderInstance> m_Instances;
+	std::vector<BlenderAction> m_Actions;
+	std::vector<BlenderPackedFile> m_PackedFiles;
+	std::vector<BlenderLibrary> m_Libraries;
+	std::vector<BlenderLinkedID> m_LinkedIDs;
+
+	// With deferPackedFiles, the data pointers of the
+	// PackedFile blocks read so far, and where each of
+	// their payloads starts in the file and its size
+	int m_PackedFileStruct;
+	BlenderFieldAccessor m_PackedFileData;
+	std::unordered_set<const void *> m_PackedAddresses;
+	std::unordered_map<const void *, std::pair<size_t, size_t> > m_PackedOffsets;
+
+	// With filter.roots, the old address of every block
+	// reachable from them
+	bool m_FilterReachable;
+	std::unordered_set<const void *> m_Reachable;
+
+	// Only set while a pipelined Load runs. The workers
+	// point into the members above, so the pool is
+	// declared last and goes first.
+	std::vector<std::unique_ptr<PendingMesh> > m_PendingMeshes;
+	std::unique_ptr<BlenderThreadPool> m_Pool;
 };
@@ -1,65 +1,142 @@
 #include "BlenderFileBlock.h"
 
+#include <utility>
+
 ////////////////////////////////////
 // BlenderFileBlock implementation
 ////////////////////////////////////
-void BlenderFileBlock::Load(std::fstream *file, unsigned short pointer_size) {
-	file->read(m_Header.code, 4);
+BlenderFileBlock::BlenderFileBlock(BlenderFileBlock &&other) {
+	m_Buffer = 0;
+	m_OwnsBuffer = false;
+	*this = std::move(other);
+}
+
+BlenderFileBlock &BlenderFileBlock::operator=(BlenderFileBlock &&other) {
+	if(this != &other) {
+		ReleaseBuffer();
+
+		m_Header = other.m_Header;
+		m_Buffer = other.m_Buffer;
+		m_OwnsBuffer = other.m_OwnsBuffer;
+
+		other.m_Buffer = 0;
+		other.m_OwnsBuffer = false;
+	}
+
+	return *this;
+}
+
+void BlenderFileBlock::InitBuffer(size_t size, BlenderArena *arena) {
+	if(arena) {
+		m_Buffer = (unsigned char *)arena->Allocate(size);
+		m_OwnsBuffer = false;
+	}
+	else {
+		m_Buffer = new unsigned char[size];
+		m_OwnsBuffer = true;
+		BLENDER_TRACE_COUNT(BLENDER_COUNTER_ALLOCATIONS, 1);
+	}
+}
+
+void BlenderFileBlock::ReleaseBuffer() {
+	if(m_Buffer && m_OwnsBuffer) {
+		delete[] m_Buffer;
+	}
+
+	m_Buffer = 0;
+	m_OwnsBuffer = false;
+}
+
+void BlenderFileBlock::Load(BlenderReader *reader, unsigned short pointer_size, BlenderArena *arena) {
+	LoadHeader(reader, pointer_size);
+	LoadPayload(reader, arena);
+}
+
+void BlenderFileBlock::LoadHeader(BlenderReader *reader, unsigned short pointer_size) {
+	reader->Read(m_Header.code, 4);
 	m_Header.code[4] = 0;
 
-	file->read((char *)&(m_Header.size), 4);
-	file->read((char *)&(m_Header.old_mem_address), pointer_size);
-	file->read((char *)&(m_Header.sdna), 4);
-	file->read((char *)&(m_Header.count), 4);
+	reader->Read(&(m_Header.size), 4);
+	m_Header.old_mem_address = 0;
+	reader->Read(&(m_Header.old_mem_address), pointer_size);
+	reader->Read(&(m_Header.sdna), 4);
+	reader->Read(&(m_Header.count), 4);
+}
+
+// Readers over memory hand out the payload in place, it
+// then belongs to the source like it would to an arena
+void BlenderFileBlock::LoadPayload(BlenderReader *reader, BlenderArena *arena) {
+	const unsigned char *data = reader->Map(m_Header.size);
 
-	InitBuffer(m_Header.size);
-	file->read((char *)GetBuffer(), m_Header.size);
+	if(data) {
+		m_Buffer = (unsigned char *)data;
+		m_OwnsBuffer = false;
+	}
+	else {
+		InitBuffer(m_Header.size, arena);
+		reader->Read(GetBuffer(), m_Header.size);
+	}
+
+	BLENDER_TRACE_COUNT(BLENDER_COUNTER_BLOCKS, 1);
+	BLENDER_TRACE_COUNT(BLENDER_COUNTER_BYTES, m_Header.size);
+}
+
+void BlenderFileBlock::SkipPayload(BlenderReader *reader) {
+	reader->Skip(m_Header.size);
 }
 
 // First version retrieves a value when 'count' is known to be one
 // Second version retrieves a value when iterating over many instances
 // of an object.
-void *BlenderFileBlock::GetPointer(unsigned int offset, unsigned int iteration, unsigned int structLength) {
+void *BlenderFileBlock::GetPointer(unsigned int offset, unsigned int iteration, unsigned int structLength) const {
 	return (void*)&m_Buffer[offset + iteration * structLength];
 }
 
-char BlenderFileBlock::GetChar(unsigned int offset, unsigned int iteration, unsigned int structLength) {
+const void *BlenderFileBlock::GetOldPointer(unsigned int offset, unsigned short pointerSize) const {
+	if(pointerSize == 4) {
+		return (const void *)(size_t)GetValue<unsigned int>(offset);
+	}
+
+	return (const void *)(size_t)GetValue<unsigned long long>(offset);
+}
+
+char BlenderFileBlock::GetChar(unsigned int offset, unsigned int iteration, unsigned int structLength) const {
 	return *((char*)&m_Buffer[offset + iteration * structLength]);
 }
 
-int BlenderFileBlock::GetInt(char *name, StructureDNA *sdna) {
+int BlenderFileBlock::GetInt(const char *name, const StructureDNA *sdna) const {
       int offset = GetMemberOffset(name, sdna);
-	  return (offset == -1) ? -1 : *((int*)&m_Buffer[offset]);
+	  return (offset == -1) ? -1 : GetValue<int>(offset);
 }
 
-int BlenderFileBlock::GetInt(unsigned int offset, unsigned int iteration, unsigned int structLength) {
-      return *((int*)&m_Buffer[offset + iteration * structLength]);
+int BlenderFileBlock::GetInt(unsigned int offset, unsigned int iteration, unsigned int structLength) const {
+      return GetValue<int>(offset + iteration * structLength);
 }
 
-short BlenderFileBlock::GetShort(char *name, StructureDNA *sdna) {
+short BlenderFileBlock::GetShort(const char *name, const StructureDNA *sdna) const {
       int offset = GetMemberOffset(name, sdna);
-	  return (offset == -1) ? -1 : *((short*)&m_Buffer[offset]);
+	  return (offset == -1) ? -1 : GetValue<short>(offset);
 }
 
-short BlenderFileBlock::GetShort(unsigned int offset, unsigned int iteration, unsigned int structLength) {
-      return *((short*)&m_Buffer[offset + iteration * structLength]);
+short BlenderFileBlock::GetShort(unsigned int offset, unsigned int iteration, unsigned int structLength) const {
+      return GetValue<short>(offset + iteration * structLength);
 }
 
-float BlenderFileBlock::GetFloat(char *name, StructureDNA *sdna) {
+float BlenderFileBlock::GetFloat(const char *name, const StructureDNA *sdna) const {
       int offset = GetMemberOffset(name, sdna);
-	  return (offset == -1) ? -1 : *((float*)&m_Buffer[offset]);
+	  return (offset == -1) ? -1 : GetValue<float>(offset);
 }
 
-float BlenderFileBlock::GetFloat(unsigned int offset, unsigned int iteration, unsigned int structLength) {
-      return *((float*)&m_Buffer[offset + iteration * structLength]);
+float BlenderFileBlock::GetFloat(unsigned int offset, unsigned int iteration, unsigned int structLength) const {
+      return GetValue<float>(offset + iteration * structLength);
 }
 
-const char* BlenderFileBlock::GetString(char *name, StructureDNA *sdna) {
+const char* BlenderFileBlock::GetString(const char *name, const StructureDNA *sdna) const {
       int offset = GetMemberOffset(name, sdna);      
 	  return (offset == -1) ? "n/a" : (const char *)&m_Buffer[offset];
 }
 
-int BlenderFileBlock::GetMemberOffset(const char *name, StructureDNA *sdna) {
+int BlenderFileBlock::GetMemberOffset(const char *name, const StructureDNA *sdna) const {
       std::string n(name);
       size_t pos = n.find('.');
 
@@ -72,13 +149,16 @@ int BlenderFileBlock::GetMemberOffset(const char *name, StructureDNA *sdna) {
             int offset_struct = 0;
             int offset_field = 0;
             
-			GetOffsets(&offset_struct, &offset_field, structname.c_str(), fieldname.c_str(), sdna);
+			if(!GetOffsets(&offset_struct, &offset_field, structname.c_str(), fieldname.c_str(), sdna)) {
+				return -1;
+			}
+
             return offset_struct + offset_field;
       }
 	  else {
 		  // Otherwise, just load the appropriate structure,
 		  // find the field, and return the offset
-		  Structure structure = sdna->structures[m_Header.sdna];
+		  const Structure &structure = sdna->structures[m_Header.sdna];
 
 		  for (unsigned int i = 0; i < structure.fields.size(); i++) {
 			  if (strcmp(name, sdna->names[structure.fields[i].name_idx].c_str()) == 0) {
@@ -89,35 +169,33 @@ int BlenderFileBlock::GetMemberOffset(const char *name, StructureDNA *sdna) {
 	  }
 }
 
-void BlenderFileBlock::GetOffsets(int *offsetStruct, int *offsetField, const char *structName, const char *fieldName, StructureDNA *sdna) {
+bool BlenderFileBlock::GetOffsets(int *offsetStruct, int *offsetField, const char *structName, const char *fieldName, const StructureDNA *sdna) const {
 	// First retrieve the structure
-	Structure structure = sdna->structures[m_Header.sdna];
+	const Structure &structure = sdna->structures[m_Header.sdna];
 
 	// Run through the fields and find the right sub structure
 	for (unsigned int i = 0; i < structure.fields.size(); i++) {
 		if (strcmp(structName, sdna->names[structure.fields[i].name_idx].c_str()) == 0) {
 			// we found the structure
-			Field field = structure.fields[i];
+			const Field &field = structure.fields[i];
 			*offsetStruct = field.offset;
 
 			// get info for substructure
-			Structure *subStructure = sdna->GetStructureByTypeIndex(field.type_idx);
-
-			//std::cout << "Structure Found: " << sdna->GetType(subStructure->type_idx).c_str() << "\n";
-			//std::cout << "Num fields: " << subStructure->fields.size() << "\n";
+			const Structure *subStructure = sdna->GetStructureByTypeIndex(field.type_idx);
+			if(!subStructure) {
+				return false;
+			}
 
 			// find offset in substructure:
 			for (unsigned int k = 0; k < subStructure->fields.size(); k++) {
-				// PROBLEM IS HERE
-				
-				//std::cout << "Field: " << sdna->GetName(subStructure->fields[k].name_idx).c_str() << "\n";
 				if (strcmp(fieldName, sdna->GetName(subStructure->fields[k].name_idx).c_str()) == 0) {
 					// found field
 					*offsetField = subStructure->fields[k].offset;
-					return;
+					return true;
 				}
 			}
 		}
 	}
-	assert(0 && "Sub structure field not found!");
+
+	return false;
 }
\ No newline at end of file
@@ -1,9 +1,12 @@
 #pragma once
 
-#include <fstream>
 #include <cassert>
+#include <cstring>
 
 #include "BlenderStructure.h"
+#include "BlenderTrace.h"
+#include "BlenderArena.h"
+#include "BlenderReader.h"
 
 struct BlenderFileBlockHeader {
 	char code[5];
@@ -15,29 +18,60 @@ struct BlenderFileBlockHeader {
 
 class BlenderFileBlock {
 public:
-	BlenderFileBlock() { m_Buffer = 0; }
-	~BlenderFileBlock() {}
+	BlenderFileBlock() { m_Buffer = 0; m_OwnsBuffer = false; }
+	~BlenderFileBlock() { ReleaseBuffer(); }
 
-	void InitBuffer(size_t size) { m_Buffer = new unsigned char[size]; }
+	// Blocks are move-only, a copy would alias the payload
+	BlenderFileBlock(BlenderFileBlock &&other);
+	BlenderFileBlock &operator=(BlenderFileBlock &&other);
+	BlenderFileBlock(const BlenderFileBlock &) = delete;
+	BlenderFileBlock &operator=(const BlenderFileBlock &) = delete;
+
+	// Buffers drawn from an arena belong to the arena, only
+	// blocks loaded without one free their own buffer
+	void InitBuffer(size_t size, BlenderArena *arena);
 	unsigned char *GetBuffer() { return m_Buffer; }
-	void ReleaseBuffer() { if(m_Buffer) delete[] m_Buffer; }
-
-	int GetMemberOffset(const char *name, StructureDNA *sdna);
-	void GetOffsets(int *offsetStruct, int *offsetField, const char *structName, const char *fieldName, StructureDNA *sdna);
-	void *GetPointer(unsigned int offset, unsigned int iteration, unsigned int structLength);
-	char GetChar(unsigned int offset, unsigned int iteration, unsigned int structLength);
-	int GetInt(char *name, StructureDNA *sdna);
-	int GetInt(unsigned int offset, unsigned int iteration, unsigned int structLength);
-	short GetShort(char *name, StructureDNA *sdna);
-	short GetShort(unsigned int offset, unsigned int iteration, unsigned int structLength);
-	float GetFloat(char *name, StructureDNA *sdna);
-	float GetFloat(unsigned int offset, unsigned int iteration, unsigned int structLength);
-	const char *GetString(char *name, StructureDNA *sdna);
-
-	void Load(std::fstream *file, unsigned short pointer_size);
+	const unsigned char *GetBuffer() const { return m_Buffer; }
+	void ReleaseBuffer();
+
+	// The accessors do no bounds checks. Offsets taken from
+	// the block's SDNA struct, with iteration below count,
+	// stay inside blocks that passed validation (see
+	// BlenderImporterConfig::validate).
+	int GetMemberOffset(const char *name, const StructureDNA *sdna) const;
+	// False if structName is not a struct field holding fieldName
+	bool GetOffsets(int *offsetStruct, int *offsetField, const char *structName, const char *fieldName, const StructureDNA *sdna) const;
+	void *GetPointer(unsigned int offset, unsigned int iteration, unsigned int structLength) const;
+
+	// The address a pointer field held when the file was
+	// saved, pointerSize bytes wide
+	const void *GetOldPointer(unsigned int offset, unsigned short pointerSize) const;
+	char GetChar(unsigned int offset, unsigned int iteration, unsigned int structLength) const;
+	int GetInt(const char *name, const StructureDNA *sdna) const;
+	int GetInt(unsigned int offset, unsigned int iteration, unsigned int structLength) const;
+	short GetShort(const char *name, const StructureDNA *sdna) const;
+	short GetShort(unsigned int offset, unsigned int iteration, unsigned int structLength) const;
+	float GetFloat(const char *name, const StructureDNA *sdna) const;
+	float GetFloat(unsigned int offset, unsigned int iteration, unsigned int structLength) const;
+	const char *GetString(const char *name, const StructureDNA *sdna) const;
+
+	// Payloads read in place are only 4-byte aligned, so
+	// values are copied out rather than dereferenced
+	template<typename T>
+	T GetValue(unsigned int offset) const {
+		T value;
+		memcpy(&value, &m_Buffer[offset], sizeof(T));
+		return value;
+	}
+
+	void Load(BlenderReader *reader, unsigned short pointer_size, BlenderArena *arena);
+	void LoadHeader(BlenderReader *reader, unsigned short pointer_size);
+	void LoadPayload(BlenderReader *reader, BlenderArena *arena);
+	void SkipPayload(BlenderReader *reader);
 
 	BlenderFileBlockHeader m_Header;
 
 private:
 	unsigned char *m_Buffer;
+	bool m_OwnsBuffer;
 };
\ No newline at end of file
@@ -1,5 +1,7 @@
 #include "BlenderImporter.h"
 
+#include <climits>
+
 ////////////////////////////////////////////////
 // BlenderImporter implementation
 // 
@@ -7,36 +9,70 @@
 // maybe should just be namespaced
 ////////////////////////////////////////////////
 BlenderFile BlenderImporter::LoadBlendFile(std::string filename, BlenderImporterConfig config) {
-	BlenderFile blenderFile(filename, config);
+	return LoadBlendFile(BlenderSource::File(filename), config);
+}
+
+BlenderFile BlenderImporter::LoadBlendFile(BlenderSource source, BlenderImporterConfig config) {
+	BlenderFile blenderFile(source, config);
 	blenderFile.Load();
 	return blenderFile;
 }
 
+std::shared_ptr<const BlenderFile> BlenderImporter::LoadFrozenFile(std::string filename, BlenderImporterConfig config) {
+	return LoadFrozenFile(BlenderSource::File(filename), config);
+}
+
+std::shared_ptr<const BlenderFile> BlenderImporter::LoadFrozenFile(BlenderSource source, BlenderImporterConfig config) {
+	std::shared_ptr<BlenderFile> blenderFile(new BlenderFile(source, config));
+	blenderFile->Load();
+
+	if(blenderFile->GetLoadState() != BLENDER_LOAD_DONE) {
+		return std::shared_ptr<const BlenderFile>();
+	}
+
+	return blenderFile;
+}
+
 // Computes the length of a field based on it's string representation,
 // i.e. *variable is a pointer, variable[5][10] is a 2 dimensional array
+// and *variable[4] an array of 4 pointers
 unsigned int BlenderImporter::ComputeFieldLength(std::string field_name, unsigned short length, size_t pointer_size) {
-	// check if this is a pointer
-	if (field_name.at(0) == '*' || field_name.at(0) == '(')
+	// A malformed name gets a length no struct can hold,
+	// so the SDNA it comes from is rejected
+	if (field_name.empty())
+		return UINT_MAX;
+
+	// function pointers
+	if (field_name.at(0) == '(')
 		return pointer_size;
 
+	if (field_name.at(0) == '*')
+		length = (unsigned short)pointer_size;
+
 	size_t pos = field_name.find("[");
 
-	int arrayMult = 1;
+	unsigned long long arrayMult = 1;
 
 	while (pos != std::string::npos) {
 		// determine the number of array dimensions
 		size_t end = field_name.find("]", pos);
+		if (end == std::string::npos)
+			return UINT_MAX;
+
 		std::string arrayLength = field_name.substr(pos+1, end-pos-1);
 
 		std::stringstream ss(arrayLength);
 
-		long num;
-		if((ss >> num).fail()) {
-			assert(0 && "Error in number conversion");
+		long long num;
+		if((ss >> num).fail() || num < 0 || num > (long long)UINT_MAX) {
+			return UINT_MAX;
 		}
 
 		arrayMult *= num;
+		if (arrayMult > UINT_MAX || arrayMult * length > UINT_MAX)
+			return UINT_MAX;
+
 		pos = field_name.find("[", end);
 	}
-	return arrayMult * length;
-}
\ No newline at end of file
+	return (unsigned int)(arrayMult * length);
+}
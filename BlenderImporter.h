@@ -1,6 +1,7 @@
 #pragma once
 
 #include <sstream>
+#include <memory>
 
 #include "BlenderCommon.h"
 #include "BlenderFile.h"
@@ -14,5 +15,12 @@ public:
 	~BlenderImporter() {}
 
 	static BlenderFile LoadBlendFile(std::string filename, BlenderImporterConfig config);
+	static BlenderFile LoadBlendFile(BlenderSource source, BlenderImporterConfig config);
+
+	// Loads the file and freezes it: only the const interface
+	// is reachable, so it can be shared between threads. Null
+	// if the load did not finish.
+	static std::shared_ptr<const BlenderFile> LoadFrozenFile(std::string filename, BlenderImporterConfig config);
+	static std::shared_ptr<const BlenderFile> LoadFrozenFile(BlenderSource source, BlenderImporterConfig config);
 	static unsigned int ComputeFieldLength(std::string field_name, unsigned short length, size_t pointer_size);
 };
\ No newline at end of file
@@ -0,0 +1,139 @@
+#include "BlenderLibrary.h"
+
+#include "BlenderFile.h"
+
+#include <vector>
+#include <algorithm>
+#include <fstream>
+
+// How many libraries the calling thread is loading
+static thread_local int s_LoadDepth = 0;
+
+static std::shared_ptr<const BlenderFile> LoadLibraryFile(const std::string &path, const std::vector<std::string> &roots, const BlenderImporterConfig &config) {
+	std::ifstream probe(path.c_str(), std::ios::in | std::ios::binary);
+	if(!probe.is_open()) {
+		BLENDER_LOG(BLENDER_TRACE_WARNING, "Library not found: " << path);
+		return std::shared_ptr<const BlenderFile>();
+	}
+
+	BlenderImporterConfig libraryConfig = config;
+	libraryConfig.filter.roots = roots;
+	libraryConfig.filter.names.clear();
+	libraryConfig.filter.idCodes.clear();
+	libraryConfig.streaming.enabled = false;
+
+	probe.close();
+	s_LoadDepth++;
+
+	std::shared_ptr<BlenderFile> file(new BlenderFile(path, libraryConfig));
+	file->Load();
+
+	s_LoadDepth--;
+
+	if(file->GetLoadState() != BLENDER_LOAD_DONE) {
+		return std::shared_ptr<const BlenderFile>();
+	}
+
+	return file;
+}
+
+/////////////////////////////////////////
+// BlenderLibraryCache implementation
+/////////////////////////////////////////
+BlenderLibraryCache &BlenderLibraryCache::Get() {
+	static BlenderLibraryCache cache;
+	return cache;
+}
+
+std::shared_ptr<const BlenderFile> BlenderLibraryCache::Load(const std::string &path, const std::vector<std::string> &idNames, const BlenderImporterConfig &config) {
+	std::thread::id self = std::this_thread::get_id();
+	std::shared_ptr<Entry> entry;
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+
+		if(WaitsOn(path, self)) {
+			BLENDER_LOG(BLENDER_TRACE_WARNING, "Library links back to " << path);
+			return std::shared_ptr<const BlenderFile>();
+		}
+
+		std::shared_ptr<Entry> &slot = m_Entries[path];
+
+		if(!slot) {
+			slot.reset(new Entry());
+		}
+
+		entry = slot;
+		m_Waiting[self] = path;
+	}
+
+	// Held during the load, so a second thread asking
+	// for the same library waits for this one
+	std::lock_guard<std::mutex> entryLock(entry->mutex);
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Waiting.erase(self);
+		m_Loaders[path] = self;
+	}
+
+	std::vector<std::string> roots = entry->roots;
+	for(size_t i=0; i < idNames.size(); i++) {
+		if(std::find(roots.begin(), roots.end(), idNames[i]) == roots.end()) {
+			roots.push_back(idNames[i]);
+		}
+	}
+
+	// Files handed out before keep the old roots
+	if(!entry->loaded || roots.size() != entry->roots.size()) {
+		entry->file = LoadLibraryFile(path, roots, config);
+		entry->roots = roots;
+		entry->loaded = true;
+	}
+
+	std::shared_ptr<const BlenderFile> file = entry->file;
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Loaders.erase(path);
+	}
+
+	return file;
+}
+
+// Follows the chain of threads holding a library and the library
+// they wait for. Reaching thread means waiting would deadlock.
+bool BlenderLibraryCache::WaitsOn(const std::string &path, std::thread::id thread) {
+	const std::string *next = &path;
+
+	for(size_t i=0; i <= m_Loaders.size(); i++) {
+		std::unordered_map<std::string, std::thread::id>::const_iterator loader = m_Loaders.find(*next);
+		if(loader == m_Loaders.end()) {
+			return false;
+		}
+
+		if(loader->second == thread) {
+			return true;
+		}
+
+		std::unordered_map<std::thread::id, std::string>::const_iterator waiting = m_Waiting.find(loader->second);
+		if(waiting == m_Waiting.end()) {
+			return false;
+		}
+
+		next = &waiting->second;
+	}
+
+	return false;
+}
+
+bool BlenderLibraryCache::IsLoading() {
+	return s_LoadDepth > 0;
+}
+
+void BlenderLibraryCache::Clear() {
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	m_Entries.clear();
+}
+
+size_t BlenderLibraryCache::GetNumFiles() {
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	return m_Entries.size();
+}
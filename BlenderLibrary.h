@@ -0,0 +1,96 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "BlenderCommon.h"
+
+class BlenderFile;
+
+// A library .blend, from an LI block. path is the
+// filepath as saved, "//" meaning the directory of
+// the file that links it.
+struct BlenderLibrary {
+	std::string name;
+	std::string path;
+	std::string resolvedPath;
+};
+
+// A datablock linked from a library, from an ID block.
+// file is the library, loaded with filter.roots set to
+// every datablock linked from it, null if it could not
+// be loaded. Files are shared with every other file
+// linking the same library, see BlenderLibraryCache.
+struct BlenderLinkedID {
+	// With the code prefix, e.g. "MEBody"
+	std::string name;
+	int libraryIndex;
+	const void *oldAddress;
+
+	std::shared_ptr<const BlenderFile> file;
+
+	// The mesh of file named like this ID, -1 if
+	// it is not a mesh or was not loaded
+	int meshIndex;
+};
+
+////////////////////////////////////////////////
+// BlenderLibraryCache
+//
+// Process-wide cache of loaded library files, one
+// per library path. A library is parsed once for
+// all the datablocks asked for and then shared by
+// every file linking them, until Clear. It is only
+// parsed again when a datablock it was not loaded
+// with is asked for. The config of the first load
+// is used, so files sharing the cache should be
+// loaded with the same config. Safe to use from
+// several threads; two threads asking for the same
+// library load it once. A load that would wait on
+// a load waiting on it, on this thread or another,
+// is treated as a link back and gives null.
+////////////////////////////////////////////////
+class BlenderLibraryCache {
+public:
+	static BlenderLibraryCache &Get();
+
+	// Loads the library with filter.roots set to the
+	// datablocks, or returns the file loaded before
+	// when it has them all. Null if it does not load
+	// or links back to itself while loading.
+	std::shared_ptr<const BlenderFile> Load(const std::string &path, const std::vector<std::string> &idNames, const BlenderImporterConfig &config);
+
+	// True while the calling thread is loading a library.
+	// Libraries linked from it are then loaded on the same
+	// thread, so a link back to it is always seen.
+	static bool IsLoading();
+
+	// Drops the cache's references, files still
+	// used by a linking file stay alive
+	void Clear();
+	size_t GetNumFiles();
+
+private:
+	BlenderLibraryCache() {}
+
+	struct Entry {
+		std::mutex mutex;
+		bool loaded = false;
+		std::vector<std::string> roots;
+		std::shared_ptr<const BlenderFile> file;
+	};
+
+	bool WaitsOn(const std::string &path, std::thread::id thread);
+
+	std::mutex m_Mutex;
+	std::unordered_map<std::string, std::shared_ptr<Entry> > m_Entries;
+
+	// The thread holding each entry and the path each
+	// thread waits for, guarded by m_Mutex
+	std::unordered_map<std::string, std::thread::id> m_Loaders;
+	std::unordered_map<std::thread::id, std::string> m_Waiting;
+};
@@ -1,12 +1,36 @@
 #include "BlenderMesh.h"
 
+#include "BlenderThreadPool.h"
+#include "BlenderQuery.h"
+#include "BlenderSimplify.h"
+
+#include <utility>
+#include <algorithm>
+#include <functional>
+#include <cstring>
+#include <cfloat>
+#include <cmath>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define BLENDER_SSE2
+#endif
+
 ////////////////////////////////////////
 // BlenderMesh implementation
 //
 // An object to store mesh data
 ////////////////////////////////////////
-BlenderMesh::BlenderMesh() {
+BlenderMesh::BlenderMesh() : m_Arena(1 << 16) {
+	m_TotalVerts = 0;
+	m_TotalEdges = 0;
+	m_TotalLoops = 0;
+	m_TotalPolygons = 0;
+	m_TotalFaces = 0;
+	m_OldAddress = 0;
+
 	m_Vertices = 0;
+	m_Edges = 0;
 	m_Loops = 0;
 	m_LoopUVs = 0;
 	m_Polygons = 0;
@@ -16,9 +40,167 @@ BlenderMesh::BlenderMesh() {
 	m_TexFaces = 0;
 	m_DeformVerts = 0;
 	m_DeformWeights = 0;
+
+	m_Triangulated = false;
+	m_Submeshes = 0;
+	m_TotalSubmeshes = 0;
+	m_BVHNodes = 0;
+	m_TotalBVHNodes = 0;
+	m_BVHFaces = 0;
+	m_Tangents = 0;
+	m_TotalSourceVerts = 0;
+	m_SourceVertices = 0;
+	m_SharedAttributes = false;
+	memset(&m_Bounds, 0, sizeof(m_Bounds));
 }
 
-std::string BlenderMesh::GetMeshInfo() {
+// The arrays move with the arena that owns them,
+// the source is left as an empty mesh
+BlenderMesh::BlenderMesh(BlenderMesh &&other) : m_Arena(std::move(other.m_Arena)) {
+	MoveFrom(other);
+}
+
+BlenderMesh &BlenderMesh::operator=(BlenderMesh &&other) {
+	if(this != &other) {
+		m_Arena = std::move(other.m_Arena);
+		MoveFrom(other);
+	}
+
+	return *this;
+}
+
+void BlenderMesh::MoveFrom(BlenderMesh &other) {
+	m_TotalVerts	= other.m_TotalVerts;
+	m_TotalEdges	= other.m_TotalEdges;
+	m_TotalLoops	= other.m_TotalLoops;
+	m_TotalPolygons	= other.m_TotalPolygons;
+	m_TotalFaces	= other.m_TotalFaces;
+	m_Name.swap(other.m_Name);
+	m_OldAddress	= other.m_OldAddress;
+
+	m_Vertices		= other.m_Vertices;
+	m_Edges			= other.m_Edges;
+	m_Loops			= other.m_Loops;
+	m_LoopUVs		= other.m_LoopUVs;
+	m_Polygons		= other.m_Polygons;
+	m_TexPolygons	= other.m_TexPolygons;
+	m_DeformVerts	= other.m_DeformVerts;
+	m_DeformWeights	= other.m_DeformWeights;
+	m_Faces			= other.m_Faces;
+	m_TexFaces		= other.m_TexFaces;
+	m_Triangulated	= other.m_Triangulated;
+	m_Submeshes		= other.m_Submeshes;
+	m_TotalSubmeshes = other.m_TotalSubmeshes;
+	m_BVHNodes		= other.m_BVHNodes;
+	m_TotalBVHNodes	= other.m_TotalBVHNodes;
+	m_BVHFaces		= other.m_BVHFaces;
+	m_VertexFaces	= other.m_VertexFaces;
+	m_VertexEdges	= other.m_VertexEdges;
+	m_EdgeFaces		= other.m_EdgeFaces;
+	m_Tangents		= other.m_Tangents;
+	m_TotalSourceVerts = other.m_TotalSourceVerts;
+	m_SourceVertices = other.m_SourceVertices;
+	m_Bounds		= other.m_Bounds;
+	m_Materials.swap(other.m_Materials);
+	m_LODs.swap(other.m_LODs);
+	m_ShapeKeys.swap(other.m_ShapeKeys);
+	m_Attributes.swap(other.m_Attributes);
+	m_SharedAttributes = other.m_SharedAttributes;
+
+	other.ReleaseMesh();
+}
+
+template<typename T>
+static T *CopyArray(BlenderArena &arena, const T *source, size_t count) {
+	if(!source || count == 0) {
+		return 0;
+	}
+
+	T *copy = arena.AllocateArray<T>(count);
+	memcpy(copy, source, sizeof(T) * count);
+	return copy;
+}
+
+static void CopyAdjacency(BlenderArena &arena, const BlenderAdjacency &source, BlenderAdjacency &copy) {
+	copy = BlenderAdjacency();
+
+	if(source.IsValid()) {
+		copy.numLists = source.numLists;
+		copy.offsets = CopyArray(arena, source.offsets, source.numLists + 1);
+		copy.items = CopyArray(arena, source.items, source.offsets[source.numLists]);
+	}
+}
+
+// Everything is copied into the target's arena, attributes
+// included, so the copy outlives this mesh and its file
+void BlenderMesh::CopyTo(BlenderMesh &out) const {
+	out.ReleaseMesh();
+	BlenderArena &arena = out.m_Arena;
+
+	out.m_TotalVerts	= m_TotalVerts;
+	out.m_TotalEdges	= m_TotalEdges;
+	out.m_TotalLoops	= m_TotalLoops;
+	out.m_TotalPolygons	= m_TotalPolygons;
+	out.m_TotalFaces	= m_TotalFaces;
+	out.m_Name			= m_Name;
+	out.m_OldAddress	= m_OldAddress;
+
+	out.m_Vertices		= CopyArray(arena, m_Vertices, m_TotalVerts);
+	out.m_Edges			= CopyArray(arena, m_Edges, m_TotalEdges);
+	out.m_Loops			= CopyArray(arena, m_Loops, m_TotalLoops);
+	out.m_LoopUVs		= CopyArray(arena, m_LoopUVs, m_TotalLoops);
+	out.m_Polygons		= CopyArray(arena, m_Polygons, m_TotalPolygons);
+	out.m_TexPolygons	= CopyArray(arena, m_TexPolygons, m_TotalPolygons);
+	out.m_Faces			= CopyArray(arena, m_Faces, m_TotalFaces);
+	out.m_TexFaces		= CopyArray(arena, m_TexFaces, m_TotalFaces);
+	out.m_Triangulated	= m_Triangulated;
+
+	// One deform vertex per file vertex, their weights follow
+	// each other in the same order
+	size_t numWeights = 0;
+	for(int i=0; m_DeformVerts && i < m_TotalSourceVerts; i++) {
+		numWeights += m_DeformVerts[i].totWeight;
+	}
+
+	out.m_DeformVerts	= CopyArray(arena, m_DeformVerts, m_TotalSourceVerts);
+	out.m_DeformWeights	= CopyArray(arena, m_DeformWeights, numWeights);
+
+	out.m_TotalSubmeshes = m_TotalSubmeshes;
+	out.m_Submeshes		= CopyArray(arena, m_Submeshes, m_TotalSubmeshes);
+	out.m_TotalBVHNodes	= m_TotalBVHNodes;
+	out.m_BVHNodes		= CopyArray(arena, m_BVHNodes, m_TotalBVHNodes);
+	out.m_BVHFaces		= m_BVHNodes ? CopyArray(arena, m_BVHFaces, m_TotalFaces) : 0;
+
+	CopyAdjacency(arena, m_VertexFaces, out.m_VertexFaces);
+	CopyAdjacency(arena, m_VertexEdges, out.m_VertexEdges);
+	CopyAdjacency(arena, m_EdgeFaces, out.m_EdgeFaces);
+
+	out.m_Tangents		= CopyArray(arena, m_Tangents, m_TotalVerts);
+	out.m_TotalSourceVerts = m_TotalSourceVerts;
+	out.m_SourceVertices = CopyArray(arena, m_SourceVertices, m_TotalVerts);
+	out.m_Bounds		= m_Bounds;
+	out.m_Materials		= m_Materials;
+
+	out.m_LODs = m_LODs;
+	for(size_t i=0; i < out.m_LODs.size(); i++) {
+		out.m_LODs[i].faces = CopyArray(arena, m_LODs[i].faces, m_LODs[i].numFaces);
+	}
+
+	out.m_ShapeKeys = m_ShapeKeys;
+	for(size_t i=0; i < out.m_ShapeKeys.size(); i++) {
+		BlenderShapeKey &key = out.m_ShapeKeys[i];
+		key.indices = CopyArray(arena, m_ShapeKeys[i].indices, key.numDeltas);
+		key.deltas = CopyArray(arena, m_ShapeKeys[i].deltas, (size_t)key.numDeltas * 3);
+	}
+
+	out.m_Attributes = m_Attributes;
+	for(size_t i=0; i < out.m_Attributes.size(); i++) {
+		BlenderAttribute &attribute = out.m_Attributes[i];
+		attribute.data = CopyArray(arena, m_Attributes[i].data, (size_t)attribute.elementSize * attribute.count);
+	}
+}
+
+std::string BlenderMesh::GetMeshInfo() const {
 	char buffer[256];
 
 	sprintf_s(buffer, "Name: %s\nTotal Vertices: %d\nTotal Edges: %d\nTotal Faces: %d\nTotal Loops: %d\nTotal Polygons: %d\n",
@@ -32,112 +214,266 @@ std::string BlenderMesh::GetMeshInfo() {
 	return std::string(buffer);
 }
 
-bool BlenderMesh::LoadMesh(StructureDNA *sdna, std::vector<BlenderFileBlock> &blocks, bool triangulate, bool vertexUVs, bool flipYZ) {
-	BlenderFileBlock fBlock = blocks[0];
+static const BlenderFileBlock *FindGroupBlock(BlenderSpan<const BlenderFileBlock> blocks, const void *oldAddress) {
+	for(unsigned int i=0; oldAddress && i < blocks.size(); i++) {
+		if(blocks[i].m_Header.old_mem_address == oldAddress) {
+			return &blocks[i];
+		}
+	}
 
-	m_TotalVerts = fBlock.GetInt("totvert", sdna);
-	m_TotalEdges = fBlock.GetInt("totedge", sdna);
-	m_TotalFaces = fBlock.GetInt("totface", sdna);
-	m_TotalLoops = fBlock.GetInt("totloop", sdna);
-	m_TotalPolygons = fBlock.GetInt("totpoly", sdna);
+	return 0;
+}
+
+static const BlenderAttribute *FindLayer(const std::vector<BlenderAttribute> &layers, const char *name, BlenderAttributeDomain domain, int type, unsigned int elementSize) {
+	for(unsigned int i=0; i < layers.size(); i++) {
+		const BlenderAttribute &layer = layers[i];
+
+		if(layer.domain == domain && layer.type == type && layer.elementSize == elementSize && layer.name == name) {
+			return &layer;
+		}
+	}
+
+	return 0;
+}
+
+// Blender 4.x renamed the element counts, e.g. totvert to verts_num
+// A missing, non-int or negative count reads as no elements
+static int GetElementCount(const BlenderFileBlock &block, StructureDNA *sdna, const char *name, const char *modernName) {
+	BlenderFieldAccessor count(sdna, block.m_Header.sdna, name, sdna->pointer_size);
+	if(!count.IsValid()) {
+		count = BlenderFieldAccessor(sdna, block.m_Header.sdna, modernName, sdna->pointer_size);
+	}
+
+	int value = count.IsInt() ? count.GetInt(block) : 0;
+	return (value < 0) ? 0 : value;
+}
+
+bool BlenderMesh::LoadMesh(StructureDNA *sdna, BlenderSpan<const BlenderFileBlock> blocks, bool triangulate, bool vertexUVs, bool flipYZ, unsigned int extractFlags, bool copyAttributes) {
+	BLENDER_TRACE_SCOPE("BlenderMesh::LoadMesh");
+
+	const BlenderFileBlock &fBlock = blocks[0];
+
+	m_TotalVerts = GetElementCount(fBlock, sdna, "totvert", "verts_num");
+	m_TotalEdges = GetElementCount(fBlock, sdna, "totedge", "edges_num");
+	m_TotalFaces = GetElementCount(fBlock, sdna, "totface", "totface_legacy");
+	m_TotalLoops = GetElementCount(fBlock, sdna, "totloop", "corners_num");
+	m_TotalPolygons = GetElementCount(fBlock, sdna, "totpoly", "faces_num");
 
 	m_Name = fBlock.GetString("id.name[66]", sdna);
+	m_OldAddress = fBlock.m_Header.old_mem_address;
+
+	bool extractUVs = (extractFlags & BLENDER_EXTRACT_UVS) != 0;
+
+	std::vector<BlenderAttribute> layers;
+	CollectLayers(sdna, blocks, layers);
+
+	// Newer files have no MVert, MPoly or MLoop blocks and
+	// keep the same data in generic attribute arrays
+	m_Vertices		= ExtractVertices(sdna, blocks, flipYZ, (extractFlags & BLENDER_EXTRACT_NORMALS) != 0);
+	if(!m_Vertices)
+		m_Vertices	= ExtractPositions(layers, flipYZ);
 
-	m_Vertices		= ExtractVertices(sdna, blocks, flipYZ);
 	m_Faces			= ExtractFaces(sdna, blocks);
 	//m_TexFaces	= ExtractTexFaces(sdna, blocks);
-	m_DeformVerts	= ExtractDeformVerts(sdna, blocks);
-	m_DeformWeights = ExtractDeformWeights(sdna, blocks);
+
+	if(extractFlags & BLENDER_EXTRACT_EDGES) {
+		m_Edges		= ExtractEdges(sdna, blocks);
+		if(!m_Edges)
+			m_Edges	= ExtractEdgeAttribute(layers);
+	}
+
+	if(extractFlags & BLENDER_EXTRACT_DEFORM_WEIGHTS) {
+		m_DeformVerts	= ExtractDeformVerts(sdna, blocks);
+		m_DeformWeights = ExtractDeformWeights(sdna, blocks);
+	}
+
+	if(extractFlags & BLENDER_EXTRACT_ATTRIBUTES) {
+		ExtractAttributes(layers, copyAttributes);
+	}
 
 	// If there are no faces, than this is a
 	// newer blend file which uses MPolys and MLoops
 	if(m_Faces == 0) {
 		m_Loops		= ExtractLoops(sdna, blocks);
-		m_LoopUVs	= ExtractLoopUVs(sdna, blocks);
+		if(!m_Loops)
+			m_Loops	= ExtractCorners(layers);
+
 		m_Polygons	= ExtractPolys(sdna, blocks);
-		m_TexPolygons = ExtractTexPolys(sdna, blocks);
+		if(!m_Polygons)
+			m_Polygons = ExtractPolyOffsets(sdna, blocks, layers);
+
+		if(extractUVs) {
+			m_LoopUVs		= ExtractLoopUVs(sdna, blocks);
+			m_TexPolygons	= ExtractTexPolys(sdna, blocks);
+
+			if(!m_LoopUVs)
+				m_LoopUVs	= ExtractUVAttribute(layers);
+		}
+
+		if(!ValidateTopology()) {
+			BLENDER_LOG(BLENDER_TRACE_WARNING, "Mesh " << m_Name << " has no usable polygon data, skipped");
+			ReleaseMesh();
+
+			m_TotalVerts = 0;
+			m_TotalEdges = 0;
+			m_TotalFaces = 0;
+			m_TotalLoops = 0;
+			m_TotalPolygons = 0;
+			return false;
+		}
 
 		ConvertPolysToFaces();
 	}
 
+	m_TotalSourceVerts = m_Vertices ? m_TotalVerts : 0;
+
 	if(triangulate)
 		Triangulate();
 
-	if(vertexUVs)
+	m_Triangulated = triangulate;
+
+	if(vertexUVs && extractUVs)
 		UVsToVerts();
 
 	return true;
 }
 
+// Every array lives in the mesh arena,
+// so this is one walk over its chunks
 void BlenderMesh::ReleaseMesh() {
-	if(m_Vertices) {
-		delete[] m_Vertices;
-		m_Vertices=0;
-	}
+	m_Vertices = 0;
+	m_Edges = 0;
+	m_Loops = 0;
+	m_LoopUVs = 0;
+	m_Polygons = 0;
+	m_TexPolygons = 0;
+	m_Faces = 0;
+	m_TexFaces = 0;
+	m_DeformVerts = 0;
+	m_DeformWeights = 0;
+	m_Submeshes = 0;
+	m_TotalSubmeshes = 0;
+	m_BVHNodes = 0;
+	m_TotalBVHNodes = 0;
+	m_BVHFaces = 0;
+	m_VertexFaces = BlenderAdjacency();
+	m_VertexEdges = BlenderAdjacency();
+	m_EdgeFaces = BlenderAdjacency();
+	m_Tangents = 0;
+	m_TotalSourceVerts = 0;
+	m_SourceVertices = 0;
+	memset(&m_Bounds, 0, sizeof(m_Bounds));
+	m_LODs.clear();
+	m_ShapeKeys.clear();
+	m_Attributes.clear();
+	m_SharedAttributes = false;
+
+	m_Arena.Release();
+}
 
-	if(m_Loops) {
-		delete[] m_Loops;
-		m_Loops=0;
+static void BeginBounds(BlenderBounds &bounds) {
+	for(int a=0; a < 3; a++) {
+		bounds.min[a] = FLT_MAX;
+		bounds.max[a] = -FLT_MAX;
 	}
+}
 
-	if(m_LoopUVs) {
-		delete[] m_LoopUVs;
-		m_LoopUVs = 0;
+static inline void GrowBounds(BlenderBounds &bounds, const float co[3]) {
+	for(int a=0; a < 3; a++) {
+		bounds.min[a] = co[a] < bounds.min[a] ? co[a] : bounds.min[a];
+		bounds.max[a] = co[a] > bounds.max[a] ? co[a] : bounds.max[a];
 	}
+}
 
-	if(m_Polygons) {
-		delete[] m_Polygons;
-		m_Polygons = 0;
-	}
+// Bounds of count packed float3 values. The SSE2 loop loads four
+// floats per point and ignores the fourth lane, so the last point,
+// which has nothing after it, goes through GrowBounds. A NaN is
+// skipped the same way GrowBounds skips it.
+static void GrowBoundsPacked(BlenderBounds &bounds, const float *co, int count) {
+	int k = 0;
+
+#ifdef BLENDER_SSE2
+	if(count > 1) {
+		__m128 lo = _mm_set1_ps(FLT_MAX);
+		__m128 hi = _mm_set1_ps(-FLT_MAX);
+
+		for(; k < count - 1; k++) {
+			__m128 point = _mm_loadu_ps(co + 3 * k);
+			lo = _mm_min_ps(point, lo);
+			hi = _mm_max_ps(point, hi);
+		}
 
-	if(m_TexPolygons) {
-		delete[] m_TexPolygons;
-		m_TexPolygons = 0;
-	}
+		float lanes[2][4];
+		_mm_storeu_ps(lanes[0], lo);
+		_mm_storeu_ps(lanes[1], hi);
 
-	if(m_Faces) {
-		delete[] m_Faces;
-		m_Faces=0;
+		for(int a=0; a < 3; a++) {
+			bounds.min[a] = lanes[0][a] < bounds.min[a] ? lanes[0][a] : bounds.min[a];
+			bounds.max[a] = lanes[1][a] > bounds.max[a] ? lanes[1][a] : bounds.max[a];
+		}
 	}
+#endif
 
-	if(m_TexFaces) {
-		delete[] m_TexFaces;
-		m_TexFaces=0;
+	for(; k < count; k++) {
+		GrowBounds(bounds, co + 3 * k);
 	}
+}
 
-	if(m_DeformVerts) {
-		delete[] m_DeformVerts;
-		m_DeformVerts = 0;
+static void EndBounds(BlenderBounds &bounds, int count) {
+	if(count <= 0) {
+		memset(&bounds, 0, sizeof(bounds));
+		return;
 	}
 
-	if(m_DeformWeights) {
-		delete[] m_DeformWeights;
-		m_DeformWeights = 0;
+	float radius = 0.0f;
+	for(int a=0; a < 3; a++) {
+		float half = 0.5f * (bounds.max[a] - bounds.min[a]);
+		bounds.center[a] = bounds.min[a] + half;
+		radius += half * half;
 	}
+
+	bounds.radius = sqrtf(radius);
 }
 
-MVert *BlenderMesh::ExtractVertices(StructureDNA *sdna, std::vector<BlenderFileBlock> &blocks, bool flipYZ) {
+MVert *BlenderMesh::ExtractVertices(StructureDNA *sdna, BlenderSpan<const BlenderFileBlock> blocks, bool flipYZ, bool normals) {
+	BLENDER_TRACE_SCOPE("BlenderMesh::ExtractVertices");
+
 	Structure *mVert = sdna->GetStructureByType("MVert");
+	if(!mVert) {
+		BLENDER_LOG(BLENDER_TRACE_DEBUG, "No MVert Structure!");
+		return 0;
+	}
+
 	unsigned int length = sdna->lengths[mVert->type_idx];
 
 	for (unsigned int i=0; i < blocks.size(); i++) {
-		BlenderFileBlock fBlock = blocks[i];
+		const BlenderFileBlock &fBlock = blocks[i];
 
 		// Get block structure
 		unsigned int type_idx = sdna->GetStructureFromBlock(&fBlock)->type_idx;
-		std::string blockStructureName = sdna->GetType(type_idx);
+		const std::string &blockStructureName = sdna->GetType(type_idx);
 		
 		// Check if we have found the vertices block
 		if (strcmp("MVert", blockStructureName.c_str()) == 0) {
-			std::cout << "MVert Block Found!\n";
+			BLENDER_LOG(BLENDER_TRACE_DEBUG, "MVert Block Found!");
 
 			unsigned int count = blocks[i].m_Header.count;
-			MVert *vertices = new MVert[count];
-			
+
 			// Retrieve the member offsets for this structure
 			// for the fields we are interested in
 			int offset_co = blocks[i].GetMemberOffset("co[3]", sdna);
 			int offset_no = blocks[i].GetMemberOffset("no[3]", sdna);
+
+			if(offset_co == -1 || count < (unsigned int)m_TotalVerts) {
+				BLENDER_LOG(BLENDER_TRACE_WARNING, "MVert Block does not match the mesh!");
+				return 0;
+			}
+
+			MVert *vertices = m_Arena.AllocateArray<MVert>(count);
+			BLENDER_TRACE_COUNT(BLENDER_COUNTER_VERTICES, count);
+
+			BlenderBounds bounds;
+			BeginBounds(bounds);
 			
 			// Iterate and retreive the data
 			for (unsigned int k=0; k < count; k++) {
@@ -151,13 +487,20 @@ MVert *BlenderMesh::ExtractVertices(StructureDNA *sdna, std::vector<BlenderFileB
 					vertices[k].co[2] = blocks[i].GetFloat(offset_co+8, k, length);
 				}
 
-				vertices[k].no[0] = blocks[i].GetShort(offset_no, k, length);
+				GrowBounds(bounds, vertices[k].co);
 
-				if(flipYZ) {
+				if(!normals || offset_no == -1) {
+					vertices[k].no[0] = 0;
+					vertices[k].no[1] = 0;
+					vertices[k].no[2] = 0;
+				}
+				else if(flipYZ) {
+					vertices[k].no[0] = blocks[i].GetShort(offset_no, k, length);
 					vertices[k].no[2] = -blocks[i].GetShort(offset_no+2, k, length);
 					vertices[k].no[1] = blocks[i].GetShort(offset_no+4, k, length);
 				}
 				else {
+					vertices[k].no[0] = blocks[i].GetShort(offset_no, k, length);
 					vertices[k].no[1] = blocks[i].GetShort(offset_no+2, k, length);
 					vertices[k].no[2] = blocks[i].GetShort(offset_no+4, k, length);
 				}
@@ -168,104 +511,502 @@ MVert *BlenderMesh::ExtractVertices(StructureDNA *sdna, std::vector<BlenderFileB
 				vertices[k].uv[1] = 0.0f;
 			}
 
+			EndBounds(bounds, count);
+			m_Bounds = bounds;
+
 			return vertices;
 		}
 	}
 
-	std::cout << "No MVert Block Found!\n";
+	BLENDER_LOG(BLENDER_TRACE_DEBUG, "No MVert Block Found!");
 	return 0;
 }
 
-MFace *BlenderMesh::ExtractFaces(StructureDNA *sdna, std::vector<BlenderFileBlock> &blocks) {
-	Structure *mFace = sdna->GetStructureByType("MFace");
-	unsigned int length = sdna->lengths[mFace->type_idx];
+MFace *BlenderMesh::ExtractFaces(StructureDNA *sdna, BlenderSpan<const BlenderFileBlock> blocks) {
+	BLENDER_TRACE_SCOPE("BlenderMesh::ExtractFaces");
 
-	std::cout << "\nFace structure: " << sdna->GetType(mFace->type_idx) << "\n\n";
+	Structure *mFace = sdna->GetStructureByType("MFace");
+	if(!mFace) {
+		BLENDER_LOG(BLENDER_TRACE_DEBUG, "No MFace Structure!");
+		return 0;
+	}
 
 	for (unsigned int i=0; i < blocks.size(); i++) {
-		BlenderFileBlock fBlock = blocks[i];
+		const BlenderFileBlock &fBlock = blocks[i];
 
 		Structure *s = sdna->GetStructureFromBlock(&fBlock);
 		unsigned int type_idx = s->type_idx;
-		std::string blockStructureName = sdna->GetType(type_idx);
-
-		if(type_idx != 95) {
-			std::cout << "Block Structure ID: " << type_idx << ", Name: " << blockStructureName << "\n";
-			for(unsigned int j=0; j < s->fields.size(); j++) {
-				std::string name = sdna->GetName(s->fields[j].name_idx);
-				std::string type = sdna->GetType(s->fields[j].type_idx);
-				std::cout << "\t" << s->fields[j].offset << ": " << name << "(" << type << ")\n";
-			}
+		const std::string &blockStructureName = sdna->GetType(type_idx);
 
-			std::cout << "\n\tCount: " << fBlock.m_Header.count << "\n\n";
-		}
-		
 		if (strcmp("MFace", blockStructureName.c_str()) == 0) {
-			std::cout << "MFace Block Found!\n";
+			BLENDER_LOG(BLENDER_TRACE_DEBUG, "MFace Block Found!");
 
 			// NOT IMPLEMENTED FOR NOW
 			// MFace used in old versions of blender
 		}
 	}
 
-	std::cout << "No MFace Block Found!\n";
+	BLENDER_LOG(BLENDER_TRACE_DEBUG, "No MFace Block Found!");
+	return 0;
+}
+
+MEdge *BlenderMesh::ExtractEdges(StructureDNA *sdna, BlenderSpan<const BlenderFileBlock> blocks) {
+	BLENDER_TRACE_SCOPE("BlenderMesh::ExtractEdges");
+
+	Structure *mEdge = sdna->GetStructureByType("MEdge");
+	if(!mEdge) {
+		BLENDER_LOG(BLENDER_TRACE_DEBUG, "No MEdge Structure!");
+		return 0;
+	}
+
+	unsigned int length = sdna->lengths[mEdge->type_idx];
+
+	for (unsigned int i=0; i < blocks.size(); i++) {
+		const BlenderFileBlock &fBlock = blocks[i];
+
+		Structure *s = sdna->GetStructureFromBlock(&fBlock);
+		unsigned int type_idx = s->type_idx;
+		const std::string &blockStructureName = sdna->GetType(type_idx);
+
+		if (strcmp("MEdge", blockStructureName.c_str()) == 0) {
+			BLENDER_LOG(BLENDER_TRACE_DEBUG, "MEdge Block Found!");
+
+			unsigned int count = blocks[i].m_Header.count;
+			int offset_v1 = blocks[i].GetMemberOffset("v1", sdna);
+			int offset_v2 = blocks[i].GetMemberOffset("v2", sdna);
+			int offset_flag = blocks[i].GetMemberOffset("flag", sdna);
+
+			if(offset_v1 == -1 || offset_v2 == -1) {
+				BLENDER_LOG(BLENDER_TRACE_WARNING, "MEdge Block does not match the mesh!");
+				return 0;
+			}
+
+			MEdge *edges = m_Arena.AllocateArray<MEdge>(count);
+
+			// Crease and bevel weight became attributes in 3.x
+			int offset_crease = blocks[i].GetMemberOffset("crease", sdna);
+			int offset_bweight = blocks[i].GetMemberOffset("bweight", sdna);
+
+			for (unsigned int k=0; k < count; k++) {
+				edges[k].v1 = blocks[i].GetInt(offset_v1, k, length);
+				edges[k].v2 = blocks[i].GetInt(offset_v2, k, length);
+				edges[k].flag = (offset_flag != -1) ? blocks[i].GetShort(offset_flag, k, length) : 0;
+				edges[k].crease = (offset_crease != -1) ? blocks[i].GetChar(offset_crease, k, length) : 0;
+				edges[k].bweight = (offset_bweight != -1) ? blocks[i].GetChar(offset_bweight, k, length) : 0;
+			}
+
+			m_TotalEdges = count;
+			return edges;
+		}
+	}
+
+	BLENDER_LOG(BLENDER_TRACE_DEBUG, "No MEdge Block Found!");
 	return 0;
 }
 
-MLoop *BlenderMesh::ExtractLoops(StructureDNA *sdna, std::vector<BlenderFileBlock> &blocks) {
+MLoop *BlenderMesh::ExtractLoops(StructureDNA *sdna, BlenderSpan<const BlenderFileBlock> blocks) {
+	BLENDER_TRACE_SCOPE("BlenderMesh::ExtractLoops");
+
 	Structure *mLoop = sdna->GetStructureByType("MLoop");
-	unsigned int length = sdna->lengths[mLoop->type_idx];
+	if(!mLoop) {
+		BLENDER_LOG(BLENDER_TRACE_DEBUG, "No MLoop Structure!");
+		return 0;
+	}
 
-	std::cout << "\nLoop structure: " << sdna->GetType(mLoop->type_idx) << "\n";
+	unsigned int length = sdna->lengths[mLoop->type_idx];
 
 	for (unsigned int i=0; i < blocks.size(); i++) {
-		BlenderFileBlock fBlock = blocks[i];
+		const BlenderFileBlock &fBlock = blocks[i];
 
 		Structure *s = sdna->GetStructureFromBlock(&fBlock);
 		unsigned int type_idx = s->type_idx;
-		std::string blockStructureName = sdna->GetType(type_idx);
+		const std::string &blockStructureName = sdna->GetType(type_idx);
 		
 		if (strcmp("MLoop", blockStructureName.c_str()) == 0) {
-			std::cout << "MLoop Block Found!\n";
+			BLENDER_LOG(BLENDER_TRACE_DEBUG, "MLoop Block Found!");
 
 			unsigned int count = blocks[i].m_Header.count;
-			MLoop *loops = new MLoop[count];
 			int offset_v = blocks[i].GetMemberOffset("v", sdna);
 			int offset_e = blocks[i].GetMemberOffset("e", sdna);
 
+			if(offset_v == -1 || count < (unsigned int)m_TotalLoops) {
+				BLENDER_LOG(BLENDER_TRACE_WARNING, "MLoop Block does not match the mesh!");
+				return 0;
+			}
+
+			MLoop *loops = m_Arena.AllocateArray<MLoop>(count);
+
 			for (unsigned int k=0; k < count; k++) {
 				loops[k].v = blocks[i].GetInt(offset_v, k, length);
-				loops[k].e = blocks[i].GetInt(offset_e, k, length);
+				loops[k].e = (offset_e != -1) ? blocks[i].GetInt(offset_e, k, length) : ~0u;
 			}
 
 			return loops;
 		}
 	}
 
-	std::cout << "No MLoop Block Found!\n";
+	BLENDER_LOG(BLENDER_TRACE_DEBUG, "No MLoop Block Found!");
+	return 0;
+}
+
+// Walks the layer array of each CustomData on the Mesh. The
+// element size comes from the payload size, so raw attribute
+// arrays and struct layers like MLoopUV are read the same way.
+// The layers point into the block payloads.
+void BlenderMesh::CollectLayers(StructureDNA *sdna, BlenderSpan<const BlenderFileBlock> blocks, std::vector<BlenderAttribute> &found) {
+	BLENDER_TRACE_SCOPE("BlenderMesh::CollectLayers");
+
+	static const struct {
+		const char *name;
+		const char *count;
+		const char *modernName;		// Blender 4.x
+		const char *modernCount;
+		BlenderAttributeDomain domain;
+	} s_CustomData[] = {
+		{ "vdata", "totvert", "vert_data", "verts_num", BLENDER_DOMAIN_POINT },
+		{ "edata", "totedge", "edge_data", "edges_num", BLENDER_DOMAIN_EDGE },
+		{ "fdata", "totface", "fdata_legacy", "totface_legacy", BLENDER_DOMAIN_TESSFACE },
+		{ "pdata", "totpoly", "face_data", "faces_num", BLENDER_DOMAIN_FACE },
+		{ "ldata", "totloop", "corner_data", "corners_num", BLENDER_DOMAIN_CORNER }
+	};
+
+	int layerStruct = sdna->GetStructureIndex("CustomDataLayer");
+	if(layerStruct == -1) {
+		return;
+	}
+
+	BlenderFieldAccessor layerType(sdna, layerStruct, "type", sdna->pointer_size);
+	BlenderFieldAccessor layerName(sdna, layerStruct, "name", sdna->pointer_size);
+	BlenderFieldAccessor layerData(sdna, layerStruct, "data", sdna->pointer_size);
+
+	if(!layerType.IsInt() || !layerName.IsString() || !layerData.IsPointer()) {
+		return;
+	}
+
+	const BlenderFileBlock &meshBlock = blocks[0];
+
+	for(unsigned int d=0; d < sizeof(s_CustomData) / sizeof(s_CustomData[0]); d++) {
+		std::string name = s_CustomData[d].name;
+		std::string count = s_CustomData[d].count;
+
+		if(!BlenderFieldAccessor(sdna, meshBlock.m_Header.sdna, name + ".layers", sdna->pointer_size).IsValid()) {
+			name = s_CustomData[d].modernName;
+			count = s_CustomData[d].modernCount;
+		}
+
+		BlenderFieldAccessor layers(sdna, meshBlock.m_Header.sdna, name + ".layers", sdna->pointer_size);
+		BlenderFieldAccessor totlayer(sdna, meshBlock.m_Header.sdna, name + ".totlayer", sdna->pointer_size);
+		BlenderFieldAccessor total(sdna, meshBlock.m_Header.sdna, count, sdna->pointer_size);
+
+		if(!layers.IsPointer() || !totlayer.IsInt() || !total.IsInt()) {
+			continue;
+		}
+
+		const BlenderFileBlock *layerBlock = FindGroupBlock(blocks, layers.GetPointer(meshBlock));
+		int numElements = total.GetInt(meshBlock);
+
+		if(!layerBlock || (int)layerBlock->m_Header.sdna != layerStruct || numElements <= 0) {
+			continue;
+		}
+
+		int numLayers = totlayer.GetInt(meshBlock);
+		if(numLayers > (int)layerBlock->m_Header.count) {
+			numLayers = (int)layerBlock->m_Header.count;
+		}
+
+		for(int k=0; k < numLayers; k++) {
+			const BlenderFileBlock *dataBlock = FindGroupBlock(blocks, layerData.GetPointer(*layerBlock, k));
+
+			if(!dataBlock || dataBlock->m_Header.size < (unsigned int)numElements) {
+				continue;
+			}
+
+			BlenderAttribute layer;
+			layer.name = layerName.GetString(*layerBlock, k);
+			layer.type = layerType.GetInt(*layerBlock, k);
+			layer.domain = s_CustomData[d].domain;
+			layer.elementSize = dataBlock->m_Header.size / numElements;
+			layer.count = (unsigned int)numElements;
+			layer.data = dataBlock->GetBuffer();
+
+			found.push_back(layer);
+		}
+	}
+}
+
+void BlenderMesh::ExtractAttributes(const std::vector<BlenderAttribute> &layers, bool copy) {
+	BLENDER_TRACE_SCOPE("BlenderMesh::ExtractAttributes");
+
+	m_Attributes = layers;
+	m_SharedAttributes = true;
+
+	if(copy) {
+		CopyAttributes();
+	}
+}
+
+void BlenderMesh::CopyAttributes() {
+	for(unsigned int i=0; m_SharedAttributes && i < m_Attributes.size(); i++) {
+		BlenderAttribute &attribute = m_Attributes[i];
+		attribute.data = CopyArray(m_Arena, attribute.data, (size_t)attribute.elementSize * attribute.count);
+	}
+
+	m_SharedAttributes = false;
+}
+
+// Blender 3.x/4.x store positions as a float3 "position"
+// attribute instead of MVert structs. The layer is one
+// contiguous array, so no per-field decoding is needed.
+MVert *BlenderMesh::ExtractPositions(const std::vector<BlenderAttribute> &layers, bool flipYZ) {
+	BLENDER_TRACE_SCOPE("BlenderMesh::ExtractPositions");
+
+	const BlenderAttribute *position = FindLayer(layers, "position", BLENDER_DOMAIN_POINT, BLENDER_CD_PROP_FLOAT3, sizeof(float[3]));
+	if(!position || (int)position->count < m_TotalVerts) {
+		BLENDER_LOG(BLENDER_TRACE_DEBUG, "No position Attribute Found!");
+		return 0;
+	}
+
+	BLENDER_LOG(BLENDER_TRACE_DEBUG, "position Attribute Found!");
+
+	MVert *vertices = m_Arena.AllocateArray<MVert>(m_TotalVerts);
+	memset(vertices, 0, m_TotalVerts * sizeof(MVert));
+	BLENDER_TRACE_COUNT(BLENDER_COUNTER_VERTICES, m_TotalVerts);
+
+	BlenderSpan<const float[3]> positions = position->GetSpan<float[3]>();
+	BlenderBounds bounds;
+	BeginBounds(bounds);
+	GrowBoundsPacked(bounds, (const float *)positions.data(), m_TotalVerts);
+
+	if(flipYZ) {
+		float minY = bounds.min[1];
+		float maxY = bounds.max[1];
+		bounds.min[1] = bounds.min[2];
+		bounds.max[1] = bounds.max[2];
+		bounds.min[2] = -maxY;
+		bounds.max[2] = -minY;
+	}
+
+	// Without the flip a position has the layout of MVert::co
+	for(int k=0; k < m_TotalVerts; k++) {
+		if(flipYZ) {
+			vertices[k].co[0] = positions[k][0];
+			vertices[k].co[1] = positions[k][2];
+			vertices[k].co[2] = -positions[k][1];
+		}
+		else {
+			memcpy(vertices[k].co, positions[k], sizeof(vertices[k].co));
+		}
+
+		vertices[k].nextSupplVert = -1;
+	}
+
+	EndBounds(bounds, m_TotalVerts);
+	m_Bounds = bounds;
+
+	return vertices;
+}
+
+// Corners are split into ".corner_vert" and ".corner_edge"
+// int attributes, the edge layer is optional and corners
+// without it get an invalid edge
+MLoop *BlenderMesh::ExtractCorners(const std::vector<BlenderAttribute> &layers) {
+	BLENDER_TRACE_SCOPE("BlenderMesh::ExtractCorners");
+
+	const BlenderAttribute *cornerVert = FindLayer(layers, ".corner_vert", BLENDER_DOMAIN_CORNER, BLENDER_CD_PROP_INT32, sizeof(int));
+	const BlenderAttribute *cornerEdge = FindLayer(layers, ".corner_edge", BLENDER_DOMAIN_CORNER, BLENDER_CD_PROP_INT32, sizeof(int));
+
+	if(!cornerVert || (int)cornerVert->count < m_TotalLoops) {
+		BLENDER_LOG(BLENDER_TRACE_DEBUG, "No .corner_vert Attribute Found!");
+		return 0;
+	}
+
+	BLENDER_LOG(BLENDER_TRACE_DEBUG, ".corner_vert Attribute Found!");
+
+	if(cornerEdge && (int)cornerEdge->count < m_TotalLoops) {
+		cornerEdge = 0;
+	}
+
+	MLoop *loops = m_Arena.AllocateArray<MLoop>(m_TotalLoops);
+	BlenderSpan<const int> verts = cornerVert->GetSpan<int>();
+
+	for(int k=0; k < m_TotalLoops; k++) {
+		loops[k].v = verts[k];
+		loops[k].e = ~0u;
+	}
+
+	if(cornerEdge) {
+		BlenderSpan<const int> edges = cornerEdge->GetSpan<int>();
+
+		for(int k=0; k < m_TotalLoops; k++) {
+			loops[k].e = edges[k];
+		}
+	}
+
+	return loops;
+}
+
+// Polygons are an int array of totpoly+1 loop offsets, pointed
+// to by the Mesh, with the material in a "material_index"
+// attribute when any polygon uses one
+MPoly *BlenderMesh::ExtractPolyOffsets(StructureDNA *sdna, BlenderSpan<const BlenderFileBlock> blocks, const std::vector<BlenderAttribute> &layers) {
+	BLENDER_TRACE_SCOPE("BlenderMesh::ExtractPolyOffsets");
+
+	const BlenderFileBlock &meshBlock = blocks[0];
+
+	BlenderFieldAccessor offsetField(sdna, meshBlock.m_Header.sdna, "poly_offset_indices", sdna->pointer_size);
+	if(!offsetField.IsValid()) {
+		offsetField = BlenderFieldAccessor(sdna, meshBlock.m_Header.sdna, "face_offset_indices", sdna->pointer_size);
+	}
+
+	const BlenderFileBlock *offsetBlock = offsetField.IsPointer() ? FindGroupBlock(blocks, offsetField.GetPointer(meshBlock)) : 0;
+
+	if(!offsetBlock || m_TotalPolygons <= 0 || offsetBlock->m_Header.size < ((size_t)m_TotalPolygons + 1) * sizeof(int)) {
+		BLENDER_LOG(BLENDER_TRACE_DEBUG, "No Polygon Offsets Found!");
+		return 0;
+	}
+
+	BLENDER_LOG(BLENDER_TRACE_DEBUG, "Polygon Offsets Found!");
+
+	BlenderSpan<const int> offsets((const int *)offsetBlock->GetBuffer(), (size_t)m_TotalPolygons + 1);
+
+	// Sizes are differences of neighbours, so the offsets
+	// have to rise within the loops before any is taken
+	if(offsets[0] < 0 || offsets[m_TotalPolygons] > m_TotalLoops) {
+		BLENDER_LOG(BLENDER_TRACE_WARNING, "Mesh " << m_Name << " has polygon offsets outside its loops");
+		return 0;
+	}
+
+	for(int k=0; k < m_TotalPolygons; k++) {
+		if(offsets[k+1] < offsets[k]) {
+			BLENDER_LOG(BLENDER_TRACE_WARNING, "Mesh " << m_Name << " has decreasing polygon offsets");
+			return 0;
+		}
+	}
+
+	const BlenderAttribute *material = FindLayer(layers, "material_index", BLENDER_DOMAIN_FACE, BLENDER_CD_PROP_INT32, sizeof(int));
+	if(material && (int)material->count < m_TotalPolygons) {
+		material = 0;
+	}
+
+	MPoly *polys = m_Arena.AllocateArray<MPoly>(m_TotalPolygons);
+
+	for(int k=0; k < m_TotalPolygons; k++) {
+		polys[k].loopstart = offsets[k];
+		polys[k].totloop = offsets[k+1] - offsets[k];
+		polys[k].mat_nr = 0;
+		polys[k].flag = 0;
+		polys[k].pad = 0;
+	}
+
+	if(material) {
+		BlenderSpan<const int> materials = material->GetSpan<int>();
+
+		for(int k=0; k < m_TotalPolygons; k++) {
+			polys[k].mat_nr = (short)materials[k];
+		}
+	}
+
+	return polys;
+}
+
+// Since Blender 3.5 UV maps are float2 corner attributes,
+// the first one that is not internal (a "." prefix) is used
+MLoopUV *BlenderMesh::ExtractUVAttribute(const std::vector<BlenderAttribute> &layers) {
+	BLENDER_TRACE_SCOPE("BlenderMesh::ExtractUVAttribute");
+
+	for(unsigned int i=0; i < layers.size(); i++) {
+		const BlenderAttribute &layer = layers[i];
+
+		if(layer.domain != BLENDER_DOMAIN_CORNER || layer.type != BLENDER_CD_PROP_FLOAT2 ||
+			layer.elementSize != sizeof(float[2]) || layer.name[0] == '.' || (int)layer.count < m_TotalLoops) {
+			continue;
+		}
+
+		BLENDER_LOG(BLENDER_TRACE_DEBUG, "UV Attribute Found!");
+
+		MLoopUV *loopUVs = m_Arena.AllocateArray<MLoopUV>(m_TotalLoops);
+		BlenderSpan<const float[2]> uvs = layer.GetSpan<float[2]>();
+
+		for(int k=0; k < m_TotalLoops; k++) {
+			memcpy(loopUVs[k].uv, uvs[k], sizeof(loopUVs[k].uv));
+			loopUVs[k].flag = 0;
+		}
+
+		return loopUVs;
+	}
+
+	BLENDER_LOG(BLENDER_TRACE_DEBUG, "No UV Attribute Found!");
+	return 0;
+}
+
+// Since Blender 3.6 edges are an int2 ".edge_verts" attribute
+MEdge *BlenderMesh::ExtractEdgeAttribute(const std::vector<BlenderAttribute> &layers) {
+	BLENDER_TRACE_SCOPE("BlenderMesh::ExtractEdgeAttribute");
+
+	const BlenderAttribute *edgeVerts = FindLayer(layers, ".edge_verts", BLENDER_DOMAIN_EDGE, BLENDER_CD_PROP_INT32_2D, sizeof(int[2]));
+
+	if(!edgeVerts || (int)edgeVerts->count < m_TotalEdges) {
+		BLENDER_LOG(BLENDER_TRACE_DEBUG, "No .edge_verts Attribute Found!");
+		return 0;
+	}
+
+	BLENDER_LOG(BLENDER_TRACE_DEBUG, ".edge_verts Attribute Found!");
+
+	MEdge *edges = m_Arena.AllocateArray<MEdge>(m_TotalEdges);
+	BlenderSpan<const int[2]> verts = edgeVerts->GetSpan<int[2]>();
+
+	for(int k=0; k < m_TotalEdges; k++) {
+		edges[k].v1 = verts[k][0];
+		edges[k].v2 = verts[k][1];
+		edges[k].crease = 0;
+		edges[k].bweight = 0;
+		edges[k].flag = 0;
+	}
+
+	return edges;
+}
+
+const BlenderAttribute *BlenderMesh::FindAttribute(const std::string &name, BlenderAttributeDomain domain) const {
+	for(unsigned int i=0; i < m_Attributes.size(); i++) {
+		if(m_Attributes[i].domain == domain && m_Attributes[i].name == name) {
+			return &m_Attributes[i];
+		}
+	}
+
 	return 0;
 }
 
-MLoopUV *BlenderMesh::ExtractLoopUVs(StructureDNA *sdna, std::vector<BlenderFileBlock> &blocks) {
+MLoopUV *BlenderMesh::ExtractLoopUVs(StructureDNA *sdna, BlenderSpan<const BlenderFileBlock> blocks) {
+	BLENDER_TRACE_SCOPE("BlenderMesh::ExtractLoopUVs");
+
 	Structure *mLoopUV = sdna->GetStructureByType("MLoopUV");
-	unsigned int length = sdna->lengths[mLoopUV->type_idx];
+	if(!mLoopUV) {
+		BLENDER_LOG(BLENDER_TRACE_DEBUG, "No MLoopUV Structure!");
+		return 0;
+	}
 
-	std::cout << "\nLoopUV structure: " << sdna->GetType(mLoopUV->type_idx) << "\n";
+	unsigned int length = sdna->lengths[mLoopUV->type_idx];
 
 	for (unsigned int i=0; i < blocks.size(); i++) {
-		BlenderFileBlock fBlock = blocks[i];
+		const BlenderFileBlock &fBlock = blocks[i];
 
 		Structure *s = sdna->GetStructureFromBlock(&fBlock);
 		unsigned int type_idx = s->type_idx;
-		std::string blockStructureName = sdna->GetType(type_idx);
+		const std::string &blockStructureName = sdna->GetType(type_idx);
 		
 		if (strcmp("MLoopUV", blockStructureName.c_str()) == 0) {
-			std::cout << "MLoopUV Block Found!\n";
+			BLENDER_LOG(BLENDER_TRACE_DEBUG, "MLoopUV Block Found!");
 
 			unsigned int count = blocks[i].m_Header.count;
-			MLoopUV *loops = new MLoopUV[count];
 			int offset_uv = blocks[i].GetMemberOffset("uv[2]", sdna);
 
+			if(offset_uv == -1 || count < (unsigned int)m_TotalLoops) {
+				BLENDER_LOG(BLENDER_TRACE_WARNING, "MLoopUV Block does not match the mesh!");
+				return 0;
+			}
+
+			MLoopUV *loops = m_Arena.AllocateArray<MLoopUV>(count);
+
 			for (unsigned int k=0; k < count; k++) {
 				loops[k].uv[0] = blocks[i].GetFloat(offset_uv, k, length);
 				loops[k].uv[1] = blocks[i].GetFloat(offset_uv+4, k, length);
@@ -275,64 +1016,85 @@ MLoopUV *BlenderMesh::ExtractLoopUVs(StructureDNA *sdna, std::vector<BlenderFile
 		}
 	}
 
-	std::cout << "No MLoopUV Block Found!\n";
+	BLENDER_LOG(BLENDER_TRACE_DEBUG, "No MLoopUV Block Found!");
 	return 0;
 }
 
-MPoly *BlenderMesh::ExtractPolys(StructureDNA *sdna, std::vector<BlenderFileBlock> &blocks) {
+MPoly *BlenderMesh::ExtractPolys(StructureDNA *sdna, BlenderSpan<const BlenderFileBlock> blocks) {
+	BLENDER_TRACE_SCOPE("BlenderMesh::ExtractPolys");
+
 	Structure *mPoly = sdna->GetStructureByType("MPoly");
-	unsigned int length = sdna->lengths[mPoly->type_idx];
+	if(!mPoly) {
+		BLENDER_LOG(BLENDER_TRACE_DEBUG, "No MPoly Structure!");
+		return 0;
+	}
 
-	std::cout << "\nPolygon structure: " << sdna->GetType(mPoly->type_idx) << "\n";
+	unsigned int length = sdna->lengths[mPoly->type_idx];
 
 	for (unsigned int i=0; i < blocks.size(); i++) {
-		BlenderFileBlock fBlock = blocks[i];
+		const BlenderFileBlock &fBlock = blocks[i];
 
 		Structure *s = sdna->GetStructureFromBlock(&fBlock);
 		unsigned int type_idx = s->type_idx;
-		std::string blockStructureName = sdna->GetType(type_idx);
+		const std::string &blockStructureName = sdna->GetType(type_idx);
 		
 		if (strcmp("MPoly", blockStructureName.c_str()) == 0) {
-			std::cout << "MPoly Block Found!\n";
+			BLENDER_LOG(BLENDER_TRACE_DEBUG, "MPoly Block Found!");
 
 			unsigned int count = blocks[i].m_Header.count;
-			MPoly *polys = new MPoly[count];
 			int offset_loopstart = blocks[i].GetMemberOffset("loopstart", sdna);
 			int offset_totloop = blocks[i].GetMemberOffset("totloop", sdna);
 			int offset_mat_nr = blocks[i].GetMemberOffset("mat_nr", sdna);
 
+			if(offset_loopstart == -1 || offset_totloop == -1 || count < (unsigned int)m_TotalPolygons) {
+				BLENDER_LOG(BLENDER_TRACE_WARNING, "MPoly Block does not match the mesh!");
+				return 0;
+			}
+
+			MPoly *polys = m_Arena.AllocateArray<MPoly>(count);
+
 			for (unsigned int k=0; k < count; k++) {
 				polys[k].loopstart = blocks[i].GetInt(offset_loopstart, k, length);
 				polys[k].totloop = blocks[i].GetInt(offset_totloop, k, length);
-				polys[k].mat_nr = blocks[i].GetShort(offset_mat_nr, k, length);
+				polys[k].mat_nr = (offset_mat_nr != -1) ? blocks[i].GetShort(offset_mat_nr, k, length) : 0;
 			}
 
 			return polys;
 		}
 	}
 
-	std::cout << "No MPoly Block Found!\n";
+	BLENDER_LOG(BLENDER_TRACE_DEBUG, "No MPoly Block Found!");
 	return 0;
 }
 
-MTexPoly *BlenderMesh::ExtractTexPolys(StructureDNA *sdna, std::vector<BlenderFileBlock> &blocks) {
+MTexPoly *BlenderMesh::ExtractTexPolys(StructureDNA *sdna, BlenderSpan<const BlenderFileBlock> blocks) {
+	BLENDER_TRACE_SCOPE("BlenderMesh::ExtractTexPolys");
+
 	Structure *mTexPoly = sdna->GetStructureByType("MTexPoly");
-	unsigned int length = sdna->lengths[mTexPoly->type_idx];
+	if(!mTexPoly) {
+		BLENDER_LOG(BLENDER_TRACE_DEBUG, "No MTexPoly Structure!");
+		return 0;
+	}
 
-	std::cout << "\nTexPolygon structure: " << sdna->GetType(mTexPoly->type_idx) << "\n";
+	unsigned int length = sdna->lengths[mTexPoly->type_idx];
 
 	for (unsigned int i=0; i < blocks.size(); i++) {
-		BlenderFileBlock fBlock = blocks[i];
+		const BlenderFileBlock &fBlock = blocks[i];
 
 		Structure *s = sdna->GetStructureFromBlock(&fBlock);
 		unsigned int type_idx = s->type_idx;
-		std::string blockStructureName = sdna->GetType(type_idx);
+		const std::string &blockStructureName = sdna->GetType(type_idx);
 		
 		if (strcmp("MTexPoly", blockStructureName.c_str()) == 0) {
-			std::cout << "MTexPoly Block Found!\n";
+			BLENDER_LOG(BLENDER_TRACE_DEBUG, "MTexPoly Block Found!");
 
 			unsigned int count = blocks[i].m_Header.count;
-			MTexPoly *texPolys = new MTexPoly[count];
+			if(count < (unsigned int)m_TotalPolygons) {
+				BLENDER_LOG(BLENDER_TRACE_WARNING, "MTexPoly Block does not match the mesh!");
+				return 0;
+			}
+
+			MTexPoly *texPolys = m_Arena.AllocateArray<MTexPoly>(count);
 
 			int offset_tpage	= blocks[i].GetMemberOffset("*tpage", sdna);
 			int offset_flag		= blocks[i].GetMemberOffset("flag", sdna);
@@ -341,11 +1103,11 @@ MTexPoly *BlenderMesh::ExtractTexPolys(StructureDNA *sdna, std::vector<BlenderFi
 			int offset_tile		= blocks[i].GetMemberOffset("tile", sdna);
 
 			for (unsigned int k=0; k < count; k++) {
-				texPolys[k].tpage	= blocks[i].GetPointer(offset_tpage, k, length);
-				texPolys[k].flag	= blocks[i].GetChar(offset_flag, k, length);
-				texPolys[k].transp	= blocks[i].GetChar(offset_transp, k, length);
-				texPolys[k].mode	= blocks[i].GetShort(offset_mode, k, length);
-				texPolys[k].tile	= blocks[i].GetShort(offset_tile, k, length);
+				texPolys[k].tpage	= (offset_tpage != -1) ? blocks[i].GetPointer(offset_tpage, k, length) : 0;
+				texPolys[k].flag	= (offset_flag != -1) ? blocks[i].GetChar(offset_flag, k, length) : 0;
+				texPolys[k].transp	= (offset_transp != -1) ? blocks[i].GetChar(offset_transp, k, length) : 0;
+				texPolys[k].mode	= (offset_mode != -1) ? blocks[i].GetShort(offset_mode, k, length) : 0;
+				texPolys[k].tile	= (offset_tile != -1) ? blocks[i].GetShort(offset_tile, k, length) : 0;
 				texPolys[k].pad		= 0;
 			}
 
@@ -353,60 +1115,75 @@ MTexPoly *BlenderMesh::ExtractTexPolys(StructureDNA *sdna, std::vector<BlenderFi
 		}
 	}
 
-	std::cout << "No MPoly Block Found!\n";
+	BLENDER_LOG(BLENDER_TRACE_DEBUG, "No MTexPoly Block Found!");
 	return 0;
 }
 
-MDeformVert	*BlenderMesh::ExtractDeformVerts(StructureDNA *sdna, std::vector<BlenderFileBlock> &blocks) {
+MDeformVert	*BlenderMesh::ExtractDeformVerts(StructureDNA *sdna, BlenderSpan<const BlenderFileBlock> blocks) {
+	BLENDER_TRACE_SCOPE("BlenderMesh::ExtractDeformVerts");
+
 	Structure *mDeformVert = sdna->GetStructureByType("MDeformVert");
-	unsigned int length = sdna->lengths[mDeformVert->type_idx];
+	if(!mDeformVert) {
+		BLENDER_LOG(BLENDER_TRACE_DEBUG, "No MDeformVert Structure!");
+		return 0;
+	}
 
-	std::cout << "\nMDeformVert structure: " << sdna->GetType(mDeformVert->type_idx) << "\n";
+	unsigned int length = sdna->lengths[mDeformVert->type_idx];
 
 	for (unsigned int i=0; i < blocks.size(); i++) {
-		BlenderFileBlock fBlock = blocks[i];
+		const BlenderFileBlock &fBlock = blocks[i];
 
 		Structure *s = sdna->GetStructureFromBlock(&fBlock);
 		unsigned int type_idx = s->type_idx;
-		std::string blockStructureName = sdna->GetType(type_idx);
+		const std::string &blockStructureName = sdna->GetType(type_idx);
 		
 		if (strcmp("MDeformVert", blockStructureName.c_str()) == 0) {
-			std::cout << "MDeformVert Block Found!\n";
+			BLENDER_LOG(BLENDER_TRACE_DEBUG, "MDeformVert Block Found!");
 
 			unsigned int count = blocks[i].m_Header.count;
-			MDeformVert *deformVerts = new MDeformVert[count];
+			if(count < (unsigned int)m_TotalVerts) {
+				BLENDER_LOG(BLENDER_TRACE_WARNING, "MDeformVert Block does not match the mesh!");
+				return 0;
+			}
+
+			MDeformVert *deformVerts = m_Arena.AllocateArray<MDeformVert>(count);
 
 			int offset_totWeight = blocks[i].GetMemberOffset("totweight", sdna);
 			int offset_flag = blocks[i].GetMemberOffset("flag", sdna);
 
 			for (unsigned int k=0; k < count; k++) {
-				deformVerts[k].totWeight	= blocks[i].GetInt(offset_totWeight, k, length);
-				deformVerts[k].flag			= blocks[i].GetInt(offset_flag, k, length);
+				deformVerts[k].totWeight	= (offset_totWeight != -1) ? blocks[i].GetInt(offset_totWeight, k, length) : 0;
+				deformVerts[k].flag			= (offset_flag != -1) ? blocks[i].GetInt(offset_flag, k, length) : 0;
 			}
 
 			return deformVerts;
 		}
 	}
 
-	std::cout << "No MDeformVert Block Found!\n";
+	BLENDER_LOG(BLENDER_TRACE_DEBUG, "No MDeformVert Block Found!");
 	return 0;
 }
 
-MDeformWeight *BlenderMesh::ExtractDeformWeights(StructureDNA *sdna, std::vector<BlenderFileBlock> &blocks) {
+MDeformWeight *BlenderMesh::ExtractDeformWeights(StructureDNA *sdna, BlenderSpan<const BlenderFileBlock> blocks) {
+	BLENDER_TRACE_SCOPE("BlenderMesh::ExtractDeformWeights");
+
 	Structure *mDeformWeight = sdna->GetStructureByType("MDeformWeight");
-	unsigned int length = sdna->lengths[mDeformWeight->type_idx];
+	if(!mDeformWeight) {
+		BLENDER_LOG(BLENDER_TRACE_DEBUG, "No MDeformWeight Structure!");
+		return 0;
+	}
 
-	std::cout << "\nMDeformWeight structure: " << sdna->GetType(mDeformWeight->type_idx) << "\n";
+	unsigned int length = sdna->lengths[mDeformWeight->type_idx];
 
 	// First get total count
 	unsigned int total_count=0;
 
 	for (unsigned int i=0; i < blocks.size(); i++) {
-		BlenderFileBlock fBlock = blocks[i];
+		const BlenderFileBlock &fBlock = blocks[i];
 
 		Structure *s = sdna->GetStructureFromBlock(&fBlock);
 		unsigned int type_idx = s->type_idx;
-		std::string blockStructureName = sdna->GetType(type_idx);
+		const std::string &blockStructureName = sdna->GetType(type_idx);
 
 		if (strcmp("MDeformWeight", blockStructureName.c_str()) == 0) {			
 			unsigned int count = blocks[i].m_Header.count;
@@ -415,20 +1192,20 @@ MDeformWeight *BlenderMesh::ExtractDeformWeights(StructureDNA *sdna, std::vector
 	}
 
 	if(total_count > 0)
-		std::cout << "MDeformWeight Block Found!\n";
+		BLENDER_LOG(BLENDER_TRACE_DEBUG, "MDeformWeight Block Found!");
 	else {
-		std::cout << "No MDeformWeight Block Found!\n";
+		BLENDER_LOG(BLENDER_TRACE_DEBUG, "No MDeformWeight Block Found!");
 		return 0;
 	}
 
-	MDeformWeight *deformWeights = new MDeformWeight[total_count];
+	MDeformWeight *deformWeights = m_Arena.AllocateArray<MDeformWeight>(total_count);
 
 	for (unsigned int i=0; i < blocks.size(); i++) {
-		BlenderFileBlock fBlock = blocks[i];
+		const BlenderFileBlock &fBlock = blocks[i];
 
 		Structure *s = sdna->GetStructureFromBlock(&fBlock);
 		unsigned int type_idx = s->type_idx;
-		std::string blockStructureName = sdna->GetType(type_idx);
+		const std::string &blockStructureName = sdna->GetType(type_idx);
 
 		unsigned int count = blocks[i].m_Header.count;
 
@@ -437,9 +1214,8 @@ MDeformWeight *BlenderMesh::ExtractDeformWeights(StructureDNA *sdna, std::vector
 			int offset_weight = blocks[i].GetMemberOffset("weight", sdna);
 
 			for (unsigned int k=0; k < count; k++) {
-				deformWeights[k].def_nr	= blocks[i].GetInt(offset_def_nr, k, length);
-				deformWeights[k].weight = blocks[i].GetFloat(offset_weight, k, length);
-				//std::cout << "DefNR: " << deformWeights[k].def_nr << ", Weight: " << deformWeights[k].weight << std::endl;
+				deformWeights[k].def_nr	= (offset_def_nr != -1) ? blocks[i].GetInt(offset_def_nr, k, length) : 0;
+				deformWeights[k].weight = (offset_weight != -1) ? blocks[i].GetFloat(offset_weight, k, length) : 0.0f;
 			}
 		}
 	}
@@ -447,28 +1223,56 @@ MDeformWeight *BlenderMesh::ExtractDeformWeights(StructureDNA *sdna, std::vector
 	return deformWeights;
 }
 
+bool BlenderMesh::ValidateTopology() const {
+	if(!m_Vertices || !m_Polygons || !m_Loops) {
+		return false;
+	}
+
+	for(int i=0; i < m_TotalPolygons; i++) {
+		const MPoly &polygon = m_Polygons[i];
+
+		if(polygon.loopstart < 0 || polygon.totloop < 0 || (long long)polygon.loopstart + polygon.totloop > m_TotalLoops) {
+			return false;
+		}
+	}
+
+	for(int i=0; i < m_TotalLoops; i++) {
+		if(m_Loops[i].v >= (unsigned int)m_TotalVerts) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
 void BlenderMesh::ConvertPolysToFaces() {
-	if(m_Faces !=0 || m_Polygons == 0 || m_Loops == 0 || m_LoopUVs == 0) {
+	BLENDER_TRACE_SCOPE("BlenderMesh::ConvertPolysToFaces");
+
+	if(m_Faces !=0 || m_Polygons == 0 || m_Loops == 0) {
 		assert(0 && "Faces must be null, and polygon data must exist");
 	}
 
-	m_Faces = new MFace[m_TotalPolygons];
-	m_TexFaces = new MTFace[m_TotalPolygons];
+	// UVs and texture polygons are optional, faces
+	// get zeroed texture data without them
+	MTexPoly emptyTexPolygon;
+	memset(&emptyTexPolygon, 0, sizeof(MTexPoly));
+
+	m_Faces = m_Arena.AllocateArray<MFace>(m_TotalPolygons);
+	m_TexFaces = m_Arena.AllocateArray<MTFace>(m_TotalPolygons);
+	m_TotalFaces = 0;
 	for(int i=0; i < m_TotalPolygons; i++) {
-		MPoly polygon		= m_Polygons[i];
-		MTexPoly texPolygon = m_TexPolygons[i];
+		const MPoly &polygon		= m_Polygons[i];
+		const MTexPoly &texPolygon	= m_TexPolygons ? m_TexPolygons[i] : emptyTexPolygon;
 		MFace face;
 		MTFace texFace;
 
+		// Faces hold at most 4 corners
 		if(polygon.totloop > 4) {
-			assert(0 && "Polygon with more than 4 vertices detected.");
 			continue;
 		}
 
 		face.mat_nr = polygon.mat_nr;
-		face.isQuad = true;
-
-		//std::cout << "Face: " << face.v1 << " " << face.v2 << " " << face.v3 << " " << face.v4 << "\n";
+		face.isQuad = (polygon.totloop == 4);
 
 		for(int j=0; j < 4; j++) {
 			if(polygon.totloop > j) 
@@ -476,8 +1280,18 @@ void BlenderMesh::ConvertPolysToFaces() {
 			else
 				face.v[j] = 0;
 
-			texFace.uv[j][0] = m_LoopUVs[polygon.loopstart+j].uv[0];
-			texFace.uv[j][1] = m_LoopUVs[polygon.loopstart+j].uv[1];
+			// The loop edge runs to the next corner
+			unsigned int e = (polygon.totloop > j) ? m_Loops[polygon.loopstart+j].e : ~0u;
+			face.e[j] = (e < (unsigned int)m_TotalEdges) ? (int)e : -1;
+
+			if(m_LoopUVs && polygon.totloop > j) {
+				texFace.uv[j][0] = m_LoopUVs[polygon.loopstart+j].uv[0];
+				texFace.uv[j][1] = m_LoopUVs[polygon.loopstart+j].uv[1];
+			}
+			else {
+				texFace.uv[j][0] = 0.0f;
+				texFace.uv[j][1] = 0.0f;
+			}
 		}
 
 		texFace.flag	= texPolygon.flag;
@@ -487,32 +1301,32 @@ void BlenderMesh::ConvertPolysToFaces() {
 		texFace.tpage	= texPolygon.tpage;
 		texFace.unwrap	= false;
 		
-		m_Faces[i] = face;
-		m_TexFaces[i] = texFace;
+		// Skipped polygons leave no gap
+		m_Faces[m_TotalFaces] = face;
+		m_TexFaces[m_TotalFaces] = texFace;
 		m_TotalFaces += 1;
 	}
 
-	if(m_LoopUVs) {
-		delete[] m_LoopUVs;
-		m_LoopUVs = 0;
-	}
-	if(m_Loops) {
-		delete[] m_Loops;
-		m_Loops = 0;
+	if(m_TotalFaces < m_TotalPolygons) {
+		BLENDER_LOG(BLENDER_TRACE_WARNING, "Mesh " << m_Name << " has " << (m_TotalPolygons - m_TotalFaces) << " polygons with more than 4 vertices, skipped");
 	}
+
+	// The loop and polygon arrays stay in the
+	// arena until the mesh is released
+	m_LoopUVs = 0;
+	m_Loops = 0;
 	m_TotalLoops = 0;
 
-	if(m_Polygons) {
-		delete[] m_Polygons;
-		m_Polygons = 0;
-	}
+	m_Polygons = 0;
 	m_TotalPolygons = 0;
 }
 
 // NOTE: This assumes that all faces are quads!
 void BlenderMesh::Triangulate() {
-	MFace *triFaces = new MFace[m_TotalFaces*2];
-	MTFace *triTexFaces = new MTFace[m_TotalFaces*2];
+	BLENDER_TRACE_SCOPE("BlenderMesh::Triangulate");
+
+	MFace *triFaces = m_Arena.AllocateArray<MFace>(m_TotalFaces*2);
+	MTFace *triTexFaces = m_Arena.AllocateArray<MTFace>(m_TotalFaces*2);
 
 	unsigned int outFace = 0;
 	for(int i=0; i < m_TotalFaces; i++) {
@@ -527,6 +1341,10 @@ void BlenderMesh::Triangulate() {
 		triFaces[outFace].v[0] = face->v[0];
 		triFaces[outFace].v[1] = face->v[1];
 		triFaces[outFace].v[2] = face->v[2];
+		triFaces[outFace].e[0] = face->e[0];
+		triFaces[outFace].e[1] = face->e[1];
+		triFaces[outFace].e[2] = face->isQuad ? -1 : face->e[2];
+		triFaces[outFace].e[3] = -1;
 
 		triTexFaces[outFace].flag = texFace->flag;
 		triTexFaces[outFace].mode = texFace->mode;
@@ -544,7 +1362,7 @@ void BlenderMesh::Triangulate() {
 		outFace++;
 
 		// If this is a quad, split
-		if(face->v[4] != 0) {
+		if(face->isQuad) {
 			triFaces[outFace-1].isQuad = true;
 			triFaces[outFace].isQuad = true;
 			triFaces[outFace].mat_nr = face->mat_nr;
@@ -554,6 +1372,10 @@ void BlenderMesh::Triangulate() {
 			triFaces[outFace].v[0] = face->v[0];
 			triFaces[outFace].v[1] = face->v[2];
 			triFaces[outFace].v[2] = face->v[3];
+			triFaces[outFace].e[0] = -1;
+			triFaces[outFace].e[1] = face->e[2];
+			triFaces[outFace].e[2] = face->e[3];
+			triFaces[outFace].e[3] = -1;
 
 			triTexFaces[outFace].flag = texFace->flag;
 			triTexFaces[outFace].mode = texFace->mode;
@@ -573,16 +1395,18 @@ void BlenderMesh::Triangulate() {
 	}
 
 	m_TotalFaces = outFace;
-	delete[] m_TexFaces;
-	m_TexFaces = triTexFaces;
+	BLENDER_TRACE_COUNT(BLENDER_COUNTER_TRIANGLES, outFace);
 
-	delete[] m_Faces;
+	m_TexFaces = triTexFaces;
 	m_Faces = triFaces;
 }
 
 // NOTE: This assumes that faces have already been triangulated
 void BlenderMesh::UVsToVerts() {
+	BLENDER_TRACE_SCOPE("BlenderMesh::UVsToVerts");
+
 	std::vector<MVert> newVertices;
+	std::vector<unsigned int> newSources;
 	unsigned int newVertCount = 0;
 
 	for(int i=0; i < m_TotalFaces; i++) {
@@ -606,13 +1430,14 @@ void BlenderMesh::UVsToVerts() {
 				newVert.uv[0] = texFace->uv[j][0];
 				newVert.uv[1] = texFace->uv[j][1];
 				newVertices.push_back(newVert);
+				newSources.push_back(face->v[j]);
 				face->v[j] = m_TotalVerts + newVertCount;
 				newVertCount++;
 			}
 		}
 	}
 
-	MVert *finalVertices = new MVert[m_TotalVerts + newVertCount];
+	MVert *finalVertices = m_Arena.AllocateArray<MVert>(m_TotalVerts + newVertCount);
 
 	for(int i=0; i < m_TotalVerts; i++) {
 		finalVertices[i] = m_Vertices[i];
@@ -622,8 +1447,597 @@ void BlenderMesh::UVsToVerts() {
 		finalVertices[m_TotalVerts+i] = newVertices[i];
 	}
 
+	// Shape keys are stored per file vertex, so
+	// the copies remember where they came from
+	if(newVertCount) {
+		m_SourceVertices = m_Arena.AllocateArray<unsigned int>(m_TotalVerts + newVertCount);
+
+		for(int i=0; i < m_TotalVerts; i++) {
+			m_SourceVertices[i] = i;
+		}
+
+		for(unsigned int i=0; i < newVertCount; i++) {
+			m_SourceVertices[m_TotalVerts+i] = newSources[i];
+		}
+	}
+
 	newVertices.clear();
-	delete[] m_Vertices;
 	m_Vertices = finalVertices;
 	m_TotalVerts += newVertCount;
+	BLENDER_TRACE_COUNT(BLENDER_COUNTER_VERTICES, newVertCount);
+}
+
+static void ForEachBatch(BlenderThreadPool *pool, size_t numBatches, const std::function<void(size_t batch)> &fn) {
+	if(pool) {
+		pool->ParallelFor(numBatches, 1, [&fn](size_t begin, size_t end) {
+			for(size_t b=begin; b < end; b++) {
+				fn(b);
+			}
+		});
+	}
+	else {
+		for(size_t b=0; b < numBatches; b++) {
+			fn(b);
+		}
+	}
+}
+
+// Each batch counts its faces per material, a prefix sum over
+// (material, batch) gives every batch its own output slots, and
+// the scatter keeps file order within a material
+void BlenderMesh::SortByMaterial(BlenderThreadPool *pool) {
+	BLENDER_TRACE_SCOPE("BlenderMesh::SortByMaterial");
+
+	if(!m_Faces || m_TotalFaces <= 0) {
+		return;
+	}
+
+	const size_t batchSize = 1 << 14;
+	size_t numFaces = (size_t)m_TotalFaces;
+	size_t numBatches = (numFaces + batchSize - 1) / batchSize;
+
+	std::vector<int> batchMax(numBatches, 0);
+	ForEachBatch(pool, numBatches, [&](size_t b) {
+		size_t end = (b+1) * batchSize < numFaces ? (b+1) * batchSize : numFaces;
+
+		for(size_t i=b * batchSize; i < end; i++) {
+			if(m_Faces[i].mat_nr > batchMax[b]) {
+				batchMax[b] = m_Faces[i].mat_nr;
+			}
+		}
+	});
+
+	int numMaterials = 1;
+	for(size_t b=0; b < numBatches; b++) {
+		if(batchMax[b] + 1 > numMaterials) {
+			numMaterials = batchMax[b] + 1;
+		}
+	}
+
+	// Negative mat_nr values go to material 0
+	std::vector<unsigned int> slots(numBatches * numMaterials, 0);
+	ForEachBatch(pool, numBatches, [&](size_t b) {
+		size_t end = (b+1) * batchSize < numFaces ? (b+1) * batchSize : numFaces;
+
+		for(size_t i=b * batchSize; i < end; i++) {
+			int material = m_Faces[i].mat_nr < 0 ? 0 : m_Faces[i].mat_nr;
+			slots[b * numMaterials + material] += 1;
+		}
+	});
+
+	std::vector<unsigned int> materialStart(numMaterials + 1, 0);
+	unsigned int running = 0;
+
+	for(int m=0; m < numMaterials; m++) {
+		materialStart[m] = running;
+
+		for(size_t b=0; b < numBatches; b++) {
+			unsigned int count = slots[b * numMaterials + m];
+			slots[b * numMaterials + m] = running;
+			running += count;
+		}
+	}
+
+	materialStart[numMaterials] = running;
+
+	std::vector<MFace> sortedFaces(numFaces);
+	std::vector<MTFace> sortedTexFaces(m_TexFaces ? numFaces : 0);
+
+	ForEachBatch(pool, numBatches, [&](size_t b) {
+		size_t end = (b+1) * batchSize < numFaces ? (b+1) * batchSize : numFaces;
+
+		for(size_t i=b * batchSize; i < end; i++) {
+			int material = m_Faces[i].mat_nr < 0 ? 0 : m_Faces[i].mat_nr;
+			unsigned int dst = slots[b * numMaterials + material]++;
+
+			sortedFaces[dst] = m_Faces[i];
+			if(m_TexFaces) {
+				sortedTexFaces[dst] = m_TexFaces[i];
+			}
+		}
+	});
+
+	memcpy(m_Faces, &sortedFaces[0], numFaces * sizeof(MFace));
+	if(m_TexFaces) {
+		memcpy(m_TexFaces, &sortedTexFaces[0], numFaces * sizeof(MTFace));
+	}
+
+	m_TotalSubmeshes = 0;
+	for(int m=0; m < numMaterials; m++) {
+		if(materialStart[m+1] > materialStart[m]) {
+			m_TotalSubmeshes += 1;
+		}
+	}
+
+	m_Submeshes = m_Arena.AllocateArray<BlenderSubmesh>(m_TotalSubmeshes);
+
+	int submesh = 0;
+	for(int m=0; m < numMaterials; m++) {
+		if(materialStart[m+1] > materialStart[m]) {
+			m_Submeshes[submesh].materialIndex = (short)m;
+			m_Submeshes[submesh].firstFace = (int)materialStart[m];
+			m_Submeshes[submesh].numFaces = (int)(materialStart[m+1] - materialStart[m]);
+			submesh++;
+		}
+	}
+
+	// Vertex range of each submesh
+	ForEachBatch(pool, m_TotalSubmeshes, [&](size_t s) {
+		BlenderSubmesh &sub = m_Submeshes[s];
+		int minVertex = m_TotalVerts;
+		int maxVertex = -1;
+
+		for(int i=sub.firstFace; i < sub.firstFace + sub.numFaces; i++) {
+			int corners = (!m_Triangulated && m_Faces[i].isQuad) ? 4 : 3;
+
+			for(int c=0; c < corners; c++) {
+				if(m_Faces[i].v[c] < minVertex) minVertex = m_Faces[i].v[c];
+				if(m_Faces[i].v[c] > maxVertex) maxVertex = m_Faces[i].v[c];
+			}
+		}
+
+		sub.firstVertex = (maxVertex < 0) ? 0 : minVertex;
+		sub.numVertices = (maxVertex < 0) ? 0 : maxVertex - minVertex + 1;
+	});
+}
+
+void BlenderMesh::BuildBVH(BlenderThreadPool *pool) {
+	BLENDER_TRACE_SCOPE("BlenderMesh::BuildBVH");
+
+	if(!m_Faces || !m_Vertices || m_TotalFaces <= 0) {
+		return;
+	}
+
+	BlenderBVHBuilder builder(m_Vertices, m_Faces, m_TotalFaces, m_Triangulated);
+	builder.Build(pool);
+
+	const std::vector<BlenderBVHNode> &nodes = builder.GetNodes();
+	const std::vector<int> &faces = builder.GetFaces();
+
+	m_TotalBVHNodes = (int)nodes.size();
+	m_BVHNodes = m_Arena.AllocateArray<BlenderBVHNode>(nodes.size());
+	m_BVHFaces = m_Arena.AllocateArray<int>(faces.size());
+
+	memcpy(m_BVHNodes, &nodes[0], nodes.size() * sizeof(BlenderBVHNode));
+	memcpy(m_BVHFaces, &faces[0], faces.size() * sizeof(int));
+}
+
+// A face is listed once per vertex even if the
+// vertex repeats, as in a degenerate quad
+void BlenderMesh::BuildVertexFaces(BlenderThreadPool *pool) {
+	BlenderBuildAdjacency(m_Arena, pool, m_TotalFaces, m_TotalVerts, [this](size_t i, unsigned int keys[4]) {
+		const MFace &face = m_Faces[i];
+		int numCorners = GetFaceCorners(face);
+		int n = 0;
+
+		for(int j=0; j < numCorners; j++) {
+			unsigned int v = face.v[j];
+			bool seen = false;
+
+			for(int k=0; k < n; k++) {
+				seen |= (keys[k] == v);
+			}
+
+			if(!seen && v < (unsigned int)m_TotalVerts) {
+				keys[n++] = v;
+			}
+		}
+
+		return n;
+	}, m_VertexFaces);
+}
+
+void BlenderMesh::BuildAdjacency(BlenderThreadPool *pool) {
+	BLENDER_TRACE_SCOPE("BlenderMesh::BuildAdjacency");
+
+	if(!m_Faces || m_TotalFaces <= 0 || m_TotalVerts <= 0) {
+		return;
+	}
+
+	if(!m_VertexFaces.IsValid()) {
+		BuildVertexFaces(pool);
+	}
+
+	if(m_Edges && !m_VertexEdges.IsValid()) {
+		BlenderBuildAdjacency(m_Arena, pool, m_TotalEdges, m_TotalVerts, [this](size_t i, unsigned int keys[4]) {
+			const MEdge &edge = m_Edges[i];
+			int n = 0;
+
+			if(edge.v1 < (unsigned int)m_TotalVerts)
+				keys[n++] = edge.v1;
+			if(edge.v2 < (unsigned int)m_TotalVerts && edge.v2 != edge.v1)
+				keys[n++] = edge.v2;
+
+			return n;
+		}, m_VertexEdges);
+	}
+
+	// Triangulation diagonals have no edge and are skipped, so
+	// both halves of a split quad list the quad's outer edges.
+	// Without the edge array totedge is not backed by data.
+	if(m_Edges && m_TotalEdges > 0 && !m_EdgeFaces.IsValid()) {
+		BlenderBuildAdjacency(m_Arena, pool, m_TotalFaces, m_TotalEdges, [this](size_t i, unsigned int keys[4]) {
+			const MFace &face = m_Faces[i];
+			int n = 0;
+
+			for(int j=0; j < 4; j++) {
+				if(face.e[j] >= 0 && face.e[j] < m_TotalEdges) {
+					keys[n++] = face.e[j];
+				}
+			}
+
+			return n;
+		}, m_EdgeFaces);
+	}
+}
+
+static void Cross(const float a[3], const float b[3], float out[3]) {
+	out[0] = a[1] * b[2] - a[2] * b[1];
+	out[1] = a[2] * b[0] - a[0] * b[2];
+	out[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+static float Dot(const float a[3], const float b[3]) {
+	return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+static bool Normalize(float v[3]) {
+	float length = sqrtf(Dot(v, v));
+	if(length <= 1e-20f) {
+		return false;
+	}
+
+	v[0] /= length;
+	v[1] /= length;
+	v[2] /= length;
+	return true;
+}
+
+// Faces are first reduced to a tangent, bitangent and normal
+// each, in parallel. Every vertex then sums the faces that use
+// it in face order, read from a vertex to face table, so there
+// are no shared writes and no order that depends on threads.
+void BlenderMesh::GenerateTangents(BlenderThreadPool *pool) {
+	BLENDER_TRACE_SCOPE("BlenderMesh::GenerateTangents");
+
+	if(!m_Faces || !m_TexFaces || !m_Vertices || m_TotalFaces <= 0) {
+		return;
+	}
+
+	const size_t batchSize = 1 << 14;
+	size_t numFaces = (size_t)m_TotalFaces;
+	size_t numVerts = (size_t)m_TotalVerts;
+
+	struct FaceFrame {
+		float tangent[3];
+		float bitangent[3];
+		float normal[3];
+	};
+
+	std::vector<FaceFrame> frames(numFaces);
+
+	ForEachBatch(pool, (numFaces + batchSize - 1) / batchSize, [&](size_t b) {
+		size_t end = (b+1) * batchSize < numFaces ? (b+1) * batchSize : numFaces;
+
+		for(size_t i=b * batchSize; i < end; i++) {
+			const MFace &face = m_Faces[i];
+			const MTFace &texFace = m_TexFaces[i];
+			FaceFrame &frame = frames[i];
+			int numCorners = GetFaceCorners(face);
+
+			memset(&frame, 0, sizeof(FaceFrame));
+
+			// Quads are fanned into two triangles, the
+			// unnormalized normal weights them by area
+			for(int t=1; t+1 < numCorners; t++) {
+				const float *p0 = m_Vertices[face.v[0]].co;
+				const float *p1 = m_Vertices[face.v[t]].co;
+				const float *p2 = m_Vertices[face.v[t+1]].co;
+				const float *uv0 = texFace.uv[0];
+				const float *uv1 = texFace.uv[t];
+				const float *uv2 = texFace.uv[t+1];
+
+				float e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+				float e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+				float normal[3];
+				Cross(e1, e2, normal);
+
+				float du1 = uv1[0] - uv0[0], dv1 = uv1[1] - uv0[1];
+				float du2 = uv2[0] - uv0[0], dv2 = uv2[1] - uv0[1];
+				float det = du1 * dv2 - du2 * dv1;
+
+				for(int a=0; a < 3; a++) {
+					frame.normal[a] += normal[a];
+				}
+
+				// Degenerate UVs add nothing to the tangents
+				if(fabsf(det) <= 1e-20f) {
+					continue;
+				}
+
+				float tangent[3], bitangent[3];
+				for(int a=0; a < 3; a++) {
+					tangent[a] = (e1[a] * dv2 - e2[a] * dv1) / det;
+					bitangent[a] = (e2[a] * du1 - e1[a] * du2) / det;
+				}
+
+				// Unit vectors weighted by the triangle area
+				float area = sqrtf(Dot(normal, normal));
+				if(!Normalize(tangent) || !Normalize(bitangent)) {
+					continue;
+				}
+
+				for(int a=0; a < 3; a++) {
+					frame.tangent[a] += tangent[a] * area;
+					frame.bitangent[a] += bitangent[a] * area;
+				}
+			}
+		}
+	});
+
+	if(!m_VertexFaces.IsValid()) {
+		BuildVertexFaces(pool);
+	}
+
+	m_Tangents = m_Arena.AllocateArray<BlenderTangent>(numVerts);
+
+	ForEachBatch(pool, (numVerts + batchSize - 1) / batchSize, [&](size_t b) {
+		size_t end = (b+1) * batchSize < numVerts ? (b+1) * batchSize : numVerts;
+
+		for(size_t v=b * batchSize; v < end; v++) {
+			float tangent[3] = { 0, 0, 0 };
+			float bitangent[3] = { 0, 0, 0 };
+			float normal[3] = { 0, 0, 0 };
+
+			BlenderSpan<const unsigned int> faces = m_VertexFaces.Get((unsigned int)v);
+
+			for(size_t k=0; k < faces.size(); k++) {
+				const FaceFrame &frame = frames[faces[k]];
+
+				for(int a=0; a < 3; a++) {
+					tangent[a] += frame.tangent[a];
+					bitangent[a] += frame.bitangent[a];
+					normal[a] += frame.normal[a];
+				}
+			}
+
+			BlenderTangent &result = m_Tangents[v];
+
+			if(!Normalize(normal)) {
+				normal[0] = 0.0f;
+				normal[1] = 0.0f;
+				normal[2] = 1.0f;
+			}
+
+			// Gram-Schmidt, falling back to any direction
+			// perpendicular to the normal
+			float d = Dot(normal, tangent);
+			for(int a=0; a < 3; a++) {
+				tangent[a] -= normal[a] * d;
+			}
+
+			if(!Normalize(tangent)) {
+				float axis[3] = { 0, 0, 0 };
+				axis[fabsf(normal[0]) < 0.9f ? 0 : 1] = 1.0f;
+
+				Cross(axis, normal, tangent);
+				Normalize(tangent);
+			}
+
+			float cross[3];
+			Cross(normal, tangent, cross);
+
+			result.tangent[0] = tangent[0];
+			result.tangent[1] = tangent[1];
+			result.tangent[2] = tangent[2];
+			result.sign = Dot(cross, bitangent) < 0.0f ? -1.0f : 1.0f;
+		}
+	});
+}
+
+void BlenderMesh::GenerateLODs(const std::vector<float> &ratios) {
+	BLENDER_TRACE_SCOPE("BlenderMesh::GenerateLODs");
+
+	if(!m_Faces || !m_Vertices || m_TotalFaces <= 0) {
+		return;
+	}
+
+	std::vector<float> sorted(ratios);
+	std::sort(sorted.begin(), sorted.end(), std::greater<float>());
+
+	BlenderSimplifier simplifier(m_Vertices, m_TotalVerts, m_Faces, m_TexFaces, m_TotalFaces, m_Triangulated);
+	int baseTriangles = simplifier.GetNumTriangles();
+
+	for(unsigned int i=0; i < sorted.size(); i++) {
+		if(sorted[i] <= 0.0f || sorted[i] >= 1.0f) {
+			continue;
+		}
+
+		simplifier.Simplify((int)(baseTriangles * sorted[i]));
+
+		const std::vector<int> &triangles = simplifier.GetTriangles();
+		const std::vector<short> &materials = simplifier.GetMaterials();
+
+		BlenderLOD lod;
+		lod.ratio = sorted[i];
+		lod.error = (float)simplifier.GetError();
+		lod.numFaces = simplifier.GetNumTriangles();
+		lod.faces = m_Arena.AllocateArray<MFace>(lod.numFaces);
+		memset(lod.faces, 0, lod.numFaces * sizeof(MFace));
+
+		for(int f=0; f < lod.numFaces; f++) {
+			lod.faces[f].v[0] = triangles[f * 3];
+			lod.faces[f].v[1] = triangles[f * 3 + 1];
+			lod.faces[f].v[2] = triangles[f * 3 + 2];
+			lod.faces[f].mat_nr = materials[f];
+			lod.faces[f].e[0] = lod.faces[f].e[1] = lod.faces[f].e[2] = lod.faces[f].e[3] = -1;
+		}
+
+		m_LODs.push_back(lod);
+	}
+}
+
+static const float s_ShapeKeyEpsilon = 1e-6f;
+
+static inline bool IsMoved(const float *basis, const float *co, int v, float epsilon) {
+	return fabsf(co[v*3] - basis[v*3]) > epsilon || fabsf(co[v*3+1] - basis[v*3+1]) > epsilon || fabsf(co[v*3+2] - basis[v*3+2]) > epsilon;
+}
+
+// Most vertices of a shape key match the basis. With SSE2 four
+// vertices (twelve floats) are compared per step, and only the
+// steps with a difference are checked vertex by vertex.
+static void FindMovedVertices(const float *basis, const float *co, int count, float epsilon, std::vector<unsigned int> &moved) {
+	int v = 0;
+
+#ifdef BLENDER_SSE2
+	const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+	const __m128 limit = _mm_set1_ps(epsilon);
+
+	for(; v + 4 <= count; v += 4) {
+		const float *a = basis + v*3;
+		const float *b = co + v*3;
+
+		__m128 d0 = _mm_and_ps(_mm_sub_ps(_mm_loadu_ps(b), _mm_loadu_ps(a)), absMask);
+		__m128 d1 = _mm_and_ps(_mm_sub_ps(_mm_loadu_ps(b + 4), _mm_loadu_ps(a + 4)), absMask);
+		__m128 d2 = _mm_and_ps(_mm_sub_ps(_mm_loadu_ps(b + 8), _mm_loadu_ps(a + 8)), absMask);
+		__m128 over = _mm_or_ps(_mm_or_ps(_mm_cmpgt_ps(d0, limit), _mm_cmpgt_ps(d1, limit)), _mm_cmpgt_ps(d2, limit));
+
+		if(_mm_movemask_ps(over) == 0) {
+			continue;
+		}
+
+		for(int k=v; k < v + 4; k++) {
+			if(IsMoved(basis, co, k, epsilon)) {
+				moved.push_back(k);
+			}
+		}
+	}
+#endif
+
+	for(; v < count; v++) {
+		if(IsMoved(basis, co, v, epsilon)) {
+			moved.push_back(v);
+		}
+	}
+}
+
+void BlenderMesh::EncodeShapeKeys(const std::vector<BlenderShapeKeySource> &sources, int basis, bool flipYZ) {
+	BLENDER_TRACE_SCOPE("BlenderMesh::EncodeShapeKeys");
+
+	if(basis < 0 || basis >= (int)sources.size() || !m_Vertices) {
+		return;
+	}
+
+	const BlenderShapeKeySource &base = sources[basis];
+	if(base.count != m_TotalSourceVerts) {
+		BLENDER_LOG(BLENDER_TRACE_WARNING, "Basis key of " << m_Name << " does not match the vertex count");
+		return;
+	}
+
+	// Copies made at UV seams, grouped by the file vertex
+	std::vector<unsigned int> copyStart(m_TotalSourceVerts + 1, 0);
+	std::vector<unsigned int> copies(m_TotalVerts - m_TotalSourceVerts);
+
+	if(m_SourceVertices) {
+		for(int v=m_TotalSourceVerts; v < m_TotalVerts; v++) {
+			copyStart[m_SourceVertices[v] + 1] += 1;
+		}
+
+		for(int v=0; v < m_TotalSourceVerts; v++) {
+			copyStart[v+1] += copyStart[v];
+		}
+
+		std::vector<unsigned int> fill(copyStart.begin(), copyStart.end() - 1);
+		for(int v=m_TotalSourceVerts; v < m_TotalVerts; v++) {
+			copies[fill[m_SourceVertices[v]]++] = v;
+		}
+	}
+
+	std::vector<unsigned int> moved;
+
+	for(int k=0; k < (int)sources.size(); k++) {
+		const BlenderShapeKeySource &source = sources[k];
+
+		if(k == basis || source.count != base.count) {
+			continue;
+		}
+
+		moved.clear();
+		FindMovedVertices(base.co, source.co, source.count, s_ShapeKeyEpsilon, moved);
+
+		BlenderShapeKey key;
+		key.name = source.name;
+		key.weight = source.weight;
+		key.sliderMin = source.sliderMin;
+		key.sliderMax = source.sliderMax;
+		key.numDeltas = 0;
+
+		float largest = 0.0f;
+		for(size_t i=0; i < moved.size(); i++) {
+			unsigned int v = moved[i];
+			key.numDeltas += 1 + (copyStart[v+1] - copyStart[v]);
+
+			for(int a=0; a < 3; a++) {
+				float d = fabsf(source.co[v*3+a] - base.co[v*3+a]);
+				largest = d > largest ? d : largest;
+			}
+		}
+
+		key.scale = (largest > 0.0f) ? largest / 32767.0f : 1.0f;
+		key.indices = m_Arena.AllocateArray<unsigned int>(key.numDeltas);
+		key.deltas = m_Arena.AllocateArray<short>(key.numDeltas * 3);
+
+		int out = 0;
+		for(size_t i=0; i < moved.size(); i++) {
+			unsigned int v = moved[i];
+			float delta[3];
+
+			for(int a=0; a < 3; a++) {
+				delta[a] = source.co[v*3+a] - base.co[v*3+a];
+			}
+
+			// Same axes as ExtractVertices
+			if(flipYZ) {
+				float y = delta[1];
+				delta[1] = delta[2];
+				delta[2] = -y;
+			}
+
+			short quantized[3];
+			for(int a=0; a < 3; a++) {
+				float q = floorf(delta[a] / key.scale + 0.5f);
+				quantized[a] = (short)(q > 32767.0f ? 32767.0f : (q < -32767.0f ? -32767.0f : q));
+			}
+
+			for(unsigned int c=copyStart[v]; c <= copyStart[v+1]; c++) {
+				key.indices[out] = (c == copyStart[v]) ? v : copies[c-1];
+				key.deltas[out*3] = quantized[0];
+				key.deltas[out*3+1] = quantized[1];
+				key.deltas[out*3+2] = quantized[2];
+				out++;
+			}
+		}
+
+		m_ShapeKeys.push_back(key);
+	}
 }
\ No newline at end of file
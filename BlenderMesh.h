@@ -1,5 +1,69 @@
 #pragma once
+#include "BlenderCommon.h"
 #include "BlenderFileBlock.h"
+#include "BlenderSpan.h"
+#include "BlenderBVH.h"
+#include "BlenderAdjacency.h"
+
+#include <vector>
+
+class BlenderThreadPool;
+
+// The CustomData a layer belongs to
+enum BlenderAttributeDomain {
+	BLENDER_DOMAIN_POINT,		// vdata, one per vertex
+	BLENDER_DOMAIN_EDGE,		// edata
+	BLENDER_DOMAIN_FACE,		// pdata, one per polygon
+	BLENDER_DOMAIN_CORNER,		// ldata, one per loop
+	BLENDER_DOMAIN_TESSFACE		// fdata, legacy tessellated faces
+};
+
+// CustomDataLayer.type values for the common layers
+enum BlenderCustomDataType {
+	BLENDER_CD_MVERT			= 0,
+	BLENDER_CD_MDEFORMVERT		= 2,
+	BLENDER_CD_MEDGE			= 3,
+	BLENDER_CD_MFACE			= 4,
+	BLENDER_CD_MTFACE			= 5,
+	BLENDER_CD_MCOL				= 6,
+	BLENDER_CD_PROP_FLOAT		= 10,
+	BLENDER_CD_PROP_INT32		= 11,
+	BLENDER_CD_PROP_STRING		= 12,
+	BLENDER_CD_MTEXPOLY			= 15,
+	BLENDER_CD_MLOOPUV			= 16,
+	BLENDER_CD_PROP_BYTE_COLOR	= 17,	// MLoopCol
+	BLENDER_CD_MPOLY			= 25,
+	BLENDER_CD_MLOOP			= 26,
+	BLENDER_CD_PROP_INT8		= 45,
+	BLENDER_CD_PROP_COLOR		= 47,
+	BLENDER_CD_PROP_FLOAT3		= 48,
+	BLENDER_CD_PROP_FLOAT2		= 49,
+	BLENDER_CD_PROP_BOOL		= 50,
+	BLENDER_CD_PROP_INT32_2D	= 53
+};
+
+// One CustomData layer, with the data as stored in the file:
+// flipYZ and UV splitting are not applied. The data points
+// into the block payload while the file retains its blocks,
+// so it is tied to the file the mesh came from.
+// ReleaseFileBlocks copies it into the mesh first, and in
+// streaming mode it is copied from the start.
+struct BlenderAttribute {
+	std::string name;
+	int type;
+	BlenderAttributeDomain domain;
+	unsigned int elementSize;
+	unsigned int count;
+	const unsigned char *data;
+
+	// T must have the size of one element,
+	// e.g. float[3] for BLENDER_CD_PROP_FLOAT3
+	template<typename T>
+	BlenderSpan<const T> GetSpan() const {
+		assert(sizeof(T) == elementSize);
+		return BlenderSpan<const T>((const T *)data, count);
+	}
+};
 
 ///////////////////////////////
 // Blender Object Structures
@@ -19,6 +83,14 @@ struct MVert
 	long nextSupplVert;	// used in duplicteVertex mode to to point to next additional vertex
 };
 
+struct MEdge {
+	unsigned int v1;
+	unsigned int v2;
+	char crease;
+	char bweight;
+	short flag;
+};
+
 struct MLoop {
 	unsigned int v;
 	unsigned int e;
@@ -62,6 +134,7 @@ struct MFace {
 	bool supplV1;  // true if v1 is index from duplicated vertices
 	bool supplV2;  // true if v2 is index from duplicated vertices
 	bool supplV3;  // true if v3 is index from duplicated vertices
+	int e[4];		// edge from v[j] to the next corner, -1 if it is not a mesh edge (e.g. a triangulation diagonal)
 };
  
 struct MTFace {
@@ -85,11 +158,93 @@ struct MDeformWeight {
 	float weight;
 };
 
+// A run of faces sharing one material. Faces have 3 indices
+// when the mesh is triangulated, otherwise 3 or 4 (isQuad).
+// The faces only reference vertices in
+// [firstVertex, firstVertex + numVertices).
+struct BlenderSubmesh {
+	short materialIndex;
+	int firstFace;
+	int numFaces;
+	int firstVertex;
+	int numVertices;
+};
+
+// Box and sphere around the vertex positions, after flipYZ.
+// The sphere is centered on the box and reaches its corners.
+struct BlenderBounds {
+	float min[3];
+	float max[3];
+	float center[3];
+	float radius;
+};
+
+// Tangent of a vertex in the direction of increasing U,
+// with the bitangent given by sign * cross(normal, tangent)
+struct BlenderTangent {
+	float tangent[3];
+	float sign;
+};
+
+// A simplified version of the mesh. The faces are triangles
+// indexing the mesh's own vertex buffer, with mat_nr kept.
+struct BlenderLOD {
+	// Requested fraction of the mesh's triangles
+	float ratio;
+
+	// See BlenderSimplifier::GetError
+	float error;
+
+	MFace *faces;
+	int numFaces;
+};
+
+// A KeyBlock as read from the file, count positions
+// in the file's vertex order
+struct BlenderShapeKeySource {
+	std::string name;
+	float weight;
+	float sliderMin;
+	float sliderMax;
+	const float *co;
+	int count;
+};
+
+// A shape key stored as offsets from the basis key, only for
+// the vertices it moves. Offsets are quantized per key: the
+// offset of vertex indices[i] is deltas[i*3+a] * scale. With
+// vertexUVs every copy of a moved vertex is listed.
+struct BlenderShapeKey {
+	std::string name;
+
+	// KeyBlock.curval, the value saved with the file
+	float weight;
+	float sliderMin;
+	float sliderMax;
+
+	float scale;
+	int numDeltas;
+	unsigned int *indices;
+	short *deltas;
+};
+
 class BlenderMesh {
 public:
 	BlenderMesh();
 	~BlenderMesh() {}
 
+	BlenderMesh(BlenderMesh &&other);
+	BlenderMesh &operator=(BlenderMesh &&other);
+	BlenderMesh(const BlenderMesh &) = delete;
+	BlenderMesh &operator=(const BlenderMesh &) = delete;
+
+	void SetAllocator(const BlenderAllocator *allocator) { m_Arena.SetAllocator(allocator); }
+
+	// Deep copy into another mesh, for products derived from a
+	// mesh that other threads are reading: copy it, then sort,
+	// build or generate on the copy
+	void CopyTo(BlenderMesh &out) const;
+
 	int m_TotalVerts;
 	int m_TotalEdges;
 	int m_TotalLoops;
@@ -100,7 +255,12 @@ public:
 
 	std::string m_Name;
 
+	// Address of the Mesh when the file was saved,
+	// object data pointers refer to it
+	const void *m_OldAddress;
+
 	MVert			*m_Vertices;
+	MEdge			*m_Edges;
 	MLoop			*m_Loops;
 	MLoopUV			*m_LoopUVs;
 	MPoly			*m_Polygons;
@@ -111,25 +271,149 @@ public:
 	// Old files
 	MFace	*m_Faces;
 	MTFace	*m_TexFaces;
+	bool	m_Triangulated;
+
+	// Set by SortByMaterial, in material order
+	BlenderSubmesh	*m_Submeshes;
+	int				m_TotalSubmeshes;
+
+	// Set by BuildBVH, leaves index into m_BVHFaces
+	BlenderBVHNode	*m_BVHNodes;
+	int				m_TotalBVHNodes;
+	int				*m_BVHFaces;
+
+	// Set by BuildAdjacency. Edges keep the vertex indices
+	// stored in the file, so with vertexUVs the copies made
+	// at UV seams have faces but no edges.
+	BlenderAdjacency m_VertexFaces;
+	BlenderAdjacency m_VertexEdges;
+	BlenderAdjacency m_EdgeFaces;
+
+	// Set by GenerateTangents, one per vertex
+	BlenderTangent	*m_Tangents;
 
-	std::string GetMeshInfo();
-	int GetTotalFaces()		{ return m_TotalFaces; }
-	int GetTotalVertices()	{ return m_TotalVerts; }
+	// Computed while the vertices are read, all zero
+	// for a mesh without vertices
+	BlenderBounds	m_Bounds;
+
+	// Material names by mat_nr, with the MA prefix. Empty
+	// when the Material blocks were not retained.
+	std::vector<std::string> m_Materials;
+
+	// Set by GenerateLODs, from the finest to the coarsest
+	std::vector<BlenderLOD> m_LODs;
+
+	// Set by EncodeShapeKeys, in file order without the basis
+	std::vector<BlenderShapeKey> m_ShapeKeys;
+
+	// Vertex count in the file. When UVsToVerts has split
+	// vertices, m_SourceVertices maps every vertex to the
+	// file vertex it was copied from, otherwise it is null.
+	int				m_TotalSourceVerts;
+	unsigned int	*m_SourceVertices;
+
+	// Every CustomData layer found, in file order. Shared
+	// while the data points into the block payloads.
+	std::vector<BlenderAttribute> m_Attributes;
+	bool m_SharedAttributes;
+
+	std::string GetMeshInfo() const;
+	size_t GetMemoryUsage()	{ return m_Arena.GetBytesReserved(); }
+	int GetTotalFaces() const		{ return m_TotalFaces; }
+	int GetTotalVertices() const	{ return m_TotalVerts; }
 	MVert *GetVertices()	{ return m_Vertices; }
 	MFace *GetFaces()		{ return m_Faces; }
 
-	bool LoadMesh(StructureDNA *sdna, std::vector<BlenderFileBlock> &blocks, bool triangulate, bool vertexUVs, bool flipYZ);
+	BlenderSpan<const MVert> GetVertexSpan() const	{ return BlenderSpan<const MVert>(m_Vertices, m_Vertices ? m_TotalVerts : 0); }
+	BlenderSpan<const MFace> GetFaceSpan() const	{ return BlenderSpan<const MFace>(m_Faces, m_Faces ? m_TotalFaces : 0); }
+	BlenderSpan<const MEdge> GetEdgeSpan() const	{ return BlenderSpan<const MEdge>(m_Edges, m_Edges ? m_TotalEdges : 0); }
+	BlenderSpan<const BlenderSubmesh> GetSubmeshSpan() const { return BlenderSpan<const BlenderSubmesh>(m_Submeshes, m_TotalSubmeshes); }
+	BlenderSpan<const BlenderAttribute> GetAttributes() const { return m_Attributes; }
+	BlenderSpan<const BlenderBVHNode> GetBVHSpan() const { return BlenderSpan<const BlenderBVHNode>(m_BVHNodes, m_TotalBVHNodes); }
+	const BlenderBounds &GetBounds() const { return m_Bounds; }
+	BlenderSpan<const BlenderTangent> GetTangentSpan() const { return BlenderSpan<const BlenderTangent>(m_Tangents, m_Tangents ? m_TotalVerts : 0); }
+	BlenderSpan<const unsigned int> GetSourceVertexSpan() const { return BlenderSpan<const unsigned int>(m_SourceVertices, m_SourceVertices ? m_TotalVerts : 0); }
+	BlenderSpan<const BlenderShapeKey> GetShapeKeys() const { return m_ShapeKeys; }
+
+	// First layer with this name, null if there is none
+	const BlenderAttribute *FindAttribute(const std::string &name, BlenderAttributeDomain domain) const;
+
+	// Copies attribute data that still points into the block
+	// payloads into the mesh arena, before they are freed
+	void CopyAttributes();
+
+	// copyAttributes is needed when the block payloads
+	// are freed before the mesh
+	bool LoadMesh(StructureDNA *sdna, BlenderSpan<const BlenderFileBlock> blocks, bool triangulate, bool vertexUVs, bool flipYZ, unsigned int extractFlags = BLENDER_EXTRACT_ALL, bool copyAttributes = true);
 	void ReleaseMesh();
+
+	// Stable counting sort of the faces by mat_nr, batches
+	// run on the pool when one is given
+	void SortByMaterial(BlenderThreadPool *pool);
+
+	// Binned SAH BVH over the faces, node 0 is the root.
+	// Call it after SortByMaterial, which reorders faces.
+	void BuildBVH(BlenderThreadPool *pool);
+
+	// Vertex to face, vertex to edge and edge to face lists
+	// for the final faces, built in parallel on the pool.
+	// Call it after SortByMaterial, which reorders faces.
+	void BuildAdjacency(BlenderThreadPool *pool);
+
+	// Per-vertex tangents from the face UVs, orthogonalized
+	// against area weighted face normals. With vertexUVs the
+	// vertices are already split at UV seams, so every side
+	// of a seam gets its own tangent. The result does not
+	// depend on the number of threads. Builds the vertex to
+	// face lists if BuildAdjacency has not.
+	void GenerateTangents(BlenderThreadPool *pool);
+
+	// One LOD per ratio in (0, 1), each simplified further
+	// from the one before. The LODs have no texture faces,
+	// so UVs come from the vertices (vertexUVs).
+	void GenerateLODs(const std::vector<float> &ratios);
+
+	// Encodes every source but the basis as sparse deltas
+	// against it. Sources must have m_TotalSourceVerts
+	// positions, others are skipped.
+	void EncodeShapeKeys(const std::vector<BlenderShapeKeySource> &sources, int basis, bool flipYZ);
 	
 private:
-	MVert			*ExtractVertices(StructureDNA *sdna, std::vector<BlenderFileBlock> &blocks, bool flipYZ);
-	MFace			*ExtractFaces(StructureDNA *sdna, std::vector<BlenderFileBlock> &blocks);
-	MLoop			*ExtractLoops(StructureDNA *sdna, std::vector<BlenderFileBlock> &blocks);
-	MLoopUV			*ExtractLoopUVs(StructureDNA *sdna, std::vector<BlenderFileBlock> &blocks);
-	MPoly			*ExtractPolys(StructureDNA *sdna, std::vector<BlenderFileBlock> &blocks);
-	MTexPoly		*ExtractTexPolys(StructureDNA *sdna, std::vector<BlenderFileBlock> &blocks);
-	MDeformVert		*ExtractDeformVerts(StructureDNA *sdna, std::vector<BlenderFileBlock> &blocks);
-	MDeformWeight	*ExtractDeformWeights(StructureDNA *sdna, std::vector<BlenderFileBlock> &blocks);
+	// Owns every array above
+	BlenderArena m_Arena;
+
+	void MoveFrom(BlenderMesh &other);
+
+	MVert			*ExtractVertices(StructureDNA *sdna, BlenderSpan<const BlenderFileBlock> blocks, bool flipYZ, bool normals);
+	MEdge			*ExtractEdges(StructureDNA *sdna, BlenderSpan<const BlenderFileBlock> blocks);
+	MFace			*ExtractFaces(StructureDNA *sdna, BlenderSpan<const BlenderFileBlock> blocks);
+	MLoop			*ExtractLoops(StructureDNA *sdna, BlenderSpan<const BlenderFileBlock> blocks);
+	MLoopUV			*ExtractLoopUVs(StructureDNA *sdna, BlenderSpan<const BlenderFileBlock> blocks);
+	MPoly			*ExtractPolys(StructureDNA *sdna, BlenderSpan<const BlenderFileBlock> blocks);
+	MTexPoly		*ExtractTexPolys(StructureDNA *sdna, BlenderSpan<const BlenderFileBlock> blocks);
+	MDeformVert		*ExtractDeformVerts(StructureDNA *sdna, BlenderSpan<const BlenderFileBlock> blocks);
+	MDeformWeight	*ExtractDeformWeights(StructureDNA *sdna, BlenderSpan<const BlenderFileBlock> blocks);
+	void			ExtractAttributes(const std::vector<BlenderAttribute> &layers, bool copy);
+
+	// Every CustomData layer of the group, pointing
+	// into the block payloads
+	static void		CollectLayers(StructureDNA *sdna, BlenderSpan<const BlenderFileBlock> blocks, std::vector<BlenderAttribute> &found);
+
+	// Blender 3.x/4.x layout, read straight from the
+	// attribute arrays when the struct blocks are missing
+	MVert			*ExtractPositions(const std::vector<BlenderAttribute> &layers, bool flipYZ);
+	MLoop			*ExtractCorners(const std::vector<BlenderAttribute> &layers);
+	MPoly			*ExtractPolyOffsets(StructureDNA *sdna, BlenderSpan<const BlenderFileBlock> blocks, const std::vector<BlenderAttribute> &layers);
+	MLoopUV			*ExtractUVAttribute(const std::vector<BlenderAttribute> &layers);
+	MEdge			*ExtractEdgeAttribute(const std::vector<BlenderAttribute> &layers);
+
+	int				GetFaceCorners(const MFace &face) const { return (face.isQuad && !m_Triangulated) ? 4 : 3; }
+	void			BuildVertexFaces(BlenderThreadPool *pool);
+
+	// Checks once that every polygon's loops and every
+	// loop's vertex are in range, the conversion and all
+	// later passes index without checks
+	bool ValidateTopology() const;
 
 	// Convert blender's MPoly format
 	// to the older MFace format
@@ -0,0 +1,159 @@
+#include "BlenderObject.h"
+
+#include <cmath>
+#include <cstring>
+
+void BlenderMultiplyMatrix(float out[4][4], const float a[4][4], const float b[4][4]) {
+	float result[4][4];
+
+	for(int col=0; col < 4; col++) {
+		for(int row=0; row < 4; row++) {
+			result[col][row] = a[0][row] * b[col][0] + a[1][row] * b[col][1] + a[2][row] * b[col][2] + a[3][row] * b[col][3];
+		}
+	}
+
+	memcpy(out, result, sizeof(result));
+}
+
+// Object matrices are affine, so only the 3x3
+// part needs a real inverse
+bool BlenderInvertMatrix(float out[4][4], const float m[4][4]) {
+	float c[3][3];
+	c[0][0] = m[1][1] * m[2][2] - m[2][1] * m[1][2];
+	c[0][1] = m[2][1] * m[0][2] - m[0][1] * m[2][2];
+	c[0][2] = m[0][1] * m[1][2] - m[1][1] * m[0][2];
+	c[1][0] = m[2][0] * m[1][2] - m[1][0] * m[2][2];
+	c[1][1] = m[0][0] * m[2][2] - m[2][0] * m[0][2];
+	c[1][2] = m[1][0] * m[0][2] - m[0][0] * m[1][2];
+	c[2][0] = m[1][0] * m[2][1] - m[2][0] * m[1][1];
+	c[2][1] = m[2][0] * m[0][1] - m[0][0] * m[2][1];
+	c[2][2] = m[0][0] * m[1][1] - m[1][0] * m[0][1];
+
+	float det = m[0][0] * c[0][0] + m[1][0] * c[0][1] + m[2][0] * c[0][2];
+	if(fabsf(det) < 1e-12f) {
+		return false;
+	}
+
+	float result[4][4];
+	for(int col=0; col < 3; col++) {
+		for(int row=0; row < 3; row++) {
+			result[col][row] = c[col][row] / det;
+		}
+
+		result[col][3] = 0.0f;
+	}
+
+	for(int row=0; row < 3; row++) {
+		result[3][row] = -(result[0][row] * m[3][0] + result[1][row] * m[3][1] + result[2][row] * m[3][2]);
+	}
+
+	result[3][3] = 1.0f;
+
+	memcpy(out, result, sizeof(result));
+	return true;
+}
+
+static void AxisRotation(float out[3][3], int axis, float angle) {
+	memset(out, 0, sizeof(float) * 9);
+	out[axis][axis] = 1.0f;
+
+	int a = (axis + 1) % 3;
+	int b = (axis + 2) % 3;
+	out[a][a] = cosf(angle);
+	out[a][b] = sinf(angle);
+	out[b][a] = -sinf(angle);
+	out[b][b] = cosf(angle);
+}
+
+static void MultiplyRotation(float out[3][3], const float a[3][3], const float b[3][3]) {
+	float result[3][3];
+
+	for(int col=0; col < 3; col++) {
+		for(int row=0; row < 3; row++) {
+			result[col][row] = a[0][row] * b[col][0] + a[1][row] * b[col][1] + a[2][row] * b[col][2];
+		}
+	}
+
+	memcpy(out, result, sizeof(result));
+}
+
+// Quaternions are stored w, x, y, z and need not be unit
+static void QuatRotation(float out[3][3], const float quat[4]) {
+	float length = sqrtf(quat[0] * quat[0] + quat[1] * quat[1] + quat[2] * quat[2] + quat[3] * quat[3]);
+	if(length < 1e-12f) {
+		AxisRotation(out, 0, 0.0f);
+		return;
+	}
+
+	float w = quat[0] / length, x = quat[1] / length, y = quat[2] / length, z = quat[3] / length;
+
+	out[0][0] = 1.0f - 2.0f * (y * y + z * z);
+	out[0][1] = 2.0f * (x * y + w * z);
+	out[0][2] = 2.0f * (x * z - w * y);
+	out[1][0] = 2.0f * (x * y - w * z);
+	out[1][1] = 1.0f - 2.0f * (x * x + z * z);
+	out[1][2] = 2.0f * (y * z + w * x);
+	out[2][0] = 2.0f * (x * z + w * y);
+	out[2][1] = 2.0f * (y * z - w * x);
+	out[2][2] = 1.0f - 2.0f * (x * x + y * y);
+}
+
+void BlenderComposeMatrix(float out[4][4], const BlenderTransform &transform) {
+	float rotation[3][3];
+
+	if(transform.rotMode == BLENDER_ROT_QUAT) {
+		QuatRotation(rotation, transform.quat);
+	}
+	else if(transform.rotMode == BLENDER_ROT_AXIS_ANGLE) {
+		float half = 0.5f * transform.rotAngle;
+		float length = sqrtf(transform.rotAxis[0] * transform.rotAxis[0] + transform.rotAxis[1] * transform.rotAxis[1] + transform.rotAxis[2] * transform.rotAxis[2]);
+		float scale = (length < 1e-12f) ? 0.0f : sinf(half) / length;
+		float quat[4] = { cosf(half), transform.rotAxis[0] * scale, transform.rotAxis[1] * scale, transform.rotAxis[2] * scale };
+
+		QuatRotation(rotation, quat);
+	}
+	else {
+		// Axes in the order they are applied, XYZ
+		// is Rz * Ry * Rx. Unknown modes use XYZ.
+		static const int orders[6][3] = { {0, 1, 2}, {0, 2, 1}, {1, 0, 2}, {1, 2, 0}, {2, 0, 1}, {2, 1, 0} };
+		int mode = (transform.rotMode >= BLENDER_ROT_EULER_XYZ && transform.rotMode <= BLENDER_ROT_EULER_ZYX) ? transform.rotMode - 1 : 0;
+		const int *order = orders[mode];
+		float axis[3][3];
+
+		AxisRotation(rotation, order[0], transform.rot[order[0]]);
+		AxisRotation(axis, order[1], transform.rot[order[1]]);
+		MultiplyRotation(rotation, axis, rotation);
+		AxisRotation(axis, order[2], transform.rot[order[2]]);
+		MultiplyRotation(rotation, axis, rotation);
+	}
+
+	for(int col=0; col < 3; col++) {
+		for(int row=0; row < 3; row++) {
+			out[col][row] = rotation[col][row] * transform.size[col];
+		}
+
+		out[col][3] = 0.0f;
+		out[3][col] = transform.loc[col];
+	}
+
+	out[3][3] = 1.0f;
+}
+
+// flipYZ maps (x, y, z) to (x, z, -y), the matrix
+// becomes F * m * F^-1
+void BlenderFlipMatrixYZ(float m[4][4]) {
+	float result[4][4];
+
+	for(int col=0; col < 4; col++) {
+		// Columns: x, y and z swap places like the vectors they hold
+		int src = (col == 1) ? 2 : (col == 2) ? 1 : col;
+		float sign = (col == 2) ? -1.0f : 1.0f;
+
+		result[col][0] = sign * m[src][0];
+		result[col][1] = sign * m[src][2];
+		result[col][2] = sign * -m[src][1];
+		result[col][3] = sign * m[src][3];
+	}
+
+	memcpy(m, result, sizeof(result));
+}
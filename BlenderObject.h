@@ -0,0 +1,77 @@
+#pragma once
+
+#include <string>
+
+// Object types as stored in Object.type
+enum BlenderObjectType {
+	BLENDER_OBJECT_EMPTY	= 0,
+	BLENDER_OBJECT_MESH		= 1,
+	BLENDER_OBJECT_CAMERA	= 11,
+	BLENDER_OBJECT_LAMP		= 10,
+	BLENDER_OBJECT_ARMATURE	= 25
+};
+
+// Matrices are column-major as in Blender, matrix[3]
+// holds the translation. World matrices are the obmat
+// Blender saved, so constraints and drivers are baked in.
+// Files without one get them composed from loc, rot and
+// size and the parent chain, without constraints.
+struct BlenderObject {
+	std::string name;
+	short type;
+
+	// Index into the file's meshes, -1 if the object
+	// has no mesh or the mesh was not loaded
+	int meshIndex;
+
+	// Index into the file's linked IDs when the object's
+	// data is linked from a library, -1 otherwise
+	int linkedIndex;
+
+	// Index into the file's objects, parents always come
+	// before their children. -1 for root objects.
+	int parentIndex;
+	unsigned int depth;
+
+	float local[4][4];
+	float world[4][4];
+};
+
+// One placement of a mesh, many instances may
+// share the same mesh
+struct BlenderInstance {
+	// With linkedIndex other than -1, meshIndex is a mesh
+	// of that linked ID's file
+	int meshIndex;
+	int linkedIndex;
+	int objectIndex;
+	float world[4][4];
+};
+
+// Object.rotmode values, the Euler orders run from 1 to 6
+enum BlenderRotationMode {
+	BLENDER_ROT_AXIS_ANGLE	= -1,
+	BLENDER_ROT_QUAT		= 0,
+	BLENDER_ROT_EULER_XYZ	= 1,
+	BLENDER_ROT_EULER_ZYX	= 6
+};
+
+// Object transform channels as stored in the file
+struct BlenderTransform {
+	float loc[3];
+	float rot[3];
+	float quat[4];
+	float rotAxis[3];
+	float rotAngle;
+	float size[3];
+	short rotMode;
+};
+
+void BlenderMultiplyMatrix(float out[4][4], const float a[4][4], const float b[4][4]);
+bool BlenderInvertMatrix(float out[4][4], const float m[4][4]);
+
+// loc * rotation * size, as Blender builds an object's basis
+void BlenderComposeMatrix(float out[4][4], const BlenderTransform &transform);
+
+// Converts a matrix to the space flipYZ puts vertices in
+void BlenderFlipMatrixYZ(float m[4][4]);
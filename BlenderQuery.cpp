@@ -0,0 +1,146 @@
+#include "BlenderQuery.h"
+#include "BlenderImporter.h"
+
+#include <cstring>
+
+// "*next" -> "next", "loc[3]" -> "loc", "(*func)()" -> "func"
+static std::string GetBareName(const std::string &name) {
+	size_t start = name.find_first_not_of("*(");
+	if(start == std::string::npos) {
+		return "";
+	}
+
+	size_t end = name.find_first_of("[)", start);
+	return name.substr(start, end == std::string::npos ? std::string::npos : end - start);
+}
+
+// Matches either the SDNA name as written or its bare identifier
+static const Field *FindField(const StructureDNA *sdna, const Structure &structure, const std::string &name) {
+	for(unsigned int i=0; i < structure.fields.size(); i++) {
+		const std::string &fieldName = sdna->GetName(structure.fields[i].name_idx);
+
+		if(fieldName == name || GetBareName(fieldName) == name) {
+			return &structure.fields[i];
+		}
+	}
+
+	return 0;
+}
+
+///////////////////////////////////////
+// BlenderFieldAccessor implementation
+///////////////////////////////////////
+BlenderFieldAccessor::BlenderFieldAccessor() {
+	m_SDNA = 0;
+	m_Offset = -1;
+	m_StructLength = 0;
+	m_ElementSize = 0;
+	m_NumElements = 0;
+	m_TypeIdx = 0;
+	m_IsPointer = false;
+}
+
+BlenderFieldAccessor::BlenderFieldAccessor(const StructureDNA *sdna, unsigned int sdnaIndex, const std::string &path, unsigned short pointerSize) {
+	m_SDNA = sdna;
+	m_Offset = -1;
+	m_StructLength = 0;
+	m_ElementSize = 0;
+	m_NumElements = 0;
+	m_TypeIdx = 0;
+	m_IsPointer = false;
+
+	if(!sdna || sdnaIndex >= sdna->structures.size()) {
+		return;
+	}
+
+	const Structure *structure = &sdna->structures[sdnaIndex];
+	unsigned int structLength = sdna->lengths[structure->type_idx];
+	int offset = 0;
+	size_t start = 0;
+
+	// Walk the path one nested struct at a time
+	while(true) {
+		size_t dot = path.find('.', start);
+		std::string part = path.substr(start, dot == std::string::npos ? std::string::npos : dot - start);
+
+		const Field *field = FindField(sdna, *structure, part);
+		if(!field) {
+			return;
+		}
+
+		const std::string &name = sdna->GetName(field->name_idx);
+		offset += field->offset;
+
+		if(dot == std::string::npos) {
+			m_IsPointer = (name[0] == '*' || name[0] == '(');
+			m_ElementSize = m_IsPointer ? pointerSize : sdna->lengths[field->type_idx];
+			if(m_ElementSize == 0) {
+				return;
+			}
+
+			m_NumElements = BlenderImporter::ComputeFieldLength(name, sdna->lengths[field->type_idx], pointerSize) / m_ElementSize;
+			m_TypeIdx = field->type_idx;
+			m_StructLength = structLength;
+			m_Offset = offset;
+			return;
+		}
+
+		if(name[0] == '*' || name[0] == '(') {
+			return;
+		}
+
+		structure = sdna->GetStructureByTypeIndex(field->type_idx);
+		if(!structure) {
+			return;
+		}
+
+		start = dot + 1;
+	}
+}
+
+std::string BlenderFieldAccessor::GetString(const BlenderFileBlock &block, unsigned int instance) const {
+	assert(IsString());
+	if(!IsString()) {
+		return std::string();
+	}
+
+	const char *text = (const char *)&block.GetBuffer()[m_Offset + instance * m_StructLength];
+	return std::string(text, strnlen(text, m_NumElements));
+}
+
+const void *BlenderFieldAccessor::GetPointer(const BlenderFileBlock &block, unsigned int instance, unsigned int element) const {
+	assert(IsValid() && m_IsPointer && element < m_NumElements);
+	if(!IsValid() || !m_IsPointer || element >= m_NumElements) {
+		return 0;
+	}
+
+	return block.GetOldPointer(m_Offset + instance * m_StructLength + element * m_ElementSize, (unsigned short)m_ElementSize);
+}
+
+////////////////////////////////////
+// BlenderBlockQuery implementation
+////////////////////////////////////
+BlenderBlockQuery::BlenderBlockQuery(const StructureDNA *sdna, int sdnaIndex, BlenderSpan<const BlenderFileBlock *const> blocks, unsigned short pointerSize) {
+	m_SDNA = sdna;
+	m_SDNAIndex = sdnaIndex;
+	m_Blocks = blocks;
+	m_PointerSize = pointerSize;
+}
+
+const std::string &BlenderBlockQuery::GetType() const {
+	assert(IsValid());
+	return m_SDNA->GetType(m_SDNA->structures[m_SDNAIndex].type_idx);
+}
+
+unsigned int BlenderBlockQuery::GetStructLength() const {
+	assert(IsValid());
+	return m_SDNA->lengths[m_SDNA->structures[m_SDNAIndex].type_idx];
+}
+
+BlenderFieldAccessor BlenderBlockQuery::GetField(const std::string &path) const {
+	if(!IsValid()) {
+		return BlenderFieldAccessor();
+	}
+
+	return BlenderFieldAccessor(m_SDNA, m_SDNAIndex, path, m_PointerSize);
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <string>
+#include <cassert>
+
+#include "BlenderStructure.h"
+#include "BlenderFileBlock.h"
+#include "BlenderSpan.h"
+
+////////////////////////////////////////////////
+// BlenderFieldAccessor
+//
+// A field of an SDNA struct, resolved once from
+// a path like "loc" or "id.name". Reading it is
+// then an offset add, with no name lookups.
+////////////////////////////////////////////////
+class BlenderFieldAccessor {
+public:
+	BlenderFieldAccessor();
+	BlenderFieldAccessor(const StructureDNA *sdna, unsigned int sdnaIndex, const std::string &path, unsigned short pointerSize);
+
+	bool IsValid() const			{ return m_Offset >= 0; }
+	bool IsPointer() const			{ return m_IsPointer; }
+	int GetOffset() const			{ return m_Offset; }
+	unsigned int GetSize() const	{ return m_ElementSize * m_NumElements; }
+
+	// Array fields like loc[3] or mat[4][4] have
+	// several elements, flattened in order
+	unsigned int GetNumElements() const	{ return m_NumElements; }
+	const std::string &GetType() const	{ assert(IsValid()); return m_SDNA->GetType(m_TypeIdx); }
+
+	// The file decides the width of every field, so check
+	// it before reading, e.g. IsShort() before GetShort()
+	bool IsInt() const		{ return IsInline(sizeof(int)) && m_NumElements == 1; }
+	bool IsShort() const	{ return IsInline(sizeof(short)) && m_NumElements == 1; }
+	bool IsFloat() const	{ return IsInline(sizeof(float)) && m_NumElements == 1; }
+	bool IsChar() const		{ return IsInline(sizeof(char)) && m_NumElements == 1; }
+	bool IsString() const	{ return IsInline(sizeof(char)); }
+
+	// instance selects the struct within the block,
+	// T must match the size of the SDNA type. A field
+	// of another width reads as 0.
+	template<typename T>
+	T Get(const BlenderFileBlock &block, unsigned int instance = 0, unsigned int element = 0) const {
+		assert(IsValid() && sizeof(T) == m_ElementSize && element < m_NumElements);
+		if(!IsValid() || sizeof(T) != m_ElementSize || element >= m_NumElements) {
+			return T();
+		}
+
+		return block.GetValue<T>(m_Offset + instance * m_StructLength + element * m_ElementSize);
+	}
+
+	float GetFloat(const BlenderFileBlock &block, unsigned int instance = 0, unsigned int element = 0) const	{ return Get<float>(block, instance, element); }
+	int GetInt(const BlenderFileBlock &block, unsigned int instance = 0, unsigned int element = 0) const		{ return Get<int>(block, instance, element); }
+	short GetShort(const BlenderFileBlock &block, unsigned int instance = 0, unsigned int element = 0) const	{ return Get<short>(block, instance, element); }
+	char GetChar(const BlenderFileBlock &block, unsigned int instance = 0, unsigned int element = 0) const		{ return Get<char>(block, instance, element); }
+
+	// Text of a char array, up to the first 0 or the end of
+	// the field. Empty for fields that are not char arrays.
+	std::string GetString(const BlenderFileBlock &block, unsigned int instance = 0) const;
+
+	// The old memory address stored in a pointer field,
+	// look the target up with BlenderFile::FindBlock. Null
+	// for fields that are not pointers.
+	const void *GetPointer(const BlenderFileBlock &block, unsigned int instance = 0, unsigned int element = 0) const;
+
+private:
+	bool IsInline(unsigned int size) const { return IsValid() && !m_IsPointer && m_ElementSize == size; }
+
+	const StructureDNA *m_SDNA;
+	int m_Offset;
+	unsigned int m_StructLength;
+	unsigned int m_ElementSize;
+	unsigned int m_NumElements;
+	unsigned short m_TypeIdx;
+	bool m_IsPointer;
+};
+
+////////////////////////////////////////////////
+// BlenderBlockQuery
+//
+// Every retained block of one SDNA struct, taken
+// from the file's block index. Only valid while
+// the file keeps its blocks.
+////////////////////////////////////////////////
+class BlenderBlockQuery {
+public:
+	BlenderBlockQuery() { m_SDNA = 0; m_SDNAIndex = -1; m_PointerSize = 0; }
+	BlenderBlockQuery(const StructureDNA *sdna, int sdnaIndex, BlenderSpan<const BlenderFileBlock *const> blocks, unsigned short pointerSize);
+
+	// False if the file has no struct of that type
+	bool IsValid() const { return m_SDNAIndex >= 0; }
+	const std::string &GetType() const;
+	unsigned int GetStructLength() const;
+
+	size_t size() const { return m_Blocks.size(); }
+	bool empty() const { return m_Blocks.empty(); }
+	const BlenderFileBlock &operator[](size_t i) const { return *m_Blocks[i]; }
+	const BlenderFileBlock *const *begin() const { return m_Blocks.begin(); }
+	const BlenderFileBlock *const *end() const { return m_Blocks.end(); }
+
+	// Resolve fields once, outside the loop over blocks
+	BlenderFieldAccessor GetField(const std::string &path) const;
+
+private:
+	const StructureDNA *m_SDNA;
+	int m_SDNAIndex;
+	BlenderSpan<const BlenderFileBlock *const> m_Blocks;
+	unsigned short m_PointerSize;
+};
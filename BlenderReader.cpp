@@ -0,0 +1,480 @@
+#include "BlenderReader.h"
+
+#include <cstring>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+//////////////////////////////////
+// BlenderSource implementation
+//////////////////////////////////
+BlenderSource BlenderSource::File(const std::string &filename) {
+	BlenderSource source;
+	source.type = BLENDER_SOURCE_FILE;
+	source.filename = filename;
+	return source;
+}
+
+BlenderSource BlenderSource::Mapped(const std::string &filename) {
+	BlenderSource source;
+	source.type = BLENDER_SOURCE_MAPPED;
+	source.filename = filename;
+	return source;
+}
+
+BlenderSource BlenderSource::Memory(const void *data, size_t size, const std::string &name) {
+	BlenderSource source;
+	source.type = BLENDER_SOURCE_MEMORY;
+	source.filename = name;
+	source.data = data;
+	source.size = size;
+	return source;
+}
+
+BlenderSource BlenderSource::Callback(size_t (*read)(void *, size_t, void *), bool (*seek)(size_t, void *), size_t size, void *userData, const std::string &name) {
+	BlenderSource source;
+	source.type = BLENDER_SOURCE_CALLBACK;
+	source.filename = name;
+	source.size = size;
+	source.read = read;
+	source.seek = seek;
+	source.userData = userData;
+	return source;
+}
+
+//////////////////////////////////////
+// BlenderFileReader implementation
+//////////////////////////////////////
+bool BlenderFileReader::Open(const std::string &filename) {
+	m_File.open(filename.c_str(), std::fstream::in | std::fstream::binary);
+
+	if(!m_File.is_open()) {
+		return false;
+	}
+
+	m_File.seekg(0, std::ios::end);
+	m_Size = (size_t)m_File.tellg();
+	m_File.seekg(0);
+
+	return true;
+}
+
+size_t BlenderFileReader::Read(void *dest, size_t size) {
+	m_File.read((char *)dest, size);
+	return (size_t)m_File.gcount();
+}
+
+void BlenderFileReader::Skip(size_t size) {
+	m_File.seekg(size, std::ios::cur);
+}
+
+void BlenderFileReader::Seek(size_t position) {
+	m_File.clear();
+	m_File.seekg(position);
+}
+
+size_t BlenderFileReader::Tell() {
+	return (size_t)m_File.tellg();
+}
+
+bool BlenderFileReader::Good() {
+	return m_File.good();
+}
+
+////////////////////////////////////////
+// BlenderMemoryReader implementation
+////////////////////////////////////////
+size_t BlenderMemoryReader::Read(void *dest, size_t size) {
+	size_t available = (m_Position < m_Size) ? m_Size - m_Position : 0;
+	size_t count = (size < available) ? size : available;
+
+	if(count) {
+		memcpy(dest, &m_Data[m_Position], count);
+	}
+
+	m_Position += count;
+	if(count < size) {
+		m_Good = false;
+	}
+
+	return count;
+}
+
+// Blender keeps payloads 4 byte aligned, a buffer
+// that is not gets its payloads copied
+const unsigned char *BlenderMemoryReader::Map(size_t size) {
+	if(m_Position > m_Size || size > m_Size - m_Position || ((size_t)&m_Data[m_Position] & 3) != 0) {
+		return 0;
+	}
+
+	const unsigned char *data = &m_Data[m_Position];
+	m_Position += size;
+
+	return data;
+}
+
+//////////////////////////////////////
+// BlenderMappedFile implementation
+//////////////////////////////////////
+BlenderMappedFile::BlenderMappedFile() {
+	m_Data = 0;
+	m_Size = 0;
+
+#ifdef _WIN32
+	m_File = INVALID_HANDLE_VALUE;
+	m_Mapping = 0;
+#endif
+}
+
+#ifdef _WIN32
+bool BlenderMappedFile::Open(const std::string &filename) {
+	m_File = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+	if(m_File == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+
+	LARGE_INTEGER size;
+	if(!GetFileSizeEx(m_File, &size)) {
+		return false;
+	}
+
+	m_Size = (size_t)size.QuadPart;
+	if(m_Size == 0) {
+		return true;
+	}
+
+	m_Mapping = CreateFileMappingA(m_File, 0, PAGE_READONLY, 0, 0, 0);
+	if(!m_Mapping) {
+		return false;
+	}
+
+	m_Data = (const unsigned char *)MapViewOfFile(m_Mapping, FILE_MAP_READ, 0, 0, 0);
+	return m_Data != 0;
+}
+
+BlenderMappedFile::~BlenderMappedFile() {
+	if(m_Data) {
+		UnmapViewOfFile(m_Data);
+	}
+
+	if(m_Mapping) {
+		CloseHandle(m_Mapping);
+	}
+
+	if(m_File != INVALID_HANDLE_VALUE) {
+		CloseHandle(m_File);
+	}
+}
+#else
+bool BlenderMappedFile::Open(const std::string &filename) {
+	int file = open(filename.c_str(), O_RDONLY);
+	if(file == -1) {
+		return false;
+	}
+
+	struct stat info;
+	if(fstat(file, &info) != 0) {
+		close(file);
+		return false;
+	}
+
+	m_Size = (size_t)info.st_size;
+
+	// The mapping stays valid once the descriptor is closed
+	void *data = (m_Size != 0) ? mmap(0, m_Size, PROT_READ, MAP_PRIVATE, file, 0) : 0;
+	close(file);
+
+	if(data == MAP_FAILED) {
+		m_Size = 0;
+		return false;
+	}
+
+	m_Data = (const unsigned char *)data;
+	return true;
+}
+
+BlenderMappedFile::~BlenderMappedFile() {
+	if(m_Data) {
+		munmap((void *)m_Data, m_Size);
+	}
+}
+#endif
+
+//////////////////////////////////////////
+// BlenderCallbackReader implementation
+//////////////////////////////////////////
+BlenderCallbackReader::BlenderCallbackReader(const BlenderSource &source) {
+	m_Read = source.read;
+	m_Seek = source.seek;
+	m_UserData = source.userData;
+	m_Size = source.size;
+	m_Position = 0;
+	m_Good = true;
+}
+
+size_t BlenderCallbackReader::Read(void *dest, size_t size) {
+	size_t count = m_Read(dest, size, m_UserData);
+
+	m_Position += count;
+	if(count < size) {
+		m_Good = false;
+	}
+
+	return count;
+}
+
+void BlenderCallbackReader::Skip(size_t size) {
+	m_Position += size;
+
+	if(!m_Seek(m_Position, m_UserData)) {
+		m_Good = false;
+	}
+}
+
+void BlenderCallbackReader::Seek(size_t position) {
+	m_Position = position;
+	m_Good = m_Seek(position, m_UserData);
+}
+
+//////////////////////////////////////////
+// BlenderReadAheadReader implementation
+//////////////////////////////////////////
+BlenderReadAheadReader::BlenderReadAheadReader(size_t chunkSize, unsigned int numChunks) {
+	m_Chunks.resize(numChunks < 2 ? 2 : numChunks);
+
+	for(unsigned int i=0; i < m_Chunks.size(); i++) {
+		m_Chunks[i].data.resize(chunkSize);
+		m_Chunks[i].offset = 0;
+		m_Chunks[i].size = 0;
+		m_Chunks[i].generation = 0;
+		m_Free.push_back(&m_Chunks[i]);
+	}
+
+	m_Size = 0;
+	m_Generation = 0;
+	m_ReadOffset = 0;
+	m_EndOfFile = false;
+	m_Stop = false;
+
+	m_Current = 0;
+	m_CurrentPos = 0;
+	m_Position = 0;
+	m_Good = true;
+}
+
+BlenderReadAheadReader::~BlenderReadAheadReader() {
+	Stop();
+}
+
+bool BlenderReadAheadReader::Open(const std::string &filename) {
+	m_File.open(filename.c_str(), std::fstream::in | std::fstream::binary);
+
+	if(!m_File.is_open()) {
+		return false;
+	}
+
+	m_File.seekg(0, std::ios::end);
+	m_Size = (size_t)m_File.tellg();
+	m_File.seekg(0);
+
+	m_Thread = std::thread(&BlenderReadAheadReader::ReadThread, this);
+	return true;
+}
+
+void BlenderReadAheadReader::Stop() {
+	if(!m_Thread.joinable()) {
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Stop = true;
+	}
+
+	m_ChunkFree.notify_all();
+	m_Thread.join();
+}
+
+void BlenderReadAheadReader::ReadThread() {
+	size_t filePos = 0;
+
+	while(true) {
+		Chunk *chunk;
+		unsigned int generation;
+		size_t offset;
+
+		{
+			std::unique_lock<std::mutex> lock(m_Mutex);
+			m_ChunkFree.wait(lock, [this] { return m_Stop || (!m_Free.empty() && !m_EndOfFile); });
+
+			if(m_Stop) {
+				return;
+			}
+
+			chunk = m_Free.back();
+			m_Free.pop_back();
+
+			generation = m_Generation;
+			offset = m_ReadOffset;
+			m_ReadOffset += chunk->data.size();
+		}
+
+		// The actual read happens outside the lock
+		BLENDER_TRACE_SCOPE("BlenderReadAheadReader::ReadChunk");
+
+		if(offset != filePos) {
+			m_File.clear();
+			m_File.seekg(offset);
+		}
+
+		m_File.read(&chunk->data[0], chunk->data.size());
+		size_t size = (size_t)m_File.gcount();
+		filePos = offset + size;
+
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+
+			if(generation != m_Generation || size == 0) {
+				// Stale after a seek, or nothing left to read
+				m_Free.push_back(chunk);
+				if(generation == m_Generation) {
+					m_EndOfFile = true;
+				}
+			}
+			else {
+				chunk->offset = offset;
+				chunk->size = size;
+				chunk->generation = generation;
+				m_Ready.push_back(chunk);
+
+				if(size < chunk->data.size()) {
+					m_EndOfFile = true;
+				}
+			}
+		}
+
+		m_ChunkReady.notify_one();
+	}
+}
+
+// Hands the current chunk back to the read thread
+// and waits for the next one in sequence
+bool BlenderReadAheadReader::NextChunk() {
+	std::unique_lock<std::mutex> lock(m_Mutex);
+
+	if(m_Current) {
+		m_Free.push_back(m_Current);
+		m_Current = 0;
+		m_ChunkFree.notify_one();
+	}
+
+	while(true) {
+		m_ChunkReady.wait(lock, [this] { return !m_Ready.empty() || m_EndOfFile; });
+
+		if(m_Ready.empty()) {
+			return false;
+		}
+
+		Chunk *chunk = m_Ready.front();
+		m_Ready.pop_front();
+
+		if(chunk->generation == m_Generation) {
+			m_Current = chunk;
+			m_CurrentPos = m_Position - chunk->offset;
+			return true;
+		}
+
+		m_Free.push_back(chunk);
+		m_ChunkFree.notify_one();
+	}
+}
+
+size_t BlenderReadAheadReader::Read(void *dest, size_t size) {
+	size_t done = 0;
+
+	while(done < size) {
+		if(!m_Current || m_CurrentPos >= m_Current->size) {
+			if(!NextChunk()) {
+				m_Good = false;
+				break;
+			}
+
+			continue;
+		}
+
+		size_t n = m_Current->size - m_CurrentPos;
+		if(n > size - done) {
+			n = size - done;
+		}
+
+		if(dest) {
+			memcpy((char *)dest + done, &m_Current->data[m_CurrentPos], n);
+		}
+
+		done += n;
+		m_CurrentPos += n;
+		m_Position += n;
+	}
+
+	return done;
+}
+
+// Short skips consume buffered data, long ones
+// restart the read thread past the gap
+void BlenderReadAheadReader::Skip(size_t size) {
+	if(size > 2 * m_Chunks[0].data.size()) {
+		Seek(m_Position + size);
+	}
+	else {
+		Read(0, size);
+	}
+}
+
+void BlenderReadAheadReader::Seek(size_t position) {
+	m_Good = true;
+
+	// Seeks inside the current chunk need no I/O
+	if(m_Current && position >= m_Current->offset && position <= m_Current->offset + m_Current->size) {
+		m_CurrentPos = position - m_Current->offset;
+		m_Position = position;
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+
+		m_Generation += 1;
+
+		while(!m_Ready.empty()) {
+			m_Free.push_back(m_Ready.front());
+			m_Ready.pop_front();
+		}
+
+		if(m_Current) {
+			m_Free.push_back(m_Current);
+			m_Current = 0;
+		}
+
+		m_ReadOffset = position;
+		m_EndOfFile = false;
+		m_Position = position;
+	}
+
+	m_ChunkFree.notify_all();
+}
+
+size_t BlenderReadAheadReader::Tell() {
+	return m_Position;
+}
+
+bool BlenderReadAheadReader::Good() {
+	return m_Good;
+}
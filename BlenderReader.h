@@ -0,0 +1,211 @@
+#pragma once
+
+#include <fstream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "BlenderTrace.h"
+
+enum BlenderSourceType {
+	BLENDER_SOURCE_FILE,
+	BLENDER_SOURCE_MAPPED,
+	BLENDER_SOURCE_MEMORY,
+	BLENDER_SOURCE_CALLBACK
+};
+
+// Where a .blend is read from, see BlenderFile's constructor
+struct BlenderSource {
+	BlenderSourceType type = BLENDER_SOURCE_FILE;
+
+	// The path of file and mapped sources. Other sources may
+	// set it as well, it names the file and "//" library
+	// paths are resolved against its directory.
+	std::string filename;
+
+	// Memory sources, owned by the caller. Block payloads
+	// point into it, so it has to outlive the file.
+	const void *data = 0;
+	size_t size = 0;
+
+	// Callback sources, size is the length of the stream. read
+	// returns the number of bytes it read, seek false if the
+	// position cannot be reached. They are called again by
+	// BlenderFile::LoadPackedFile after the load.
+	size_t (*read)(void *dest, size_t size, void *userData) = 0;
+	bool (*seek)(size_t position, void *userData) = 0;
+	void *userData = 0;
+
+	static BlenderSource File(const std::string &filename);
+	static BlenderSource Mapped(const std::string &filename);
+	static BlenderSource Memory(const void *data, size_t size, const std::string &name = "");
+	static BlenderSource Callback(size_t (*read)(void *, size_t, void *), bool (*seek)(size_t, void *), size_t size, void *userData, const std::string &name = "");
+};
+
+////////////////////////////////////////////////
+// BlenderReader
+//
+// The byte source the block parser runs over.
+// Positions are absolute offsets into the file.
+////////////////////////////////////////////////
+class BlenderReader {
+public:
+	virtual ~BlenderReader() {}
+
+	// Returns the number of bytes actually read
+	virtual size_t Read(void *dest, size_t size) = 0;
+	virtual void Skip(size_t size) = 0;
+	virtual void Seek(size_t position) = 0;
+	virtual size_t Tell() = 0;
+	virtual size_t Size() = 0;
+
+	// False once a read has come up short
+	virtual bool Good() = 0;
+
+	// Readers over memory return the next size bytes in place
+	// and move past them, so payloads need no copy. Null if the
+	// bytes have to be copied with Read instead.
+	virtual const unsigned char *Map(size_t /*size*/) { return 0; }
+};
+
+// Plain synchronous reads through std::fstream
+class BlenderFileReader : public BlenderReader {
+public:
+	BlenderFileReader() { m_Size = 0; }
+
+	bool Open(const std::string &filename);
+
+	size_t Read(void *dest, size_t size);
+	void Skip(size_t size);
+	void Seek(size_t position);
+	size_t Tell();
+	size_t Size() { return m_Size; }
+	bool Good();
+
+private:
+	std::fstream m_File;
+	size_t m_Size;
+};
+
+// Reads from memory, a caller's buffer or a mapped file
+class BlenderMemoryReader : public BlenderReader {
+public:
+	BlenderMemoryReader(const unsigned char *data, size_t size) { m_Data = data; m_Size = size; m_Position = 0; m_Good = true; }
+
+	size_t Read(void *dest, size_t size);
+	void Skip(size_t size) { m_Position += size; }
+	void Seek(size_t position) { m_Position = position; m_Good = true; }
+	size_t Tell() { return m_Position; }
+	size_t Size() { return m_Size; }
+	bool Good() { return m_Good; }
+	const unsigned char *Map(size_t size);
+
+private:
+	const unsigned char *m_Data;
+	size_t m_Size;
+	size_t m_Position;
+	bool m_Good;
+};
+
+// A read-only mapping of a whole file. Block payloads
+// point into it, so the BlenderFile that mapped it keeps
+// it until it is destroyed.
+class BlenderMappedFile {
+public:
+	BlenderMappedFile();
+	~BlenderMappedFile();
+
+	BlenderMappedFile(const BlenderMappedFile &) = delete;
+	BlenderMappedFile &operator=(const BlenderMappedFile &) = delete;
+
+	bool Open(const std::string &filename);
+	const unsigned char *GetData() const { return m_Data; }
+	size_t GetSize() const { return m_Size; }
+
+private:
+	const unsigned char *m_Data;
+	size_t m_Size;
+
+#ifdef _WIN32
+	void *m_File;
+	void *m_Mapping;
+#endif
+};
+
+// Reads through the read and seek callbacks of a source
+class BlenderCallbackReader : public BlenderReader {
+public:
+	BlenderCallbackReader(const BlenderSource &source);
+
+	size_t Read(void *dest, size_t size);
+	void Skip(size_t size);
+	void Seek(size_t position);
+	size_t Tell() { return m_Position; }
+	size_t Size() { return m_Size; }
+	bool Good() { return m_Good; }
+
+private:
+	size_t (*m_Read)(void *dest, size_t size, void *userData);
+	bool (*m_Seek)(size_t position, void *userData);
+	void *m_UserData;
+	size_t m_Size;
+	size_t m_Position;
+	bool m_Good;
+};
+
+// Reads ahead on a background thread, keeping up to numChunks
+// chunks of chunkSize bytes in flight, so the parser and the
+// extraction workers rarely wait on the disk
+class BlenderReadAheadReader : public BlenderReader {
+public:
+	BlenderReadAheadReader(size_t chunkSize, unsigned int numChunks);
+	~BlenderReadAheadReader();
+
+	bool Open(const std::string &filename);
+
+	size_t Read(void *dest, size_t size);
+	void Skip(size_t size);
+	void Seek(size_t position);
+	size_t Tell();
+	size_t Size() { return m_Size; }
+	bool Good();
+
+private:
+	struct Chunk {
+		std::vector<char> data;
+		size_t offset;
+		size_t size;
+		unsigned int generation;
+	};
+
+	void ReadThread();
+	bool NextChunk();
+	void Stop();
+
+	std::fstream m_File;
+	size_t m_Size;
+	std::thread m_Thread;
+	std::mutex m_Mutex;
+	std::condition_variable m_ChunkReady;
+	std::condition_variable m_ChunkFree;
+
+	std::vector<Chunk> m_Chunks;
+	std::deque<Chunk *> m_Ready;
+	std::vector<Chunk *> m_Free;
+
+	// Seek restarts the read thread at m_ReadOffset,
+	// chunks from an older generation are discarded
+	unsigned int m_Generation;
+	size_t m_ReadOffset;
+	bool m_EndOfFile;
+	bool m_Stop;
+
+	// Consumer side, only touched by the parsing thread
+	Chunk *m_Current;
+	size_t m_CurrentPos;
+	size_t m_Position;
+	bool m_Good;
+};
@@ -0,0 +1,334 @@
+#include "BlenderSimplify.h"
+
+#include "BlenderMesh.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+static void Subtract(const float a[3], const float b[3], double out[3]) {
+	out[0] = (double)a[0] - b[0];
+	out[1] = (double)a[1] - b[1];
+	out[2] = (double)a[2] - b[2];
+}
+
+static void Cross(const double a[3], const double b[3], double out[3]) {
+	out[0] = a[1] * b[2] - a[2] * b[1];
+	out[1] = a[2] * b[0] - a[0] * b[2];
+	out[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+static void TriangleNormal(const float p0[3], const float p1[3], const float p2[3], double normal[3]) {
+	double e1[3], e2[3];
+	Subtract(p1, p0, e1);
+	Subtract(p2, p0, e2);
+	Cross(e1, e2, normal);
+}
+
+//////////////////////////////////////
+// BlenderSimplifier implementation
+//////////////////////////////////////
+BlenderSimplifier::BlenderSimplifier(const MVert *vertices, int numVertices, const MFace *faces, const MTFace *texFaces, int numFaces, bool triangulated) {
+	m_Vertices = vertices;
+	m_NumVertices = numVertices;
+	m_Error = 0.0;
+
+	// Keeps the face corner of every triangle
+	// corner, to find UV seams
+	std::vector<int> corners;
+
+	for(int i=0; i < numFaces; i++) {
+		const MFace &face = faces[i];
+		int numCorners = (face.isQuad && !triangulated) ? 4 : 3;
+
+		for(int t=1; t+1 < numCorners; t++) {
+			m_Triangles.push_back(face.v[0]);
+			m_Triangles.push_back(face.v[t]);
+			m_Triangles.push_back(face.v[t+1]);
+			m_Materials.push_back(face.mat_nr);
+
+			corners.push_back(i * 4);
+			corners.push_back(i * 4 + t);
+			corners.push_back(i * 4 + t + 1);
+		}
+	}
+
+	ComputeQuadrics();
+	FindBorders(texFaces, corners);
+}
+
+// Every vertex starts with the planes of its triangles,
+// weighted by the triangle area
+void BlenderSimplifier::ComputeQuadrics() {
+	Quadric zero = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+	m_Quadrics.assign(m_NumVertices, zero);
+
+	for(size_t t=0; t < m_Materials.size(); t++) {
+		const int *v = &m_Triangles[t * 3];
+		double n[3];
+		TriangleNormal(m_Vertices[v[0]].co, m_Vertices[v[1]].co, m_Vertices[v[2]].co, n);
+
+		double length = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+		if(length <= 0.0) {
+			continue;
+		}
+
+		double area = 0.5 * length;
+		double a = n[0] / length, b = n[1] / length, c = n[2] / length;
+		const float *p = m_Vertices[v[0]].co;
+		double d = -(a * p[0] + b * p[1] + c * p[2]);
+
+		for(int j=0; j < 3; j++) {
+			Quadric &q = m_Quadrics[v[j]];
+			q.a2 += area * a * a;	q.ab += area * a * b;	q.ac += area * a * c;	q.ad += area * a * d;
+			q.b2 += area * b * b;	q.bc += area * b * c;	q.bd += area * b * d;
+			q.c2 += area * c * c;	q.cd += area * c * d;
+			q.d2 += area * d * d;
+		}
+	}
+}
+
+// Sorts the triangle edges so the triangles sharing an edge
+// are adjacent. Edges with one triangle, more than two, two
+// different materials or different UVs on each side mark
+// both their vertices as border vertices.
+void BlenderSimplifier::FindBorders(const MTFace *texFaces, const std::vector<int> &corners) {
+	struct Edge {
+		int a, b;
+		int triangle;
+		int cornerA, cornerB;
+
+		bool operator<(const Edge &other) const {
+			if(a != other.a) return a < other.a;
+			if(b != other.b) return b < other.b;
+			return triangle < other.triangle;
+		}
+	};
+
+	std::vector<Edge> edges;
+	edges.reserve(m_Triangles.size());
+
+	for(size_t t=0; t < m_Materials.size(); t++) {
+		for(int j=0; j < 3; j++) {
+			int k = (j + 1) % 3;
+			int a = m_Triangles[t * 3 + j], b = m_Triangles[t * 3 + k];
+			int cornerA = corners[t * 3 + j], cornerB = corners[t * 3 + k];
+
+			if(a > b) {
+				std::swap(a, b);
+				std::swap(cornerA, cornerB);
+			}
+
+			Edge edge = { a, b, (int)t, cornerA, cornerB };
+			edges.push_back(edge);
+		}
+	}
+
+	std::sort(edges.begin(), edges.end());
+	m_Border.assign(m_NumVertices, 0);
+
+	for(size_t i=0; i < edges.size(); ) {
+		size_t end = i + 1;
+		while(end < edges.size() && edges[end].a == edges[i].a && edges[end].b == edges[i].b) {
+			end++;
+		}
+
+		bool border = (end - i != 2);
+
+		if(!border && m_Materials[edges[i].triangle] != m_Materials[edges[i+1].triangle]) {
+			border = true;
+		}
+
+		if(!border && texFaces) {
+			const Edge &e0 = edges[i];
+			const Edge &e1 = edges[i+1];
+			const float *uvA0 = texFaces[e0.cornerA / 4].uv[e0.cornerA % 4];
+			const float *uvB0 = texFaces[e0.cornerB / 4].uv[e0.cornerB % 4];
+			const float *uvA1 = texFaces[e1.cornerA / 4].uv[e1.cornerA % 4];
+			const float *uvB1 = texFaces[e1.cornerB / 4].uv[e1.cornerB % 4];
+
+			border = uvA0[0] != uvA1[0] || uvA0[1] != uvA1[1] || uvB0[0] != uvB1[0] || uvB0[1] != uvB1[1];
+		}
+
+		if(border) {
+			m_Border[edges[i].a] = 1;
+			m_Border[edges[i].b] = 1;
+		}
+
+		i = end;
+	}
+}
+
+void BlenderSimplifier::BuildAdjacency() {
+	m_TriangleStart.assign(m_NumVertices + 1, 0);
+
+	for(size_t i=0; i < m_Triangles.size(); i++) {
+		m_TriangleStart[m_Triangles[i] + 1] += 1;
+	}
+
+	for(int v=0; v < m_NumVertices; v++) {
+		m_TriangleStart[v+1] += m_TriangleStart[v];
+	}
+
+	m_VertexTriangles.resize(m_Triangles.size());
+	std::vector<unsigned int> fill(m_TriangleStart.begin(), m_TriangleStart.end() - 1);
+
+	for(size_t i=0; i < m_Triangles.size(); i++) {
+		m_VertexTriangles[fill[m_Triangles[i]]++] = (unsigned int)(i / 3);
+	}
+}
+
+double BlenderSimplifier::Evaluate(const Quadric &q, const float p[3]) {
+	double x = p[0], y = p[1], z = p[2];
+
+	return q.a2 * x * x + 2 * q.ab * x * y + 2 * q.ac * x * z + 2 * q.ad * x
+		 + q.b2 * y * y + 2 * q.bc * y * z + 2 * q.bd * y
+		 + q.c2 * z * z + 2 * q.cd * z
+		 + q.d2;
+}
+
+// True if moving from onto to turns any remaining
+// triangle of from over, or collapses it to a line
+bool BlenderSimplifier::FlipsTriangle(int from, int to) {
+	for(unsigned int k=m_TriangleStart[from]; k < m_TriangleStart[from+1]; k++) {
+		const int *v = &m_Triangles[m_VertexTriangles[k] * 3];
+
+		if(v[0] == to || v[1] == to || v[2] == to) {
+			continue;
+		}
+
+		const float *p[3], *moved[3];
+		for(int j=0; j < 3; j++) {
+			p[j] = m_Vertices[v[j]].co;
+			moved[j] = (v[j] == from) ? m_Vertices[to].co : p[j];
+		}
+
+		double before[3], after[3];
+		TriangleNormal(p[0], p[1], p[2], before);
+		TriangleNormal(moved[0], moved[1], moved[2], after);
+
+		double dot = before[0] * after[0] + before[1] * after[1] + before[2] * after[2];
+		double lengths = sqrt(before[0] * before[0] + before[1] * before[1] + before[2] * before[2]) *
+						 sqrt(after[0] * after[0] + after[1] * after[1] + after[2] * after[2]);
+
+		if(lengths <= 0.0 || dot < 0.2 * lengths) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// Each pass sorts every possible collapse by cost and takes
+// them in order. The neighbours of a collapsed vertex are
+// locked until the next pass, so the flip tests stay exact.
+void BlenderSimplifier::Simplify(int targetTriangles) {
+	BLENDER_TRACE_SCOPE("BlenderSimplifier::Simplify");
+
+	std::vector<Collapse> collapses;
+	std::vector<unsigned long long> order;
+	std::vector<char> locked;
+	std::vector<int> remap;
+
+	while(GetNumTriangles() > targetTriangles) {
+		BuildAdjacency();
+		collapses.clear();
+
+		// Each half-edge offers its own direction, the twin
+		// half-edge in the next triangle offers the other
+		for(size_t i=0; i < m_Triangles.size(); i++) {
+			int from = m_Triangles[i];
+			int to = m_Triangles[i - i % 3 + (i + 1) % 3];
+
+			if(m_Border[from]) {
+				continue;
+			}
+
+			// The error of a quadric sum is the sum of the errors
+			const float *target = m_Vertices[to].co;
+			Collapse collapse = { Evaluate(m_Quadrics[from], target) + Evaluate(m_Quadrics[to], target), from, to };
+			collapses.push_back(collapse);
+		}
+
+		// Sorted as 64-bit keys, the float cost on top and the
+		// candidate index below. Non-negative floats order like
+		// their bits, and equal costs keep candidate order.
+		order.resize(collapses.size());
+		for(size_t i=0; i < collapses.size(); i++) {
+			float cost = collapses[i].cost > 0.0 ? (float)collapses[i].cost : 0.0f;
+			unsigned int bits;
+			memcpy(&bits, &cost, sizeof(bits));
+			order[i] = ((unsigned long long)bits << 32) | (unsigned int)i;
+		}
+
+		std::sort(order.begin(), order.end());
+
+		// A collapse removes about two triangles
+		int needed = (GetNumTriangles() - targetTriangles + 1) / 2;
+		int done = 0;
+
+		locked.assign(m_NumVertices, 0);
+		remap.resize(m_NumVertices);
+		for(int v=0; v < m_NumVertices; v++) {
+			remap[v] = v;
+		}
+
+		for(size_t i=0; i < order.size() && done < needed; i++) {
+			const Collapse &collapse = collapses[(unsigned int)order[i]];
+
+			if(locked[collapse.from] || locked[collapse.to] || FlipsTriangle(collapse.from, collapse.to)) {
+				continue;
+			}
+
+			remap[collapse.from] = collapse.to;
+
+			Quadric &q = m_Quadrics[collapse.to];
+			const Quadric &other = m_Quadrics[collapse.from];
+			q.a2 += other.a2;	q.ab += other.ab;	q.ac += other.ac;	q.ad += other.ad;
+			q.b2 += other.b2;	q.bc += other.bc;	q.bd += other.bd;
+			q.c2 += other.c2;	q.cd += other.cd;
+			q.d2 += other.d2;
+
+			if(collapse.cost > m_Error) {
+				m_Error = collapse.cost;
+			}
+
+			// Only the triangles of from change, locking their
+			// vertices keeps every later test on fresh triangles
+			for(unsigned int k=m_TriangleStart[collapse.from]; k < m_TriangleStart[collapse.from+1]; k++) {
+				const int *v = &m_Triangles[m_VertexTriangles[k] * 3];
+				locked[v[0]] = 1;
+				locked[v[1]] = 1;
+				locked[v[2]] = 1;
+			}
+
+			done++;
+		}
+
+		if(done == 0) {
+			break;
+		}
+
+		// Targets are locked, so one remap step is enough.
+		// Triangles that lost a corner are dropped.
+		size_t out = 0;
+		for(size_t t=0; t < m_Materials.size(); t++) {
+			int a = remap[m_Triangles[t * 3]];
+			int b = remap[m_Triangles[t * 3 + 1]];
+			int c = remap[m_Triangles[t * 3 + 2]];
+
+			if(a == b || b == c || c == a) {
+				continue;
+			}
+
+			m_Triangles[out * 3] = a;
+			m_Triangles[out * 3 + 1] = b;
+			m_Triangles[out * 3 + 2] = c;
+			m_Materials[out] = m_Materials[t];
+			out++;
+		}
+
+		m_Triangles.resize(out * 3);
+		m_Materials.resize(out);
+	}
+}
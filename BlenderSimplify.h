@@ -0,0 +1,69 @@
+#pragma once
+
+#include <vector>
+
+struct MVert;
+struct MFace;
+struct MTFace;
+
+////////////////////////////////////////////////
+// BlenderSimplifier
+//
+// Quadric error decimation by half-edge collapse:
+// a vertex only ever moves onto a neighbour, so
+// every LOD indexes the original vertex buffer.
+// Vertices on open borders, UV seams and material
+// borders are never collapsed.
+////////////////////////////////////////////////
+class BlenderSimplifier {
+public:
+	// Faces of a triangulated mesh use three vertices,
+	// otherwise isQuad faces are fanned into two triangles.
+	// texFaces may be null.
+	BlenderSimplifier(const MVert *vertices, int numVertices, const MFace *faces, const MTFace *texFaces, int numFaces, bool triangulated);
+
+	// Collapses edges until at most targetTriangles remain or
+	// no collapse is left. The state carries over, so calls
+	// with falling targets build a LOD chain.
+	void Simplify(int targetTriangles);
+
+	// Three vertex indices per triangle
+	const std::vector<int> &GetTriangles() const	{ return m_Triangles; }
+	const std::vector<short> &GetMaterials() const	{ return m_Materials; }
+	int GetNumTriangles() const						{ return (int)m_Materials.size(); }
+
+	// Largest collapse cost so far, a sum of area weighted
+	// squared distances to the original planes
+	double GetError() const							{ return m_Error; }
+
+private:
+	struct Quadric {
+		double a2, ab, ac, ad, b2, bc, bd, c2, cd, d2;
+	};
+
+	struct Collapse {
+		double cost;
+		int from;
+		int to;
+	};
+
+	void ComputeQuadrics();
+	void FindBorders(const MTFace *texFaces, const std::vector<int> &corners);
+	void BuildAdjacency();
+	bool FlipsTriangle(int from, int to);
+	double Evaluate(const Quadric &q, const float p[3]);
+
+	const MVert *m_Vertices;
+	int m_NumVertices;
+	double m_Error;
+
+	std::vector<int> m_Triangles;
+	std::vector<short> m_Materials;
+
+	std::vector<Quadric> m_Quadrics;
+	std::vector<char> m_Border;
+
+	// Vertex to triangle table, rebuilt every pass
+	std::vector<unsigned int> m_TriangleStart;
+	std::vector<unsigned int> m_VertexTriangles;
+};
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+// A non-owning view over a contiguous array, used to hand
+// out blocks and mesh arrays without copying them. The
+// owner must outlive the view.
+template<typename T>
+class BlenderSpan {
+public:
+	BlenderSpan() { m_Data = 0; m_Size = 0; }
+	BlenderSpan(T *data, size_t size) { m_Data = data; m_Size = size; }
+
+	template<typename U>
+	BlenderSpan(std::vector<U> &v) { m_Data = v.empty() ? 0 : &v[0]; m_Size = v.size(); }
+
+	template<typename U>
+	BlenderSpan(const std::vector<U> &v) { m_Data = v.empty() ? 0 : &v[0]; m_Size = v.size(); }
+
+	T &operator[](size_t i) const	{ return m_Data[i]; }
+	T *begin() const				{ return m_Data; }
+	T *end() const					{ return m_Data + m_Size; }
+	T *data() const					{ return m_Data; }
+	size_t size() const				{ return m_Size; }
+	bool empty() const				{ return m_Size == 0; }
+
+	BlenderSpan<T> subspan(size_t offset, size_t count) const { return BlenderSpan<T>(m_Data + offset, count); }
+
+private:
+	T *m_Data;
+	size_t m_Size;
+};
@@ -5,19 +5,52 @@
 // StuctureDNA implementation
 //
 ///////////////////////////////
-Structure *StructureDNA::GetStructureByType(std::string type) {
-	unsigned int type_idx;
-	for(unsigned int i=0; i < types.size(); i++) {
-		if(types[i] == type) {
-			type_idx = i;
-			break;
+// The first struct of each type wins, as with the scans
+// used before the index is built
+void StructureDNA::BuildIndex() {
+	structureByType.clear();
+	structureByTypeIndex.assign(types.size(), -1);
+
+	for(unsigned int i=0; i < structures.size(); i++) {
+		unsigned short type = structures[i].type_idx;
+
+		if(type < structureByTypeIndex.size() && structureByTypeIndex[type] == -1) {
+			structureByTypeIndex[type] = (int)i;
+			structureByType[types[type]] = (int)i;
+		}
+	}
+}
+
+int StructureDNA::GetStructureIndex(const std::string &type) const {
+	if(!structureByTypeIndex.empty()) {
+		std::unordered_map<std::string, int>::const_iterator it = structureByType.find(type);
+		return (it == structureByType.end()) ? -1 : it->second;
+	}
+
+	for(unsigned int i=0; i < structures.size(); i++) {
+		if(types[structures[i].type_idx] == type) {
+			return (int)i;
 		}
 	}
 
-	return GetStructureByTypeIndex(type_idx);
+	return -1;
+}
+
+Structure *StructureDNA::GetStructureByType(const std::string &type) {
+	int index = GetStructureIndex(type);
+	return (index == -1) ? 0 : &structures[index];
 }
 
 Structure *StructureDNA::GetStructureByTypeIndex(unsigned int type_idx) {
+	return const_cast<Structure *>(static_cast<const StructureDNA *>(this)->GetStructureByTypeIndex(type_idx));
+}
+
+const Structure *StructureDNA::GetStructureByTypeIndex(unsigned int type_idx) const {
+	if(!structureByTypeIndex.empty()) {
+		int index = (type_idx < structureByTypeIndex.size()) ? structureByTypeIndex[type_idx] : -1;
+		return (index == -1) ? 0 : &structures[index];
+	}
+
 	for(unsigned int i=0; i < structures.size(); i++) {
 		if(structures[i].type_idx == type_idx) {
 			return &structures[i];
@@ -27,6 +60,30 @@ Structure *StructureDNA::GetStructureByTypeIndex(unsigned int type_idx) {
 	return 0;
 }
 
-Structure *StructureDNA::GetStructureFromBlock(BlenderFileBlock *fBlock) {
+Structure *StructureDNA::GetStructureFromBlock(const BlenderFileBlock *fBlock) {
 	return &structures[fBlock->m_Header.sdna];
+}
+
+const Structure *StructureDNA::GetStructureFromBlock(const BlenderFileBlock *fBlock) const {
+	return &structures[fBlock->m_Header.sdna];
+}
+
+int StructureDNA::GetIDNameOffset(unsigned int sdna_idx) const {
+	if(sdna_idx >= structures.size() || structures[sdna_idx].fields.empty()) {
+		return -1;
+	}
+
+	const Field &first = structures[sdna_idx].fields[0];
+	if(types[first.type_idx] != "ID" || names[first.name_idx] != "id") {
+		return -1;
+	}
+
+	const Structure *id = GetStructureByTypeIndex(first.type_idx);
+	for(unsigned int i=0; id && i < id->fields.size(); i++) {
+		if(names[id->fields[i].name_idx] == "name[66]") {
+			return first.offset + id->fields[i].offset;
+		}
+	}
+
+	return -1;
 }
\ No newline at end of file
@@ -2,6 +2,7 @@
 
 #include <string>
 #include <vector>
+#include <unordered_map>
 #include <iostream>
 
 struct Field {
@@ -15,6 +16,8 @@ struct Structure {
 	std::vector<Field> fields;
 };
 
+// Read once from the DNA1 block and never written after
+// that, so every const method is safe from any thread
 class BlenderFileBlock;
 struct StructureDNA {
 	std::vector<std::string> names;
@@ -22,9 +25,27 @@ struct StructureDNA {
 	std::vector<unsigned short> lengths;
 	std::vector<Structure> structures;
 
-	Structure *GetStructureByType(std::string type);
+	// Pointer size of the file, field offsets depend on it
+	unsigned short pointer_size;
+
+	// Struct index by type name and by type index, -1 for
+	// types that are not structs. Filled by BuildIndex
+	// once the structures are read.
+	std::unordered_map<std::string, int> structureByType;
+	std::vector<int> structureByTypeIndex;
+	void BuildIndex();
+
+	// Index into structures, -1 if there is no such struct
+	int GetStructureIndex(const std::string &type) const;
+	Structure *GetStructureByType(const std::string &type);
 	Structure *GetStructureByTypeIndex(unsigned int type_idx);
-	Structure *GetStructureFromBlock(BlenderFileBlock *fBlock);
-	std::string GetType(unsigned short type_idx) { return types[type_idx]; }
-	std::string GetName(unsigned short name_idx) { return names[name_idx]; }
+	const Structure *GetStructureByTypeIndex(unsigned int type_idx) const;
+	Structure *GetStructureFromBlock(const BlenderFileBlock *fBlock);
+	const Structure *GetStructureFromBlock(const BlenderFileBlock *fBlock) const;
+
+	// Offset of ID.name in a datablock struct, -1 if
+	// the struct does not start with an ID
+	int GetIDNameOffset(unsigned int sdna_idx) const;
+	const std::string &GetType(unsigned short type_idx) const { return types[type_idx]; }
+	const std::string &GetName(unsigned short name_idx) const { return names[name_idx]; }
 };
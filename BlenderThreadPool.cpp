@@ -0,0 +1,105 @@
+#include "BlenderThreadPool.h"
+
+#include <utility>
+
+////////////////////////////////////
+// BlenderThreadPool implementation
+////////////////////////////////////
+BlenderThreadPool::BlenderThreadPool(unsigned int numThreads) {
+	m_Running = 0;
+	m_Stop = false;
+
+	if(numThreads == 0) {
+		numThreads = std::thread::hardware_concurrency();
+	}
+
+	if(numThreads == 0) {
+		numThreads = 1;
+	}
+
+	for(unsigned int i=0; i < numThreads; i++) {
+		m_Threads.push_back(std::thread(&BlenderThreadPool::WorkerThread, this));
+	}
+}
+
+BlenderThreadPool::~BlenderThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Stop = true;
+	}
+
+	m_TaskReady.notify_all();
+
+	for(unsigned int i=0; i < m_Threads.size(); i++) {
+		m_Threads[i].join();
+	}
+}
+
+void BlenderThreadPool::Submit(std::function<void()> task) {
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Tasks.push_back(std::move(task));
+	}
+
+	m_TaskReady.notify_one();
+}
+
+void BlenderThreadPool::Wait() {
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	m_TasksDone.wait(lock, [this] { return m_Tasks.empty() && m_Running == 0; });
+}
+
+void BlenderThreadPool::ParallelFor(size_t count, size_t minBatch, const std::function<void(size_t begin, size_t end)> &fn) {
+	if(minBatch == 0) {
+		minBatch = 1;
+	}
+
+	size_t numBatches = (count + minBatch - 1) / minBatch;
+	if(numBatches > 4 * m_Threads.size()) {
+		numBatches = 4 * m_Threads.size();
+	}
+
+	if(numBatches <= 1) {
+		fn(0, count);
+		return;
+	}
+
+	size_t batchSize = (count + numBatches - 1) / numBatches;
+
+	for(size_t begin=0; begin < count; begin += batchSize) {
+		size_t end = (begin + batchSize < count) ? begin + batchSize : count;
+		Submit([&fn, begin, end] { fn(begin, end); });
+	}
+
+	Wait();
+}
+
+void BlenderThreadPool::WorkerThread() {
+	while(true) {
+		std::function<void()> task;
+
+		{
+			std::unique_lock<std::mutex> lock(m_Mutex);
+			m_TaskReady.wait(lock, [this] { return m_Stop || !m_Tasks.empty(); });
+
+			if(m_Tasks.empty()) {
+				return;
+			}
+
+			task = std::move(m_Tasks.front());
+			m_Tasks.pop_front();
+			m_Running += 1;
+		}
+
+		task();
+
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_Running -= 1;
+
+			if(m_Tasks.empty() && m_Running == 0) {
+				m_TasksDone.notify_all();
+			}
+		}
+	}
+}
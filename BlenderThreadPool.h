@@ -0,0 +1,48 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+////////////////////////////////////////////////
+// BlenderThreadPool
+//
+// A fixed set of workers draining a FIFO queue.
+// Submit and Wait are meant to be called from
+// a single owning thread.
+////////////////////////////////////////////////
+class BlenderThreadPool {
+public:
+	// 0 threads uses the hardware concurrency
+	BlenderThreadPool(unsigned int numThreads = 0);
+	~BlenderThreadPool();
+
+	BlenderThreadPool(const BlenderThreadPool &) = delete;
+	BlenderThreadPool &operator=(const BlenderThreadPool &) = delete;
+
+	void Submit(std::function<void()> task);
+
+	// Blocks until every submitted task has finished
+	void Wait();
+
+	// Runs fn over [0, count) split into batches of at least
+	// minBatch items, and waits for them. Small ranges run
+	// inline on the calling thread.
+	void ParallelFor(size_t count, size_t minBatch, const std::function<void(size_t begin, size_t end)> &fn);
+
+	unsigned int GetNumThreads() { return (unsigned int)m_Threads.size(); }
+
+private:
+	void WorkerThread();
+
+	std::vector<std::thread> m_Threads;
+	std::deque<std::function<void()> > m_Tasks;
+	std::mutex m_Mutex;
+	std::condition_variable m_TaskReady;
+	std::condition_variable m_TasksDone;
+	unsigned int m_Running;
+	bool m_Stop;
+};
@@ -0,0 +1,153 @@
+#include "BlenderTrace.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <fstream>
+#include <iostream>
+#include <functional>
+
+static std::atomic<BlenderTraceSink *> s_Sink(0);
+static std::atomic<int> s_Level(BLENDER_TRACE_INFO);
+static std::atomic<long long> s_Counters[BLENDER_COUNTER_COUNT];
+
+static const char *s_LevelNames[] = { "Error", "Warning", "Info", "Debug", "Verbose" };
+static const char *s_CounterNames[] = { "blocks", "bytes", "vertices", "triangles", "allocations" };
+
+///////////////////////////////
+// BlenderTrace implementation
+///////////////////////////////
+void BlenderTrace::SetSink(BlenderTraceSink *sink) {
+	s_Sink = sink;
+}
+
+void BlenderTrace::SetLevel(BlenderTraceLevel level) {
+	s_Level = level;
+}
+
+bool BlenderTrace::IsEnabled(BlenderTraceLevel level) {
+	return s_Sink.load() != 0 && (int)level <= s_Level.load();
+}
+
+void BlenderTrace::Log(BlenderTraceLevel level, const std::string &message) {
+	BlenderTraceSink *sink = s_Sink;
+
+	if(sink && (int)level <= s_Level.load()) {
+		sink->Message(level, message);
+	}
+}
+
+void BlenderTrace::EmitEvent(const char *name, long long startMicros, long long durationMicros) {
+	BlenderTraceSink *sink = s_Sink;
+
+	if(sink) {
+		sink->Event(name, startMicros, durationMicros, GetThreadId());
+	}
+}
+
+void BlenderTrace::AddCounter(BlenderTraceCounter counter, long long value) {
+	s_Counters[counter] += value;
+}
+
+long long BlenderTrace::GetCounter(BlenderTraceCounter counter) {
+	return s_Counters[counter];
+}
+
+const char *BlenderTrace::GetCounterName(BlenderTraceCounter counter) {
+	return s_CounterNames[counter];
+}
+
+std::string BlenderTrace::GetCounterInfo() {
+	std::string output;
+	char buffer[128];
+
+	for(int i=0; i < BLENDER_COUNTER_COUNT; i++) {
+		sprintf_s(buffer, "%s: %lld\n", s_CounterNames[i], s_Counters[i].load());
+		output += buffer;
+	}
+
+	return output;
+}
+
+void BlenderTrace::ResetCounters() {
+	for(int i=0; i < BLENDER_COUNTER_COUNT; i++) {
+		s_Counters[i] = 0;
+	}
+}
+
+long long BlenderTrace::Now() {
+	return std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+unsigned int BlenderTrace::GetThreadId() {
+	return (unsigned int)std::hash<std::thread::id>()(std::this_thread::get_id());
+}
+
+//////////////////////////////////////////
+// BlenderStreamTraceSink implementation
+//////////////////////////////////////////
+BlenderStreamTraceSink::BlenderStreamTraceSink() {
+	m_Stream = &std::cout;
+}
+
+void BlenderStreamTraceSink::Message(BlenderTraceLevel level, const std::string &message) {
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	*m_Stream << "[" << s_LevelNames[level] << "] " << message << "\n";
+}
+
+//////////////////////////////////////////
+// BlenderChromeTraceSink implementation
+//////////////////////////////////////////
+void BlenderChromeTraceSink::Event(const char *name, long long startMicros, long long durationMicros, unsigned int threadId) {
+	TraceEvent e;
+	e.name = name;
+	e.start = startMicros;
+	e.duration = durationMicros;
+	e.threadId = threadId;
+
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	m_Events.push_back(e);
+}
+
+std::string BlenderChromeTraceSink::GetJSON() {
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	std::string output = "{\"traceEvents\":[\n";
+	char buffer[256];
+
+	for(unsigned int i=0; i < m_Events.size(); i++) {
+		sprintf_s(buffer, "{\"name\":\"%s\",\"cat\":\"blender\",\"ph\":\"X\",\"ts\":%lld,\"dur\":%lld,\"pid\":1,\"tid\":%u}%s\n",
+					m_Events[i].name,
+					m_Events[i].start,
+					m_Events[i].duration,
+					m_Events[i].threadId,
+					(i+1 < m_Events.size() ? "," : ""));
+		output += buffer;
+	}
+
+	output += "],\n\"otherData\":{";
+
+	for(int i=0; i < BLENDER_COUNTER_COUNT; i++) {
+		sprintf_s(buffer, "\"%s\":%lld%s", s_CounterNames[i], s_Counters[i].load(), (i+1 < BLENDER_COUNTER_COUNT ? "," : ""));
+		output += buffer;
+	}
+
+	output += "}}\n";
+	return output;
+}
+
+bool BlenderChromeTraceSink::WriteJSON(std::string filename) {
+	std::ofstream file(filename.c_str(), std::ofstream::out | std::ofstream::trunc);
+
+	if(!file.is_open()) {
+		return false;
+	}
+
+	file << GetJSON();
+	return true;
+}
+
+void BlenderChromeTraceSink::Clear() {
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	m_Events.clear();
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <string>
+#include <sstream>
+#include <vector>
+#include <mutex>
+
+////////////////////////////////////////////////
+// Instrumentation and tracing
+//
+// All of the macros below compile to nothing
+// unless BLENDER_IMPORTER_TRACE is defined, so
+// the load path pays nothing for them by default.
+////////////////////////////////////////////////
+enum BlenderTraceLevel {
+	BLENDER_TRACE_ERROR = 0,
+	BLENDER_TRACE_WARNING,
+	BLENDER_TRACE_INFO,
+	BLENDER_TRACE_DEBUG,
+	BLENDER_TRACE_VERBOSE
+};
+
+enum BlenderTraceCounter {
+	BLENDER_COUNTER_BLOCKS = 0,
+	BLENDER_COUNTER_BYTES,
+	BLENDER_COUNTER_VERTICES,
+	BLENDER_COUNTER_TRIANGLES,
+	BLENDER_COUNTER_ALLOCATIONS,
+	BLENDER_COUNTER_COUNT
+};
+
+// Receives messages and timed events, install
+// one with BlenderTrace::SetSink. Sinks may be called
+// from several threads at once.
+class BlenderTraceSink {
+public:
+	virtual ~BlenderTraceSink() {}
+
+	virtual void Message(BlenderTraceLevel /*level*/, const std::string &/*message*/) {}
+	virtual void Event(const char */*name*/, long long /*startMicros*/, long long /*durationMicros*/, unsigned int /*threadId*/) {}
+};
+
+// Writes messages to a stream, std::cout by default
+class BlenderStreamTraceSink : public BlenderTraceSink {
+public:
+	BlenderStreamTraceSink();
+	BlenderStreamTraceSink(std::ostream *stream) { m_Stream = stream; }
+
+	void Message(BlenderTraceLevel level, const std::string &message);
+
+private:
+	std::ostream *m_Stream;
+	std::mutex m_Mutex;
+};
+
+// Collects timed events and writes them in the Chrome trace
+// event format, which chrome://tracing and Perfetto can open
+class BlenderChromeTraceSink : public BlenderTraceSink {
+public:
+	BlenderChromeTraceSink() {}
+
+	void Event(const char *name, long long startMicros, long long durationMicros, unsigned int threadId);
+
+	std::string GetJSON();
+	bool WriteJSON(std::string filename);
+	void Clear();
+
+private:
+	struct TraceEvent {
+		const char *name;
+		long long start;
+		long long duration;
+		unsigned int threadId;
+	};
+
+	std::vector<TraceEvent> m_Events;
+	std::mutex m_Mutex;
+};
+
+class BlenderTrace {
+public:
+	static void SetSink(BlenderTraceSink *sink);
+	static void SetLevel(BlenderTraceLevel level);
+	static bool IsEnabled(BlenderTraceLevel level);
+
+	static void Log(BlenderTraceLevel level, const std::string &message);
+	static void EmitEvent(const char *name, long long startMicros, long long durationMicros);
+
+	static void AddCounter(BlenderTraceCounter counter, long long value);
+	static long long GetCounter(BlenderTraceCounter counter);
+	static const char *GetCounterName(BlenderTraceCounter counter);
+	static std::string GetCounterInfo();
+	static void ResetCounters();
+
+	static long long Now();
+	static unsigned int GetThreadId();
+};
+
+// Emits an event covering the lifetime of the object
+class BlenderScopedTimer {
+public:
+	BlenderScopedTimer(const char *name) { m_Name = name; m_Start = BlenderTrace::Now(); }
+	~BlenderScopedTimer() { BlenderTrace::EmitEvent(m_Name, m_Start, BlenderTrace::Now() - m_Start); }
+
+private:
+	const char *m_Name;
+	long long m_Start;
+};
+
+#define BLENDER_TRACE_CONCAT_INNER(a, b) a##b
+#define BLENDER_TRACE_CONCAT(a, b) BLENDER_TRACE_CONCAT_INNER(a, b)
+
+#ifdef BLENDER_IMPORTER_TRACE
+#define BLENDER_TRACE_SCOPE(name) BlenderScopedTimer BLENDER_TRACE_CONCAT(blenderScopedTimer, __LINE__)(name)
+#define BLENDER_TRACE_COUNT(counter, value) BlenderTrace::AddCounter(counter, (long long)(value))
+#define BLENDER_LOG(level, message) \
+	do { \
+		if(BlenderTrace::IsEnabled(level)) { \
+			std::ostringstream blenderLogStream; \
+			blenderLogStream << message; \
+			BlenderTrace::Log(level, blenderLogStream.str()); \
+		} \
+	} while(0)
+#else
+#define BLENDER_TRACE_SCOPE(name) ((void)0)
+#define BLENDER_TRACE_COUNT(counter, value) ((void)0)
+#define BLENDER_LOG(level, message) ((void)0)
+#endif
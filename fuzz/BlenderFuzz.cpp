@@ -0,0 +1,69 @@
+// libFuzzer target for the loader, built from the repository root with e.g.
+//   clang++ -std=c++17 -g -O1 -fsanitize=fuzzer,address,undefined -I. *.cpp fuzz/BlenderFuzz.cpp
+// The first byte picks a configuration, the rest is loaded as a .blend
+// from memory. Validation stays on, it is what makes untrusted input safe.
+#include "BlenderImporter.h"
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+static BlenderImporterConfig MakeConfig(uint8_t variant) {
+	BlenderImporterConfig config;
+	config.triangulate = true;
+	config.vertexUVs = true;
+
+	switch(variant % 6) {
+	case 1:
+		config.pipeline.enabled = true;
+		config.pipeline.readAheadChunkSize = 4096;
+		config.pipeline.readAheadChunks = 2;
+		config.pipeline.extractionThreads = 2;
+		break;
+	case 2:
+		config.streaming.enabled = true;
+		config.streaming.memoryBudget = 1 << 16;
+		break;
+	case 3:
+		config.deferPackedFiles = true;
+		break;
+	case 4:
+		config.filter.idCodes.push_back("ME");
+		config.filter.idCodes.push_back("OB");
+		config.filter.extract = BLENDER_EXTRACT_NORMALS | BLENDER_EXTRACT_UVS;
+		break;
+	case 5:
+		config.materialSubmeshes = true;
+		config.buildBVH = true;
+		config.tangents = true;
+		config.adjacency = true;
+		config.lodRatios.push_back(0.5f);
+		config.actionBakeStep = 1.0f;
+		break;
+	}
+
+	return config;
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+	if(size < 1) {
+		return 0;
+	}
+
+	BlenderImporterConfig config = MakeConfig(data[0]);
+	BlenderFile file(BlenderSource::Memory(data + 1, size - 1, "fuzz.blend"), config);
+
+	if(!file.Load()) {
+		return 0;
+	}
+
+	std::vector<unsigned char> buffer;
+	const BlenderFile &frozen = file;
+
+	for(int i=0; i < file.GetNumPackedFiles(); i++) {
+		frozen.ReadPackedFile(i, buffer);
+		file.LoadPackedFile(i);
+	}
+
+	return 0;
+}